@@ -7,12 +7,15 @@ struct AppContext {
     class Input *input;         // user interface data
     class Terrain *terrain;     // terrain geometry
     class Marker *lightmarker;  // light marker geometry
+    class ThreadPool *pool;     // worker threads
+    class FrameCapture *capture; // frame recording
 
     // uniform (aka shader parameter) block indices
     enum { SCENE_UNIFORMS, MODEL_UNIFORMS };
 
     // initialize all pointers to NULL to allow delete in destructor
-    AppContext() : scene(0), input(0), terrain(0), lightmarker(0) {}
+    AppContext() : scene(0), input(0), terrain(0), lightmarker(0), pool(0),
+                   capture(0) {}
 
     // clean up any context data
     ~AppContext();
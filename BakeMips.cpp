@@ -0,0 +1,501 @@
+//
+// BakeMips: build the full mipmap chain for a texture offline and store
+// it as a MipChain file (see MipChain.hpp)
+//
+// usage: BakeMips [-albedo | -normal | -linear] [-box | -kaiser]
+//                 [-rgb | -bc1 | -bc4 | -bc5] [-j threads] input.ppm output.mip
+//
+//   -albedo  color in sRGB: filter in linear space (default)
+//   -normal  tangent-space normal map: filter, then renormalize
+//   -linear  data that is already linear, like gloss
+//   -box     2x2 box filter, like most glGenerateMipmap (default)
+//   -kaiser  8-tap Kaiser-windowed sinc, sharper, wrapping at edges
+//   -rgb     store uncompressed 8-bit rgb (default)
+//   -bc1     compress rgb to BC1, for color
+//   -bc4     compress red to BC4, for single-channel data like gloss
+//   -bc5     compress red & green to BC5, for normal maps
+//
+// Compressed levels are decoded again to report the error against the
+// uncompressed level as PSNR.
+//
+// Levels are computed in floating point, each from the previous level,
+// and only rounded to 8 bits for output. The filters use SSE2 where
+// available.
+//
+
+#include "ImagePPM.hpp"
+#include "MipChain.hpp"
+#include "ThreadPool.hpp"
+#include "BlockCompress.hpp"
+#include "Simd.hpp"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <chrono>
+#include <vector>
+
+#ifdef _WIN32
+// don't complain if we use standard IO functions instead of windows-only
+#pragma warning( disable: 4996 )
+#endif
+
+enum Mode { ALBEDO, NORMAL, LINEAR };
+enum Filter { BOX, KAISER };
+
+// Kaiser filter taps, centered between input texels 3 and 4
+enum { TAPS = 8 };
+static float kaiser[TAPS];
+
+//
+// one level as three planes of floats
+//
+struct Planes {
+    unsigned int width, height;
+    std::vector<float> c[3];
+
+    Planes(unsigned int w, unsigned int h) : width(w), height(h) {
+        for(int i=0; i<3; ++i) c[i].resize(size_t(w) * h);
+    }
+};
+
+//
+// sRGB to linear and back
+//
+static float srgbToLinear(float v)
+{
+    return v <= 0.04045f ? v / 12.92f : powf((v + 0.055f) / 1.055f, 2.4f);
+}
+static float linearToSrgb(float v)
+{
+    return v <= 0.0031308f ? v * 12.92f : 1.055f * powf(v, 1/2.4f) - 0.055f;
+}
+
+// linear to sRGB through a table, since pow per texel is slow
+enum { SRGB_TABLE = 4096 };
+static unsigned char srgbTable[SRGB_TABLE + 1];
+
+static unsigned char toByte(float v)
+{
+    v = v * 255.f + 0.5f;
+    return (unsigned char)(v < 0 ? 0 : v > 255 ? 255 : v);
+}
+
+//
+// set up tables and filter weights
+//
+static void initTables()
+{
+    for(int i=0; i <= SRGB_TABLE; ++i)
+        srgbTable[i] = toByte(linearToSrgb(float(i) / SRGB_TABLE));
+
+    // Kaiser-windowed sinc for 2x reduction
+    // I0 is the zeroth order modified Bessel function
+    const double beta = 4, halfWidth = TAPS / 2;
+    double sum = 0, weight[TAPS];
+    for(int k=0; k < TAPS; ++k) {
+        double t = k - (TAPS-1) / 2.;           // distance from center
+        double x = t / halfWidth, arg = beta * sqrt(1 - x*x), I0 = 1, I0b = 1;
+        double term = 1, termb = 1;
+        for(int n=1; n < 20; ++n) {
+            term *= (arg/2) / n;  I0 += term*term;
+            termb *= (beta/2) / n;  I0b += termb*termb;
+        }
+        double s = t * 3.14159265358979 / 2;
+        weight[k] = (s == 0 ? 1 : sin(s) / s) * I0 / I0b;
+        sum += weight[k];
+    }
+    for(int k=0; k < TAPS; ++k)
+        kaiser[k] = float(weight[k] / sum);
+}
+
+//
+// convert image to planes of linear floats
+//
+static void toPlanes(const ImagePPM &image, Mode mode, Planes &out)
+{
+    float table[256];
+    for(int i=0; i < 256; ++i) {
+        float v = i / 255.f;
+        table[i] = mode == ALBEDO ? srgbToLinear(v)
+                 : mode == NORMAL ? v * 2 - 1 : v;
+    }
+
+    size_t count = size_t(image.width) * image.height;
+    for(size_t i=0; i < count; ++i) {
+        out.c[0][i] = table[image.image[i].r];
+        out.c[1][i] = table[image.image[i].g];
+        out.c[2][i] = table[image.image[i].b];
+    }
+}
+
+//
+// convert planes back to interleaved 8-bit rgb
+//
+static void fromPlanes(const Planes &in, Mode mode, unsigned char *out)
+{
+    size_t count = size_t(in.width) * in.height;
+    for(int c=0; c < 3; ++c) {
+        const float *p = &in.c[c][0];
+        for(size_t i=0; i < count; ++i) {
+            float v = p[i];
+            unsigned char b;
+            if (mode == ALBEDO) {
+                v = v < 0 ? 0 : v > 1 ? 1 : v;
+                b = srgbTable[int(v * SRGB_TABLE + 0.5f)];
+            }
+            else if (mode == NORMAL)
+                b = toByte(v * 0.5f + 0.5f);
+            else
+                b = toByte(v);
+            out[3*i + c] = b;
+        }
+    }
+}
+
+//
+// 2x2 box filter one row of one plane
+// src rows a and b are srcWidth wide, output is dstWidth wide
+//
+static void boxRow(const float *a, const float *b, unsigned int srcWidth,
+                   float *out, unsigned int dstWidth)
+{
+    unsigned int x = 0;
+    if (srcWidth > 1) {
+#ifdef USE_SSE2
+        // four outputs from eight inputs of each row, split into even
+        // and odd texels so they add in the same order as below, and
+        // give the same bits
+        __m128 quarter = _mm_set1_ps(0.25f);
+        for(; 2*x + 8 <= srcWidth && x + 4 <= dstWidth; x += 4) {
+            __m128 a0 = _mm_loadu_ps(a + 2*x), a1 = _mm_loadu_ps(a + 2*x + 4);
+            __m128 b0 = _mm_loadu_ps(b + 2*x), b1 = _mm_loadu_ps(b + 2*x + 4);
+            __m128 sum = _mm_add_ps(
+                _mm_shuffle_ps(a0, a1, _MM_SHUFFLE(2,0,2,0)),
+                _mm_shuffle_ps(a0, a1, _MM_SHUFFLE(3,1,3,1)));
+            sum = _mm_add_ps(sum, _mm_shuffle_ps(b0, b1, _MM_SHUFFLE(2,0,2,0)));
+            sum = _mm_add_ps(sum, _mm_shuffle_ps(b0, b1, _MM_SHUFFLE(3,1,3,1)));
+            _mm_storeu_ps(out + x, _mm_mul_ps(sum, quarter));
+        }
+#endif
+        for(; x < dstWidth; ++x)
+            out[x] = 0.25f * (a[2*x] + a[2*x+1] + b[2*x] + b[2*x+1]);
+    }
+    else                        // 1 texel wide: only average rows
+        out[0] = 0.5f * (a[0] + b[0]);
+}
+
+//
+// horizontal Kaiser pass for one row, wrapping at the edges
+//
+static void kaiserRow(const float *in, unsigned int srcWidth,
+                      float *out, unsigned int dstWidth)
+{
+    for(unsigned int x=0; x < dstWidth; ) {
+        int first = int(2*x) - (TAPS/2 - 1);
+#ifdef USE_SSE2
+        // four outputs at once if all taps are inside the row
+        // each tap loads 8 texels, starting at most TAPS-1 past first
+        if (first >= 0 && first + TAPS-1 + 8 <= int(srcWidth) &&
+            x + 4 <= dstWidth) {
+            __m128 sum = _mm_setzero_ps();
+            for(int k=0; k < TAPS; ++k) {
+                const float *p = in + first + k;
+                __m128 even = _mm_shuffle_ps(_mm_loadu_ps(p), _mm_loadu_ps(p+4),
+                                             _MM_SHUFFLE(2,0,2,0));
+                sum = _mm_add_ps(sum, _mm_mul_ps(even, _mm_set1_ps(kaiser[k])));
+            }
+            _mm_storeu_ps(out + x, sum);
+            x += 4;
+            continue;
+        }
+#endif
+        float sum = 0;
+        for(int k=0; k < TAPS; ++k) {
+            int i = (first + k) % int(srcWidth);
+            if (i < 0) i += srcWidth;
+            sum += kaiser[k] * in[i];
+        }
+        out[x++] = sum;
+    }
+}
+
+//
+// weighted sum of rows: out = sum(weight[k] * rows[k])
+//
+static void sumRows(const float *const *rows, const float *weight, int count,
+                    unsigned int width, float *out)
+{
+    unsigned int x = 0;
+#ifdef USE_SSE2
+    for(; x + 4 <= width; x += 4) {
+        __m128 sum = _mm_setzero_ps();
+        for(int k=0; k < count; ++k)
+            sum = _mm_add_ps(sum, _mm_mul_ps(_mm_loadu_ps(rows[k] + x),
+                                             _mm_set1_ps(weight[k])));
+        _mm_storeu_ps(out + x, sum);
+    }
+#endif
+    for(; x < width; ++x) {
+        float sum = 0;
+        for(int k=0; k < count; ++k)
+            sum += weight[k] * rows[k][x];
+        out[x] = sum;
+    }
+}
+
+//
+// renormalize normal vectors
+//
+static void renormalize(Planes &p, unsigned int y0, unsigned int y1)
+{
+    float *nx = &p.c[0][0], *ny = &p.c[1][0], *nz = &p.c[2][0];
+    size_t i = size_t(y0) * p.width, end = size_t(y1) * p.width;
+#ifdef USE_SSE2
+    for(; i + 4 <= end; i += 4) {
+        __m128 x = _mm_loadu_ps(nx+i), y = _mm_loadu_ps(ny+i), z = _mm_loadu_ps(nz+i);
+        __m128 len2 = _mm_add_ps(_mm_add_ps(_mm_mul_ps(x,x), _mm_mul_ps(y,y)),
+                                 _mm_mul_ps(z,z));
+        // guard against zero length, which would be a flat normal
+        __m128 zero = _mm_cmpeq_ps(len2, _mm_setzero_ps());
+        __m128 scale = _mm_div_ps(_mm_set1_ps(1.f),
+                                  _mm_sqrt_ps(_mm_max_ps(len2, _mm_set1_ps(1e-20f))));
+        z = _mm_or_ps(_mm_and_ps(zero, _mm_set1_ps(1.f)),
+                      _mm_andnot_ps(zero, _mm_mul_ps(z, scale)));
+        _mm_storeu_ps(nx+i, _mm_mul_ps(x, scale));
+        _mm_storeu_ps(ny+i, _mm_mul_ps(y, scale));
+        _mm_storeu_ps(nz+i, z);
+    }
+#endif
+    for(; i < end; ++i) {
+        float len2 = nx[i]*nx[i] + ny[i]*ny[i] + nz[i]*nz[i];
+        if (len2 == 0) { nz[i] = 1; continue; }
+        float scale = 1 / sqrtf(len2);
+        nx[i] *= scale;  ny[i] *= scale;  nz[i] *= scale;
+    }
+}
+
+//
+// make next smaller level from src
+//
+static void downsample(const Planes &src, Planes &dst, Filter filter,
+                       Mode mode, ThreadPool &pool)
+{
+    const Planes *in = &src;
+    Planes *out = &dst;
+
+    if (filter == BOX) {
+        pool.parallelFor(0, dst.height, [=](unsigned int y0, unsigned int y1) {
+            for(unsigned int y = y0; y < y1; ++y) {
+                unsigned int ya = in->height > 1 ? 2*y : 0;
+                unsigned int yb = in->height > 1 ? 2*y+1 : 0;
+                for(int c=0; c < 3; ++c)
+                    boxRow(&in->c[c][size_t(ya) * in->width],
+                           &in->c[c][size_t(yb) * in->width], in->width,
+                           &out->c[c][size_t(y) * out->width], out->width);
+            }
+            if (mode == NORMAL) renormalize(*out, y0, y1);
+        });
+        return;
+    }
+
+    // Kaiser: horizontal pass into tmp, then vertical pass
+    Planes tmp(dst.width, src.height);
+    Planes *mid = &tmp;
+    pool.parallelFor(0, src.height, [=](unsigned int y0, unsigned int y1) {
+        for(unsigned int y = y0; y < y1; ++y)
+            for(int c=0; c < 3; ++c) {
+                const float *row = &in->c[c][size_t(y) * in->width];
+                float *o = &mid->c[c][size_t(y) * mid->width];
+                if (in->width > 1)
+                    kaiserRow(row, in->width, o, mid->width);
+                else
+                    o[0] = row[0];
+            }
+    });
+    pool.parallelFor(0, dst.height, [=](unsigned int y0, unsigned int y1) {
+        const float *rows[TAPS];
+        float one = 1;
+        for(unsigned int y = y0; y < y1; ++y)
+            for(int c=0; c < 3; ++c) {
+                float *o = &out->c[c][size_t(y) * out->width];
+                if (mid->height == 1) {
+                    rows[0] = &mid->c[c][0];
+                    sumRows(rows, &one, 1, out->width, o);
+                    continue;
+                }
+                for(int k=0; k < TAPS; ++k) {
+                    int r = (int(2*y) - (TAPS/2 - 1) + k) % int(mid->height);
+                    if (r < 0) r += mid->height;
+                    rows[k] = &mid->c[c][size_t(r) * mid->width];
+                }
+                sumRows(rows, kaiser, TAPS, out->width, o);
+            }
+        if (mode == NORMAL) renormalize(*out, y0, y1);
+    });
+}
+
+
+int main(int argc, char *argv[])
+{
+    Mode mode = ALBEDO;
+    Filter filter = BOX;
+    MipChain::Format format = MipChain::RGB8;
+    unsigned int threads = 0;
+    int arg = 1;
+    for(; arg < argc && argv[arg][0] == '-'; ++arg) {
+        if (strcmp(argv[arg], "-albedo") == 0) mode = ALBEDO;
+        else if (strcmp(argv[arg], "-normal") == 0) mode = NORMAL;
+        else if (strcmp(argv[arg], "-linear") == 0) mode = LINEAR;
+        else if (strcmp(argv[arg], "-box") == 0) filter = BOX;
+        else if (strcmp(argv[arg], "-kaiser") == 0) filter = KAISER;
+        else if (strcmp(argv[arg], "-rgb") == 0) format = MipChain::RGB8;
+        else if (strcmp(argv[arg], "-bc1") == 0) format = MipChain::BC1;
+        else if (strcmp(argv[arg], "-bc4") == 0) format = MipChain::BC4;
+        else if (strcmp(argv[arg], "-bc5") == 0) format = MipChain::BC5;
+        else if (strcmp(argv[arg], "-j") == 0 && arg+1 < argc)
+            threads = atoi(argv[++arg]);
+        else break;
+    }
+    if (argc - arg != 2) {
+        fprintf(stderr, "usage: %s [-albedo | -normal | -linear] "
+                "[-box | -kaiser] [-rgb | -bc1 | -bc4 | -bc5] [-j threads] "
+                "input.ppm output.mip\n", argv[0]);
+        return 1;
+    }
+    const char *inName = argv[arg], *outName = argv[arg+1];
+
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    initTables();
+    ThreadPool pool(threads);
+
+    // all levels down to 1x1, each half the size of the last (rounding down)
+    ImagePPM image(inName);
+    std::vector<MipChain::Level> level;
+    for(unsigned int w = image.width, h = image.height; ; w = w > 1 ? w/2 : 1,
+                                                          h = h > 1 ? h/2 : 1) {
+        MipChain::Level info;
+        info.width = w;
+        info.height = h;
+        info.size = MipChain::levelBytes(format, w, h);
+        info.offset = 0;
+        level.push_back(info);
+        if (w == 1 && h == 1) break;
+    }
+
+    // level data follows header and level table, 16-byte aligned
+    MipChain::Header header;
+    memcpy(header.magic, "MIPC", 4);
+    header.version = MipChain::VERSION;
+    header.format = format;
+    header.levels = (uint32_t)level.size();
+    uint64_t offset = sizeof(header) + level.size() * sizeof(MipChain::Level);
+    for(unsigned int l=0; l < level.size(); ++l) {
+        offset = (offset + 15) & ~uint64_t(15);
+        level[l].offset = offset;
+        offset += level[l].size;
+    }
+
+    FILE *fp = fopen(outName, "wb");
+    if (!fp) {
+        fprintf(stderr, "error creating %s\n", outName);
+        return 1;
+    }
+    fwrite(&header, sizeof(header), 1, fp);
+    fwrite(&level[0], sizeof(MipChain::Level), level.size(), fp);
+
+    // level 0 is just the source, converted to float for filtering
+    Planes *current = new Planes(image.width, image.height);
+    toPlanes(image, mode, *current);
+    std::vector<unsigned char> rgb, bytes, check;
+    double levelErr[2] = {0,0};     // squared error of level 0 and all
+    double levelCount[2] = {0,0};   // values compared for each
+    for(unsigned int l=0; l < level.size(); ++l) {
+        unsigned int w = level[l].width, h = level[l].height;
+        if (l > 0) {
+            Planes *next = new Planes(level[l].width, level[l].height);
+            downsample(*current, *next, filter, mode, pool);
+            delete current;
+            current = next;
+        }
+
+        if (l == 0)         // exact copy of the source
+            rgb.assign((unsigned char*)image.image,
+                       (unsigned char*)image.image + size_t(w) * h * 3);
+        else {
+            rgb.resize(size_t(w) * h * 3);
+            fromPlanes(*current, mode, &rgb[0]);
+        }
+
+        // compress, then decompress to measure the error
+        if (format == MipChain::RGB8)
+            bytes = rgb;
+        else {
+            bytes.resize(size_t(level[l].size));
+            check = rgb;
+            unsigned int channels = 3;
+            switch (format) {
+            case MipChain::BC1:
+                encodeBC1(&rgb[0], w, h, &bytes[0], pool);
+                decodeBC1(&bytes[0], w, h, &check[0]);
+                break;
+            case MipChain::BC4:
+                encodeBC4(&rgb[0], w, h, 0, &bytes[0], pool);
+                decodeBC4(&bytes[0], w, h, 0, &check[0]);
+                channels = 1;
+                break;
+            default:
+                encodeBC5(&rgb[0], w, h, &bytes[0], pool);
+                decodeBC5(&bytes[0], w, h, &check[0]);
+                channels = 2;
+                break;
+            }
+
+            // only channels that were compressed count
+            double err = 0;
+            for(size_t i=0; i < rgb.size(); i += 3)
+                for(unsigned int c=0; c < channels; ++c) {
+                    double d = double(rgb[i+c]) - check[i+c];
+                    err += d*d;
+                }
+            double count = double(rgb.size() / 3) * channels;
+            if (l == 0) {
+                levelErr[0] = err;
+                levelCount[0] = count;
+            }
+            levelErr[1] += err;
+            levelCount[1] += count;
+        }
+
+        // pad to level offset, then write level
+        static const char zero[16] = {0};
+        fwrite(zero, 1, size_t(level[l].offset - ftell(fp)), fp);
+        fwrite(&bytes[0], 1, bytes.size(), fp);
+    }
+    delete current;
+
+    if (fclose(fp) != 0) {
+        fprintf(stderr, "error writing %s\n", outName);
+        return 1;
+    }
+
+    double ms = std::chrono::duration<double, std::milli>(
+        std::chrono::steady_clock::now() - start).count();
+    static const char *formatName[] = {"rgb", "BC1", "BC4", "BC5"};
+    printf("%s: %ux%u, %u levels, %s filter, %s, %.1f KB, %.1f ms\n", outName,
+           image.width, image.height, header.levels,
+           filter == BOX ? "box" : "kaiser", formatName[format],
+           (offset - level[0].offset) / 1024., ms);
+
+    // peak signal to noise ratio, for 8-bit data
+    if (format != MipChain::RGB8) {
+        double psnr[2];
+        for(int i=0; i < 2; ++i) {
+            double mse = levelErr[i] / levelCount[i];
+            psnr[i] = mse > 0 ? 10 * log10(255. * 255. / mse) : 99;
+        }
+        printf("  PSNR %.2f dB at level 0, %.2f dB over all levels\n",
+               psnr[0], psnr[1]);
+    }
+    return 0;
+}
@@ -0,0 +1,321 @@
+// render a camera path to image files, without a window
+//
+// Built with USE_EGL, this needs no window system at all, so it runs on
+// machines without a display, including CPU-only software rendering
+// with Mesa's llvmpipe. Otherwise it uses a hidden GLFW window.
+
+#include "Batch.hpp"
+#include "Scene.hpp"
+#include "Terrain.hpp"
+#include "Marker.hpp"
+#include "ThreadPool.hpp"
+#include "FrameCapture.hpp"
+
+// using core modern OpenGL
+#include <GL/glew.h>
+#include <GLFW/glfw3.h>
+#ifdef USE_EGL
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#endif
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include <vector>
+
+#ifdef _WIN32
+// don't complain if we use standard IO functions instead of windows-only
+#pragma warning( disable: 4996 )
+#endif
+
+namespace {
+    // one line of the camera path
+    struct Keyframe {
+        glm::vec3 view, light;  // Scene::viewSph and Scene::lightSph
+        unsigned int frames;    // frames until next keyframe
+    };
+
+    //
+    // read path file, print and exit on error
+    //
+    std::vector<Keyframe> readPath(const char *name)
+    {
+        FILE *fp = fopen(name, "r");
+        if (!fp) {
+            fprintf(stderr, "error opening %s\n", name);
+            exit(1);
+        }
+
+        std::vector<Keyframe> path;
+        char line[1024];
+        for(int lineNum=1; fgets(line, sizeof(line), fp); ++lineNum) {
+            char *comment = strchr(line, '#');
+            if (comment) *comment = 0;
+
+            Keyframe key;
+            key.frames = 1;
+            int count = sscanf(line, "%f %f %f %f %f %f %u",
+                               &key.view.x, &key.view.y, &key.view.z,
+                               &key.light.x, &key.light.y, &key.light.z,
+                               &key.frames);
+            if (count <= 0) continue;       // blank line
+            if (count < 6 || key.frames == 0) {
+                fprintf(stderr, "%s:%d: expected 6 numbers and optional "
+                        "frame count\n", name, lineNum);
+                exit(1);
+            }
+            path.push_back(key);
+        }
+        fclose(fp);
+        return path;
+    }
+
+    //
+    // OpenGL context with no visible window
+    //
+    class HeadlessContext {
+    private:
+#ifdef USE_EGL
+        EGLDisplay display;
+        EGLContext context;
+#else
+        GLFWwindow *win;
+#endif
+
+    public:
+        HeadlessContext();
+        ~HeadlessContext();
+
+        // true if context was created and made current
+        bool valid() const;
+    };
+
+#ifdef USE_EGL
+    HeadlessContext::HeadlessContext() : context(EGL_NO_CONTEXT)
+    {
+        // Mesa's surfaceless platform needs no display server or GPU
+        // fall back on the default display if it isn't there
+        display = EGL_NO_DISPLAY;
+        PFNEGLGETPLATFORMDISPLAYEXTPROC getPlatformDisplay =
+            (PFNEGLGETPLATFORMDISPLAYEXTPROC)
+            eglGetProcAddress("eglGetPlatformDisplayEXT");
+        if (getPlatformDisplay)
+            display = getPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA,
+                                         EGL_DEFAULT_DISPLAY, 0);
+        if (display == EGL_NO_DISPLAY)
+            display = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+
+        EGLint major, minor;
+        if (display == EGL_NO_DISPLAY ||
+            !eglInitialize(display, &major, &minor) ||
+            !eglBindAPI(EGL_OPENGL_API))
+            return;
+
+        // all rendering goes to our own frame buffer, so any config will do
+        // as long as it doesn't insist on a window (the default)
+        EGLint configAttribs[] = {
+            EGL_SURFACE_TYPE, 0,
+            EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT,
+            EGL_NONE };
+        EGLConfig config;
+        EGLint numConfigs = 0;
+        if (!eglChooseConfig(display, configAttribs, &config, 1, &numConfigs)
+            || numConfigs == 0)
+            return;
+
+        // same core 4.0 context as the windowed version
+        EGLint contextAttribs[] = {
+            EGL_CONTEXT_MAJOR_VERSION_KHR, 4,
+            EGL_CONTEXT_MINOR_VERSION_KHR, 0,
+            EGL_CONTEXT_OPENGL_PROFILE_MASK_KHR,
+            EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT_KHR,
+            EGL_NONE };
+        context = eglCreateContext(display, config, EGL_NO_CONTEXT,
+                                   contextAttribs);
+        if (context != EGL_NO_CONTEXT &&
+            !eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, context)) {
+            eglDestroyContext(display, context);
+            context = EGL_NO_CONTEXT;
+        }
+    }
+
+    HeadlessContext::~HeadlessContext()
+    {
+        if (context != EGL_NO_CONTEXT) {
+            eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE,
+                           EGL_NO_CONTEXT);
+            eglDestroyContext(display, context);
+        }
+        if (display != EGL_NO_DISPLAY)
+            eglTerminate(display);
+    }
+
+    bool HeadlessContext::valid() const
+    {
+        return context != EGL_NO_CONTEXT;
+    }
+#else
+    HeadlessContext::HeadlessContext() : win(0)
+    {
+        if (! glfwInit())
+            return;
+
+        glfwWindowHint(GLFW_VISIBLE, GL_FALSE);
+        glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+        glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 4);
+        glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 0);
+        glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
+        win = glfwCreateWindow(16, 16, "OpenGL Demo", 0, 0);
+        if (win)
+            glfwMakeContextCurrent(win);
+        else
+            glfwTerminate();
+    }
+
+    HeadlessContext::~HeadlessContext()
+    {
+        if (win) {
+            glfwDestroyWindow(win);
+            glfwTerminate();
+        }
+    }
+
+    bool HeadlessContext::valid() const
+    {
+        return win != 0;
+    }
+#endif
+}
+
+//
+// render all frames of the path
+//
+int runBatch(const char *pathFile, const char *pattern, int width, int height,
+             Terrain::VertexFormat format, unsigned int indexLayout,
+             float detailPixels, float simplifyError)
+{
+    std::vector<Keyframe> path = readPath(pathFile);
+    if (path.empty()) {
+        fprintf(stderr, "no keyframes in %s\n", pathFile);
+        return 1;
+    }
+    path.back().frames = 1;     // nothing to move toward after the last
+
+    HeadlessContext context;
+    if (! context.valid()) {
+        fprintf(stderr, "can't create OpenGL context\n");
+        return 1;
+    }
+
+    // GLEW may complain about the missing window system, but still
+    // loads the GL functions, so only check that there is a context
+    glewExperimental = true;
+    glewInit();
+    printf("rendering with %s\n", (const char*)glGetString(GL_RENDERER));
+    glEnable(GL_DEPTH_TEST);
+
+    // offscreen color and depth buffers
+    enum {COLOR_BUFFER, DEPTH_BUFFER, NUM_RENDERBUFFERS};
+    unsigned int framebufferID, renderbufferIDs[NUM_RENDERBUFFERS];
+    glGenFramebuffers(1, &framebufferID);
+    glGenRenderbuffers(NUM_RENDERBUFFERS, renderbufferIDs);
+    glBindRenderbuffer(GL_RENDERBUFFER, renderbufferIDs[COLOR_BUFFER]);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, width, height);
+    glBindRenderbuffer(GL_RENDERBUFFER, renderbufferIDs[DEPTH_BUFFER]);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, width, height);
+    glBindRenderbuffer(GL_RENDERBUFFER, 0);
+
+    glBindFramebuffer(GL_FRAMEBUFFER, framebufferID);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0,
+                              GL_RENDERBUFFER, renderbufferIDs[COLOR_BUFFER]);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT,
+                              GL_RENDERBUFFER, renderbufferIDs[DEPTH_BUFFER]);
+    glReadBuffer(GL_COLOR_ATTACHMENT0);
+    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+        fprintf(stderr, "can't render to %dx%d frame buffer\n", width, height);
+        return 1;
+    }
+
+    {
+        // same objects as the interactive version, loaded before timing
+        ThreadPool pool;
+        Terrain terrain("terrain.ppm", "pebbles.ppm",
+                        "pebbles-norm.ppm", "pebbles-gloss.ppm", pool,
+                        format, indexLayout, detailPixels, simplifyError);
+        terrain.finishLoading();    // every frame fully shadowed
+        Marker lightmarker;
+        Scene scene(width, height, lightmarker);
+        FrameCapture capture(pattern);
+        capture.start();
+
+        // draw each frame, then let FrameCapture read it back and write it
+        // on later frames while the next frames are drawn
+        std::chrono::steady_clock::time_point start =
+            std::chrono::steady_clock::now();
+        double drawTime = 0, captureTime = 0;
+        uint64_t tested = 0, culled = 0, drawn = 0, triangles = 0;
+        for(size_t k=0; k < path.size(); ++k) {
+            const Keyframe &key = path[k];
+            const Keyframe &next = k+1 < path.size() ? path[k+1] : key;
+            for(unsigned int f=0; f < key.frames; ++f) {
+                float t = float(f) / float(key.frames);
+                scene.viewSph = glm::mix(key.view, next.view, t);
+                scene.lightSph = glm::mix(key.light, next.light, t);
+                scene.view();
+                scene.light(lightmarker);
+
+                std::chrono::steady_clock::time_point drawStart =
+                    std::chrono::steady_clock::now();
+                glClearColor(1.f, 1.f, 1.f, 1.f);
+                glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+                scene.update();
+                terrain.draw(scene);
+                const Terrain::DrawStats &counts = terrain.drawStats();
+                tested += counts.chunksTested;
+                culled += counts.chunksCulled;
+                drawn += counts.chunksDrawn;
+                triangles += counts.triangles;
+                lightmarker.draw();
+                std::chrono::steady_clock::time_point captureStart =
+                    std::chrono::steady_clock::now();
+                drawTime += std::chrono::duration<double>(
+                    captureStart - drawStart).count();
+
+                capture.capture(width, height);
+                captureTime += std::chrono::duration<double>(
+                    std::chrono::steady_clock::now() - captureStart).count();
+            }
+        }
+        capture.flush();
+        double total = std::chrono::duration<double>(
+            std::chrono::steady_clock::now() - start).count();
+
+        // per-stage costs: draw is just issuing GL commands; readback
+        // includes any wait for the GPU to finish; write overlaps both on
+        // its own thread
+        unsigned int frames = capture.captured();
+        printf("%u frames at %dx%d in %.2f s: %.1f frames/s\n",
+               frames, width, height, total, frames / total);
+        printf("  draw      %6.2f ms/frame\n", 1000 * drawTime / frames);
+        printf("  terrain   %.0f chunks tested, %.0f culled, %.0f drawn, "
+               "%.0f triangles per frame\n", double(tested) / frames,
+               double(culled) / frames, double(drawn) / frames,
+               double(triangles) / frames);
+        const Terrain::MeshStats &mesh = terrain.meshStats();
+        if (simplifyError > 0 && mesh.gridTriangles)
+            printf("  simplify  %u of %u triangles (%.1f%%), "
+                   "max error %.3g\n", mesh.triangles, mesh.gridTriangles,
+                   100. * mesh.triangles / mesh.gridTriangles, mesh.maxError);
+        printf("  readback  %6.2f ms/frame\n", 1000 * captureTime / frames);
+        printf("  write     %6.2f ms/frame (writer thread)\n",
+               1000 * capture.writeSeconds() / frames);
+    }
+
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    glDeleteFramebuffers(1, &framebufferID);
+    glDeleteRenderbuffers(NUM_RENDERBUFFERS, renderbufferIDs);
+    return 0;
+}
@@ -0,0 +1,23 @@
+// render a camera path to image files, without a window
+//
+// The path file has one keyframe per line:
+//   viewSph.x viewSph.y viewSph.z lightSph.x lightSph.y lightSph.z [frames]
+// using the same units as Scene (view angles in degrees, light angles
+// in radians). Each keyframe is followed by frames-1 more frames (default
+// none), moving evenly to the next keyframe. Text after # is ignored.
+#ifndef Batch_hpp
+#define Batch_hpp
+
+#include "Terrain.hpp"
+
+// render every frame of the path in pathFile to a width x height image
+// pattern is a printf pattern for the frame number, like "frame%05d.ppm"
+// format, indexLayout, detailPixels and simplifyError are passed on to
+// Terrain
+// returns program exit status
+int runBatch(const char *pathFile, const char *pattern,
+             int width, int height, Terrain::VertexFormat format,
+             unsigned int indexLayout, float detailPixels,
+             float simplifyError);
+
+#endif
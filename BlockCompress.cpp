@@ -0,0 +1,368 @@
+// block texture compression and decompression
+//
+// BC1 endpoints come from the principal axis of the block's colors,
+// inset slightly, then refined with a couple of least-squares passes
+// over the chosen indices. BC4 uses the block's min and max with all
+// eight interpolated values.
+
+#include "BlockCompress.hpp"
+#include "ThreadPool.hpp"
+#include <math.h>
+#include <string.h>
+#include <stdint.h>
+
+//
+// compressed size in bytes
+//
+unsigned int compressedSize(unsigned int w, unsigned int h,
+                            unsigned int blockBytes)
+{
+    return ((w + 3) / 4) * ((h + 3) / 4) * blockBytes;
+}
+
+//
+// gather one 4x4 block of one channel, repeating edges
+//
+static void loadBlock(const unsigned char *rgb, unsigned int w, unsigned int h,
+                      unsigned int bx, unsigned int by, unsigned int channel,
+                      unsigned char out[16])
+{
+    for(unsigned int y=0; y < 4; ++y) {
+        unsigned int sy = 4*by + y < h ? 4*by + y : h - 1;
+        for(unsigned int x=0; x < 4; ++x) {
+            unsigned int sx = 4*bx + x < w ? 4*bx + x : w - 1;
+            out[4*y + x] = rgb[3*(size_t(sy)*w + sx) + channel];
+        }
+    }
+}
+
+//
+// scatter one 4x4 block of one channel, clipping at image edges
+//
+static void storeBlock(const unsigned char in[16], unsigned int w,
+                       unsigned int h, unsigned int bx, unsigned int by,
+                       unsigned int channel, unsigned char *rgb)
+{
+    for(unsigned int y=0; y < 4 && 4*by + y < h; ++y)
+        for(unsigned int x=0; x < 4 && 4*bx + x < w; ++x)
+            rgb[3*(size_t(4*by + y)*w + 4*bx + x) + channel] = in[4*y + x];
+}
+
+//
+// 5:6:5 color packing, with 8-bit expansion matching the hardware
+//
+static uint16_t pack565(const float c[3])
+{
+    int r = int(c[0] * 31 / 255 + 0.5f), g = int(c[1] * 63 / 255 + 0.5f),
+        b = int(c[2] * 31 / 255 + 0.5f);
+    r = r < 0 ? 0 : r > 31 ? 31 : r;
+    g = g < 0 ? 0 : g > 63 ? 63 : g;
+    b = b < 0 ? 0 : b > 31 ? 31 : b;
+    return uint16_t(r << 11 | g << 5 | b);
+}
+static void unpack565(uint16_t v, int c[3])
+{
+    int r = v >> 11, g = (v >> 5) & 63, b = v & 31;
+    c[0] = r << 3 | r >> 2;
+    c[1] = g << 2 | g >> 4;
+    c[2] = b << 3 | b >> 2;
+}
+
+//
+// BC1 palette from endpoints
+//
+static void paletteBC1(uint16_t c0, uint16_t c1, int palette[4][3])
+{
+    unpack565(c0, palette[0]);
+    unpack565(c1, palette[1]);
+    for(int i=0; i < 3; ++i) {
+        if (c0 > c1) {
+            palette[2][i] = (2*palette[0][i] + palette[1][i]) / 3;
+            palette[3][i] = (palette[0][i] + 2*palette[1][i]) / 3;
+        }
+        else {
+            palette[2][i] = (palette[0][i] + palette[1][i]) / 2;
+            palette[3][i] = 0;
+        }
+    }
+}
+
+//
+// quantize endpoints and choose best index per texel
+// return squared error, and fill in block
+//
+static int fitBC1(const float color[16][3], const float e0[3], const float e1[3],
+                  unsigned char block[8], unsigned char index[16])
+{
+    uint16_t c0 = pack565(e0), c1 = pack565(e1);
+    if (c0 < c1) { uint16_t t = c0; c0 = c1; c1 = t; }   // 4-color mode
+
+    int palette[4][3];
+    paletteBC1(c0, c1, palette);
+
+    // equal endpoints decode in 3-color mode, so only use index 0
+    int choices = c0 == c1 ? 1 : 4;
+    int total = 0;
+    uint32_t bits = 0;
+    for(int t=0; t < 16; ++t) {
+        int best = 0, bestErr = 1 << 30;
+        for(int p=0; p < choices; ++p) {
+            int err = 0;
+            for(int i=0; i < 3; ++i) {
+                int d = int(color[t][i]) - palette[p][i];
+                err += d*d;
+            }
+            if (err < bestErr) { bestErr = err; best = p; }
+        }
+        total += bestErr;
+        index[t] = (unsigned char)best;
+        bits |= uint32_t(best) << (2*t);
+    }
+
+    block[0] = c0 & 255;  block[1] = c0 >> 8;
+    block[2] = c1 & 255;  block[3] = c1 >> 8;
+    for(int i=0; i < 4; ++i)
+        block[4+i] = (bits >> (8*i)) & 255;
+    return total;
+}
+
+//
+// compress one BC1 block
+//
+static void blockBC1(const unsigned char rgb[3][16], unsigned char out[8])
+{
+    float color[16][3], mean[3] = {0,0,0};
+    for(int t=0; t < 16; ++t)
+        for(int i=0; i < 3; ++i) {
+            color[t][i] = rgb[i][t];
+            mean[i] += color[t][i] / 16;
+        }
+
+    // covariance, then principal axis by power iteration
+    float cov[6] = {0,0,0,0,0,0};
+    for(int t=0; t < 16; ++t) {
+        float d[3] = {color[t][0]-mean[0], color[t][1]-mean[1], color[t][2]-mean[2]};
+        cov[0] += d[0]*d[0];  cov[1] += d[0]*d[1];  cov[2] += d[0]*d[2];
+        cov[3] += d[1]*d[1];  cov[4] += d[1]*d[2];  cov[5] += d[2]*d[2];
+    }
+    float axis[3] = {1,1,1};
+    for(int iter=0; iter < 8; ++iter) {
+        float a[3] = {
+            cov[0]*axis[0] + cov[1]*axis[1] + cov[2]*axis[2],
+            cov[1]*axis[0] + cov[3]*axis[1] + cov[4]*axis[2],
+            cov[2]*axis[0] + cov[4]*axis[1] + cov[5]*axis[2]};
+        float len = sqrtf(a[0]*a[0] + a[1]*a[1] + a[2]*a[2]);
+        if (len == 0) break;    // flat block: any axis will do
+        for(int i=0; i < 3; ++i) axis[i] = a[i] / len;
+    }
+
+    // endpoints at the extremes along the axis, inset by 1/16 of range
+    float lo = 1e30f, hi = -1e30f;
+    for(int t=0; t < 16; ++t) {
+        float p = (color[t][0]-mean[0])*axis[0] + (color[t][1]-mean[1])*axis[1]
+            + (color[t][2]-mean[2])*axis[2];
+        if (p < lo) lo = p;
+        if (p > hi) hi = p;
+    }
+    float inset = (hi - lo) / 16;
+    float e0[3], e1[3];
+    for(int i=0; i < 3; ++i) {
+        e0[i] = mean[i] + axis[i] * (hi - inset);
+        e1[i] = mean[i] + axis[i] * (lo + inset);
+    }
+
+    unsigned char index[16];
+    int err = fitBC1(color, e0, e1, out, index);
+
+    // refine: least-squares endpoints for the chosen indices
+    static const float weight[4] = {1, 0, 2/3.f, 1/3.f};
+    for(int iter=0; iter < 2 && err > 0; ++iter) {
+        float aa = 0, ab = 0, bb = 0, ax[3] = {0,0,0}, bx[3] = {0,0,0};
+        for(int t=0; t < 16; ++t) {
+            float a = weight[index[t]], b = 1 - a;
+            aa += a*a;  ab += a*b;  bb += b*b;
+            for(int i=0; i < 3; ++i) {
+                ax[i] += a * color[t][i];
+                bx[i] += b * color[t][i];
+            }
+        }
+        float det = aa*bb - ab*ab;
+        if (fabsf(det) < 1e-6f) break;
+        for(int i=0; i < 3; ++i) {
+            e0[i] = (bb*ax[i] - ab*bx[i]) / det;
+            e1[i] = (aa*bx[i] - ab*ax[i]) / det;
+            e0[i] = e0[i] < 0 ? 0 : e0[i] > 255 ? 255 : e0[i];
+            e1[i] = e1[i] < 0 ? 0 : e1[i] > 255 ? 255 : e1[i];
+        }
+
+        unsigned char tryBlock[8], tryIndex[16];
+        int tryErr = fitBC1(color, e0, e1, tryBlock, tryIndex);
+        if (tryErr >= err) break;
+        err = tryErr;
+        memcpy(out, tryBlock, 8);
+        memcpy(index, tryIndex, 16);
+    }
+}
+
+//
+// BC4 palette from endpoints
+//
+static void paletteBC4(int r0, int r1, int palette[8])
+{
+    palette[0] = r0;
+    palette[1] = r1;
+    if (r0 > r1)
+        for(int i=2; i < 8; ++i)
+            palette[i] = ((8-i)*r0 + (i-1)*r1 + 3) / 7;
+    else {
+        for(int i=2; i < 6; ++i)
+            palette[i] = ((6-i)*r0 + (i-1)*r1 + 2) / 5;
+        palette[6] = 0;
+        palette[7] = 255;
+    }
+}
+
+//
+// compress one BC4 block
+//
+static void blockBC4(const unsigned char value[16], unsigned char out[8])
+{
+    int lo = 255, hi = 0;
+    for(int t=0; t < 16; ++t) {
+        if (value[t] < lo) lo = value[t];
+        if (value[t] > hi) hi = value[t];
+    }
+
+    // r0 > r1 for 8 values, or equal for a flat block using index 0
+    int palette[8];
+    paletteBC4(hi, lo, palette);
+    uint64_t bits = 0;
+    for(int t=0; t < 16 && hi > lo; ++t) {
+        int best = 0, bestErr = 256;
+        for(int p=0; p < 8; ++p) {
+            int err = value[t] > palette[p] ? value[t] - palette[p]
+                                            : palette[p] - value[t];
+            if (err < bestErr) { bestErr = err; best = p; }
+        }
+        bits |= uint64_t(best) << (3*t);
+    }
+
+    out[0] = (unsigned char)hi;
+    out[1] = (unsigned char)lo;
+    for(int i=0; i < 6; ++i)
+        out[2+i] = (bits >> (8*i)) & 255;
+}
+
+//
+// compress whole images, splitting block rows across threads
+//
+void encodeBC1(const unsigned char *rgb, unsigned int w, unsigned int h,
+               unsigned char *blocks, ThreadPool &pool)
+{
+    unsigned int bw = (w + 3) / 4;
+    pool.parallelFor(0, (h + 3) / 4, [=](unsigned int by0, unsigned int by1) {
+        unsigned char texel[3][16];
+        for(unsigned int by = by0; by < by1; ++by)
+            for(unsigned int bx=0; bx < bw; ++bx) {
+                for(int c=0; c < 3; ++c)
+                    loadBlock(rgb, w, h, bx, by, c, texel[c]);
+                blockBC1(texel, blocks + 8*(size_t(by)*bw + bx));
+            }
+    });
+}
+
+void encodeBC4(const unsigned char *rgb, unsigned int w, unsigned int h,
+               unsigned int channel, unsigned char *blocks, ThreadPool &pool)
+{
+    unsigned int bw = (w + 3) / 4;
+    pool.parallelFor(0, (h + 3) / 4, [=](unsigned int by0, unsigned int by1) {
+        unsigned char texel[16];
+        for(unsigned int by = by0; by < by1; ++by)
+            for(unsigned int bx=0; bx < bw; ++bx) {
+                loadBlock(rgb, w, h, bx, by, channel, texel);
+                blockBC4(texel, blocks + 8*(size_t(by)*bw + bx));
+            }
+    });
+}
+
+void encodeBC5(const unsigned char *rgb, unsigned int w, unsigned int h,
+               unsigned char *blocks, ThreadPool &pool)
+{
+    unsigned int bw = (w + 3) / 4;
+    pool.parallelFor(0, (h + 3) / 4, [=](unsigned int by0, unsigned int by1) {
+        unsigned char texel[16];
+        for(unsigned int by = by0; by < by1; ++by)
+            for(unsigned int bx=0; bx < bw; ++bx) {
+                unsigned char *out = blocks + 16*(size_t(by)*bw + bx);
+                loadBlock(rgb, w, h, bx, by, 0, texel);
+                blockBC4(texel, out);
+                loadBlock(rgb, w, h, bx, by, 1, texel);
+                blockBC4(texel, out + 8);
+            }
+    });
+}
+
+//
+// decompress one BC4 block into 16 values
+//
+static void unblockBC4(const unsigned char *in, unsigned char value[16])
+{
+    int palette[8];
+    paletteBC4(in[0], in[1], palette);
+    uint64_t bits = 0;
+    for(int i=0; i < 6; ++i)
+        bits |= uint64_t(in[2+i]) << (8*i);
+    for(int t=0; t < 16; ++t)
+        value[t] = (unsigned char)palette[(bits >> (3*t)) & 7];
+}
+
+//
+// decompress whole images
+//
+void decodeBC1(const unsigned char *blocks, unsigned int w, unsigned int h,
+               unsigned char *rgb)
+{
+    unsigned int bw = (w + 3) / 4;
+    for(unsigned int by=0; by < (h + 3) / 4; ++by)
+        for(unsigned int bx=0; bx < bw; ++bx) {
+            const unsigned char *in = blocks + 8*(size_t(by)*bw + bx);
+            int palette[4][3];
+            paletteBC1(uint16_t(in[0] | in[1] << 8), uint16_t(in[2] | in[3] << 8),
+                       palette);
+            uint32_t bits = in[4] | in[5] << 8 | in[6] << 16 | uint32_t(in[7]) << 24;
+
+            unsigned char texel[3][16];
+            for(int t=0; t < 16; ++t)
+                for(int c=0; c < 3; ++c)
+                    texel[c][t] = (unsigned char)palette[(bits >> (2*t)) & 3][c];
+            for(int c=0; c < 3; ++c)
+                storeBlock(texel[c], w, h, bx, by, c, rgb);
+        }
+}
+
+void decodeBC4(const unsigned char *blocks, unsigned int w, unsigned int h,
+               unsigned int channel, unsigned char *rgb)
+{
+    unsigned int bw = (w + 3) / 4;
+    unsigned char texel[16];
+    for(unsigned int by=0; by < (h + 3) / 4; ++by)
+        for(unsigned int bx=0; bx < bw; ++bx) {
+            unblockBC4(blocks + 8*(size_t(by)*bw + bx), texel);
+            storeBlock(texel, w, h, bx, by, channel, rgb);
+        }
+}
+
+void decodeBC5(const unsigned char *blocks, unsigned int w, unsigned int h,
+               unsigned char *rgb)
+{
+    unsigned int bw = (w + 3) / 4;
+    unsigned char texel[16];
+    for(unsigned int by=0; by < (h + 3) / 4; ++by)
+        for(unsigned int bx=0; bx < bw; ++bx) {
+            const unsigned char *in = blocks + 16*(size_t(by)*bw + bx);
+            unblockBC4(in, texel);
+            storeBlock(texel, w, h, bx, by, 0, rgb);
+            unblockBC4(in + 8, texel);
+            storeBlock(texel, w, h, bx, by, 1, rgb);
+        }
+}
@@ -0,0 +1,37 @@
+// block texture compression: BC1 (DXT1), BC4 (RGTC1) and BC5 (RGTC2)
+// images are 8-bit rgb in [y][x][color] order, like ImagePPM
+// images that aren't a multiple of 4 in size are padded by repeating
+// the last row and column
+#ifndef BlockCompress_hpp
+#define BlockCompress_hpp
+
+class ThreadPool;
+
+// bytes of compressed data for an image
+// BC1 and BC4 use 8 bytes per 4x4 block, BC5 uses 16
+unsigned int compressedSize(unsigned int width, unsigned int height,
+                            unsigned int blockBytes);
+
+// compress rgb to BC1: 5:6:5 endpoints and 2-bit indices
+void encodeBC1(const unsigned char *rgb, unsigned int width,
+               unsigned int height, unsigned char *blocks, ThreadPool &pool);
+
+// compress one channel of rgb to BC4: 8-bit endpoints and 3-bit indices
+void encodeBC4(const unsigned char *rgb, unsigned int width,
+               unsigned int height, unsigned int channel,
+               unsigned char *blocks, ThreadPool &pool);
+
+// compress red and green of rgb to BC5: one BC4 block for each
+void encodeBC5(const unsigned char *rgb, unsigned int width,
+               unsigned int height, unsigned char *blocks, ThreadPool &pool);
+
+// decompress into rgb, which must be width*height*3 bytes
+// BC4 only writes the given channel, and BC5 only red and green
+void decodeBC1(const unsigned char *blocks, unsigned int width,
+               unsigned int height, unsigned char *rgb);
+void decodeBC4(const unsigned char *blocks, unsigned int width,
+               unsigned int height, unsigned int channel, unsigned char *rgb);
+void decodeBC5(const unsigned char *blocks, unsigned int width,
+               unsigned int height, unsigned char *rgb);
+
+#endif
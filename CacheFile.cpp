@@ -0,0 +1,59 @@
+// writing cache files that other running instances may be reading
+
+#include "CacheFile.hpp"
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#include <process.h>
+#define getpid _getpid
+// don't complain if we use standard IO functions instead of windows-only
+#pragma warning( disable: 4996 )
+#else
+#include <unistd.h>
+#endif
+
+//
+// temporary file next to the cache, unique to this process
+//
+CacheFile::CacheFile(const char *name) : name(name)
+{
+    char suffix[32];
+    sprintf(suffix, ".%d.tmp", int(getpid()));
+    tempName = this->name + suffix;
+    fp = fopen(tempName.c_str(), "wb");
+}
+
+//
+// clean up after a failed or abandoned write
+//
+CacheFile::~CacheFile()
+{
+    if (fp) {
+        fclose(fp);
+        remove(tempName.c_str());
+    }
+}
+
+//
+// close, then rename over the old cache in one step
+//
+bool CacheFile::commit()
+{
+    if (! fp)
+        return false;
+    bool failed = ferror(fp) != 0;
+    failed = fclose(fp) != 0 || failed;
+    fp = 0;
+
+#ifdef _WIN32
+    // rename won't replace an existing file on windows
+    failed = failed || ! MoveFileExA(tempName.c_str(), name.c_str(),
+                                     MOVEFILE_REPLACE_EXISTING);
+#else
+    failed = failed || rename(tempName.c_str(), name.c_str()) != 0;
+#endif
+    if (failed)
+        remove(tempName.c_str());
+    return ! failed;
+}
@@ -0,0 +1,42 @@
+// writing cache files that other running instances may be reading
+//
+// Caches are mapped or read by every instance, so they are never
+// rewritten in place, which could show a reader a half-written file, or
+// pull pages out from under a mapping. Each writer makes a temporary file
+// of its own next to the cache, named for the process, and renames it
+// over the cache once it is complete. Anyone who already has the old file
+// open keeps it until they close it.
+#ifndef CacheFile_hpp
+#define CacheFile_hpp
+
+#include <stdio.h>
+#include <string>
+
+class CacheFile {
+// private data
+private:
+    FILE *fp;                   // temporary file, or NULL
+    std::string name;           // cache file it will replace
+    std::string tempName;       // temporary file name
+
+    // no copying
+    CacheFile(const CacheFile &);
+    CacheFile &operator=(const CacheFile &);
+
+// public methods
+public:
+    // create a temporary file to become cache file name
+    explicit CacheFile(const char *name);
+
+    // remove the temporary file if it wasn't committed
+    ~CacheFile();
+
+    // file to write, or NULL if it couldn't be created
+    FILE *file() const { return fp; }
+
+    // close and move into place over the cache
+    // returns false, leaving the cache as it was, if any write failed
+    bool commit();
+};
+
+#endif
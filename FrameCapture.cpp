@@ -0,0 +1,201 @@
+// capture rendered frames to numbered PPM files without stalling
+
+#include "FrameCapture.hpp"
+#include "ImagePPM.hpp"
+#include <stdio.h>
+#include <string.h>
+#include <chrono>
+
+// using core modern OpenGL
+#include <GL/glew.h>
+#include <GLFW/glfw3.h>
+
+#ifdef _WIN32
+// don't complain about snprintf
+#pragma warning( disable: 4996 )
+#define snprintf _snprintf
+#endif
+
+//
+// set up buffers and writer thread
+//
+FrameCapture::FrameCapture(const char *name)
+    : pattern(name), active(false), next(0), frames(0),
+      quit(false), waits(0), writeTime(0), written(0)
+{
+    for(int i=0; i < RING_SIZE; ++i) {
+        glGenBuffers(1, &ring[i].bufferID);
+        ring[i].fence = 0;
+        ring[i].width = ring[i].height = 0;
+        ring[i].capacity = 0;
+        ring[i].frame = 0;
+    }
+
+    writer = std::thread([this]() { write(); });
+}
+
+//
+// write remaining frames, then stop writer
+//
+FrameCapture::~FrameCapture()
+{
+    stop();
+    {
+        std::unique_lock<std::mutex> hold(lock);
+        quit = true;
+    }
+    changed.notify_all();
+    writer.join();
+
+    for(int i=0; i < RING_SIZE; ++i)
+        glDeleteBuffers(1, &ring[i].bufferID);
+}
+
+//
+// start recording
+//
+void FrameCapture::start()
+{
+    if (active) return;
+    active = true;
+    printf("capturing to %s\n", pattern.c_str());
+}
+
+//
+// stop recording, flushing frames in the ring, oldest first
+//
+void FrameCapture::stop()
+{
+    if (! active) return;
+    active = false;
+    for(int i=0; i < RING_SIZE; ++i) {
+        Slot &slot = ring[(next + i) % RING_SIZE];
+        if (slot.fence) retire(slot);
+    }
+
+    std::unique_lock<std::mutex> hold(lock);
+    printf("captured %u frames, waited %u times for disk\n", frames, waits);
+}
+
+//
+// stop and wait for the writer to catch up
+//
+void FrameCapture::flush()
+{
+    stop();
+    std::unique_lock<std::mutex> hold(lock);
+    while (written < frames)
+        changed.wait(hold);
+}
+
+//
+// start reading back the current frame
+//
+void FrameCapture::capture(int width, int height)
+{
+    if (! active) return;
+
+    // buffer written RING_SIZE frames ago should be done by now
+    Slot &slot = ring[next];
+    if (slot.fence) retire(slot);
+    next = (next + 1) % RING_SIZE;
+
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.bufferID);
+    size_t size = size_t(width) * height * 3;
+    if (size > slot.capacity) {
+        glBufferData(GL_PIXEL_PACK_BUFFER, size, 0, GL_STREAM_READ);
+        slot.capacity = size;
+    }
+
+    // rgb rows aren't always a multiple of 4 bytes
+    glPixelStorei(GL_PACK_ALIGNMENT, 1);
+    glReadPixels(0, 0, width, height, GL_RGB, GL_UNSIGNED_BYTE, 0);
+    glPixelStorei(GL_PACK_ALIGNMENT, 4);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+    slot.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    slot.width = width;
+    slot.height = height;
+    slot.frame = frames++;
+}
+
+//
+// copy out pixels from a finished readback and hand them to the writer
+//
+void FrameCapture::retire(Slot &slot)
+{
+    // only blocks if the GPU is more than RING_SIZE frames behind
+    glClientWaitSync(slot.fence, GL_SYNC_FLUSH_COMMANDS_BIT, GL_TIMEOUT_IGNORED);
+    glDeleteSync(slot.fence);
+    slot.fence = 0;
+
+    // GL rows are bottom to top, PPM top to bottom
+    Frame out;
+    out.image = new ImagePPM(slot.width, slot.height);
+    out.frame = slot.frame;
+    size_t rowBytes = size_t(slot.width) * 3;
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.bufferID);
+    const unsigned char *pixels = (const unsigned char*)
+        glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, rowBytes * slot.height,
+                         GL_MAP_READ_BIT);
+    if (pixels) {
+        unsigned char *rows = (unsigned char*)out.image->image;
+        for(int y=0; y < slot.height; ++y)
+            memcpy(rows + (slot.height-1 - y) * rowBytes,
+                   pixels + y * rowBytes, rowBytes);
+        glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+    }
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+    // wait for space in the queue so a slow disk can't use all memory
+    std::unique_lock<std::mutex> hold(lock);
+    if (queue.size() >= QUEUE_DEPTH) {
+        ++waits;
+        while (queue.size() >= QUEUE_DEPTH)
+            changed.wait(hold);
+    }
+    queue.push_back(out);
+    changed.notify_all();
+}
+
+//
+// writer thread: write queued frames until told to quit
+//
+void FrameCapture::write()
+{
+    std::unique_lock<std::mutex> hold(lock);
+    for(;;) {
+        while (!quit && queue.empty())
+            changed.wait(hold);
+        if (queue.empty())
+            return;             // quit and nothing left to write
+
+        Frame frame = queue.front();
+        queue.pop_front();
+        changed.notify_all();   // capture may be waiting for space
+
+        // write without holding the lock
+        hold.unlock();
+        std::chrono::steady_clock::time_point start =
+            std::chrono::steady_clock::now();
+        char name[1024];
+        snprintf(name, sizeof(name), pattern.c_str(), frame.frame);
+        frame.image->write(name);
+        delete frame.image;
+        double seconds = std::chrono::duration<double>(
+            std::chrono::steady_clock::now() - start).count();
+        hold.lock();
+        writeTime += seconds;
+        ++written;
+        changed.notify_all();   // flush may be waiting
+    }
+}
+
+//
+// total time spent writing
+//
+double FrameCapture::writeSeconds()
+{
+    std::unique_lock<std::mutex> hold(lock);
+    return writeTime;
+}
@@ -0,0 +1,96 @@
+// capture rendered frames to numbered PPM files without stalling
+//
+// Each frame is read into one of a ring of pixel pack buffers, so the
+// copy happens on the GPU's schedule. A buffer is only mapped when the
+// ring comes back around to it, by which time the copy is long done.
+// PPM files are written by a separate thread from a bounded queue.
+#ifndef FrameCapture_hpp
+#define FrameCapture_hpp
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+
+struct ImagePPM;
+
+class FrameCapture {
+// public constants
+public:
+    enum { RING_SIZE = 3 };     // frames in flight on the GPU
+    enum { QUEUE_DEPTH = 8 };   // frames waiting to be written
+
+// private types
+private:
+    struct Slot {
+        unsigned int bufferID;  // GL pixel pack buffer
+        struct __GLsync *fence; // signaled when readback is done, or NULL
+        int width, height;      // size of frame in buffer
+        size_t capacity;        // allocated buffer size
+        unsigned int frame;     // frame number for file name
+    };
+
+    struct Frame {
+        ImagePPM *image;        // pixels, top row first
+        unsigned int frame;     // frame number for file name
+    };
+
+// private data
+private:
+    std::string pattern;        // printf pattern for file names
+    bool active;                // true while recording
+    Slot ring[RING_SIZE];       // readback buffers
+    unsigned int next;          // next slot to fill
+    unsigned int frames;        // frames captured so far
+
+    // writer thread and its queue
+    std::thread writer;
+    std::mutex lock;                    // protects everything below
+    std::condition_variable changed;    // signal queue change
+    std::deque<Frame> queue;            // frames to write, oldest first
+    bool quit;                          // true to stop writer thread
+    unsigned int waits;                 // times capture waited for writer
+    double writeTime;                   // seconds spent writing files
+    unsigned int written;               // frames written so far
+
+    // no copying
+    FrameCapture(const FrameCapture &);
+    FrameCapture &operator=(const FrameCapture &);
+
+    // map finished buffer and queue its frame for writing
+    void retire(Slot &slot);
+
+    // writer thread loop
+    void write();
+
+// public methods
+public:
+    // set up buffers and writer thread
+    // pattern is a printf pattern for the frame number, like "frame%05d.ppm"
+    explicit FrameCapture(const char *pattern);
+
+    // write any remaining frames and free buffers
+    // needs the GL context still current
+    ~FrameCapture();
+
+    // start or stop recording
+    // stopping writes out all frames still in the ring
+    void start();
+    void stop();
+    bool recording() const { return active; }
+
+    // stop, then wait for every captured frame to be written
+    void flush();
+
+    // read back frame just drawn, call before swapping buffers
+    // does nothing if not recording
+    void capture(int width, int height);
+
+    // frames captured, and total seconds spent writing them out (on the
+    // writer thread)
+    unsigned int captured() const { return frames; }
+    double writeSeconds();
+};
+
+#endif
@@ -0,0 +1,87 @@
+// view frustum for culling bounding boxes
+
+#include "Frustum.hpp"
+#include "Simd.hpp"
+#include <math.h>
+
+//
+// extract planes from matrix rows
+//
+Frustum::Frustum(const glm::mat4 &m)
+{
+    // a point p is inside if -w <= x,y,z <= w for (x,y,z,w) = m*p,
+    // so each plane is row 3 plus or minus row 0, 1 or 2
+    // glm matrices are indexed [column][row]
+    for(int i=0; i < 6; ++i) {
+        int row = i/2;
+        float sign = (i & 1) ? -1.f : 1.f;
+        a[i] = m[0][3] + sign * m[0][row];
+        b[i] = m[1][3] + sign * m[1][row];
+        c[i] = m[2][3] + sign * m[2][row];
+        d[i] = m[3][3] + sign * m[3][row];
+    }
+    for(int i=6; i < PLANES; ++i) {
+        a[i] = b[i] = c[i] = 0;
+        d[i] = 1;
+    }
+    for(int i=0; i < PLANES; ++i) {
+        absA[i] = fabsf(a[i]);
+        absB[i] = fabsf(b[i]);
+        absC[i] = fabsf(c[i]);
+    }
+}
+
+//
+// test box center against each plane, allowing for the box extent
+// toward that plane
+//
+Frustum::Result Frustum::test(const glm::vec3 &boxMin,
+                              const glm::vec3 &boxMax) const
+{
+#ifdef USE_SSE2
+    __m128 cx = _mm_set1_ps(0.5f * (boxMin.x + boxMax.x));
+    __m128 cy = _mm_set1_ps(0.5f * (boxMin.y + boxMax.y));
+    __m128 cz = _mm_set1_ps(0.5f * (boxMin.z + boxMax.z));
+    __m128 ex = _mm_set1_ps(0.5f * (boxMax.x - boxMin.x));
+    __m128 ey = _mm_set1_ps(0.5f * (boxMax.y - boxMin.y));
+    __m128 ez = _mm_set1_ps(0.5f * (boxMax.z - boxMin.z));
+
+    int outside = 0, partly = 0;
+    for(int i=0; i < PLANES; i += 4) {
+        // signed distance of center, and of the box corner farthest
+        // along the plane normal, in units of the normal's length
+        __m128 dist = _mm_add_ps(
+            _mm_add_ps(_mm_mul_ps(_mm_loadu_ps(a+i), cx),
+                       _mm_mul_ps(_mm_loadu_ps(b+i), cy)),
+            _mm_add_ps(_mm_mul_ps(_mm_loadu_ps(c+i), cz),
+                       _mm_loadu_ps(d+i)));
+        __m128 radius = _mm_add_ps(
+            _mm_add_ps(_mm_mul_ps(_mm_loadu_ps(absA+i), ex),
+                       _mm_mul_ps(_mm_loadu_ps(absB+i), ey)),
+            _mm_mul_ps(_mm_loadu_ps(absC+i), ez));
+
+        // wholly behind any plane is outside, partly behind any intersects
+        outside |= _mm_movemask_ps(
+            _mm_cmplt_ps(_mm_add_ps(dist, radius), _mm_setzero_ps()));
+        partly |= _mm_movemask_ps(
+            _mm_cmplt_ps(_mm_sub_ps(dist, radius), _mm_setzero_ps()));
+    }
+#else
+    glm::vec3 center = 0.5f * (boxMin + boxMax);
+    glm::vec3 extent = 0.5f * (boxMax - boxMin);
+
+    int outside = 0, partly = 0;
+    for(int i=0; i < PLANES; ++i) {
+        // same distances as above, one plane at a time
+        float dist = (a[i] * center.x + b[i] * center.y)
+                   + (c[i] * center.z + d[i]);
+        float radius = (absA[i] * extent.x + absB[i] * extent.y)
+                     + absC[i] * extent.z;
+        outside |= dist + radius < 0;
+        partly |= dist - radius < 0;
+    }
+#endif
+
+    if (outside) return OUTSIDE;
+    return partly ? INTERSECTS : INSIDE;
+}
@@ -0,0 +1,36 @@
+// view frustum for culling bounding boxes
+// CPU only
+//
+// The six clip planes come straight from the rows of a combined
+// projection * view matrix, so boxes are tested in world space. Planes
+// are stored by component, four to an SSE register, so a box is tested
+// against four planes at once, or one at a time on CPUs without SSE2.
+#ifndef Frustum_hpp
+#define Frustum_hpp
+
+#include <glm/glm.hpp>
+
+class Frustum {
+// public types
+public:
+    enum Result { OUTSIDE, INTERSECTS, INSIDE };
+
+// private data
+private:
+    // left, right, bottom, top, near, far, and two that always pass
+    // a, b, c, d of a*x + b*y + c*z + d >= 0 for points inside,
+    // and |a|, |b|, |c|
+    enum { PLANES = 8 };
+    float a[PLANES], b[PLANES], c[PLANES], d[PLANES];
+    float absA[PLANES], absB[PLANES], absC[PLANES];
+
+// public methods
+public:
+    // planes of projection * view matrix
+    explicit Frustum(const glm::mat4 &viewProjection);
+
+    // classify world space box
+    Result test(const glm::vec3 &boxMin, const glm::vec3 &boxMax) const;
+};
+
+#endif
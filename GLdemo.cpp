@@ -8,12 +8,18 @@
 #include "Scene.hpp"
 #include "Terrain.hpp"
 #include "Marker.hpp"
+#include "ThreadPool.hpp"
+#include "FrameCapture.hpp"
+#include "Batch.hpp"
 
 // using core modern OpenGL
 #include <GL/glew.h>
 #include <GLFW/glfw3.h>
 
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
 
 ///////
 // Clean up any context data
@@ -24,6 +30,8 @@ AppContext::~AppContext()
     delete input;
     delete terrain;
     delete lightmarker;
+    delete capture;
+    delete pool;
 }
 
 ///////
@@ -56,7 +64,7 @@ extern "C" {
     {
         AppContext *appctx = (AppContext*)glfwGetWindowUserPointer(win);
 
-        appctx->input->mousePress(win, button, action);
+        appctx->input->mousePress(win, button, action, appctx);
     }
 
     //
@@ -126,6 +134,88 @@ GLFWwindow *initGLFW(AppContext *appctx)
 
 int main(int argc, char *argv[])
 {
+    // startup time, for reporting time to first frame
+    std::chrono::steady_clock::time_point start =
+        std::chrono::steady_clock::now();
+
+    // GLdemo -batch path.txt [-size width height] [-o pattern]
+    // renders frames of a camera path to files instead of opening a window
+    // -packed uses compact vertices (see Terrain::VertexFormat)
+    // -grid draws with no vertex data, just an elevation texture
+    // -lod draws chunks with detail to suit the view, with no error over
+    // the given number of pixels (see TerrainQuadtree)
+    // -tess draws patches the GPU divides into triangles about the given
+    // number of pixels across, fewer where the terrain is smooth
+    // -simplify draws the mesh with only the triangles needed to keep
+    // within the given height error in world units (see TerrainRTIN)
+    // -index sets the triangle order, like "rows" or "blocks+strips+short"
+    // (see TerrainIndices)
+    const char *batchPath = 0, *pattern = "frame%05d.ppm";
+    int width = 1280, height = 720;
+    Terrain::VertexFormat format = Terrain::SEPARATE_VERTICES;
+    float detailPixels = 1, simplifyError = 0;
+    int indexLayout = TerrainIndices::BLOCKS | TerrainIndices::STRIPS |
+        TerrainIndices::SHORT;
+    for(int arg=1; arg < argc; ++arg) {
+        if (strcmp(argv[arg], "-packed") == 0)
+            format = Terrain::PACKED_VERTICES;
+        else if (strcmp(argv[arg], "-grid") == 0)
+            format = Terrain::PROCEDURAL_GRID;
+        else if (strcmp(argv[arg], "-lod") == 0 && arg+1 < argc) {
+            format = Terrain::LOD_CHUNKS;
+            detailPixels = float(atof(argv[++arg]));
+            if (detailPixels <= 0) {
+                fprintf(stderr, "-lod needs a pixel error above 0\n");
+                return 1;
+            }
+        }
+        else if (strcmp(argv[arg], "-tess") == 0 && arg+1 < argc) {
+            format = Terrain::TESSELLATED_PATCHES;
+            detailPixels = float(atof(argv[++arg]));
+            if (detailPixels <= 0) {
+                fprintf(stderr, "-tess needs a triangle size above 0\n");
+                return 1;
+            }
+        }
+        else if (strcmp(argv[arg], "-simplify") == 0 && arg+1 < argc) {
+            simplifyError = float(atof(argv[++arg]));
+            if (simplifyError <= 0) {
+                fprintf(stderr, "-simplify needs a height error above 0\n");
+                return 1;
+            }
+        }
+        else if (strcmp(argv[arg], "-index") == 0 && arg+1 < argc) {
+            indexLayout = TerrainIndices::parseLayout(argv[++arg]);
+            if (indexLayout < 0) {
+                fprintf(stderr, "unknown index layout %s\n", argv[arg]);
+                return 1;
+            }
+        }
+        else if (strcmp(argv[arg], "-batch") == 0 && arg+1 < argc)
+            batchPath = argv[++arg];
+        else if (strcmp(argv[arg], "-size") == 0 && arg+2 < argc) {
+            width = atoi(argv[++arg]);
+            height = atoi(argv[++arg]);
+            if (width <= 0 || height <= 0) {
+                fprintf(stderr, "-size needs a width and height above 0\n");
+                return 1;
+            }
+        }
+        else if (strcmp(argv[arg], "-o") == 0 && arg+1 < argc)
+            pattern = argv[++arg];
+        else {
+            fprintf(stderr, "usage: %s [-packed | -grid | -lod pixels | "
+                    "-tess pixels] [-simplify error] "
+                    "[-index rows|blocks[+strips][+short]] "
+                    "[-batch path.txt [-size width height] "
+                    "[-o frame%%05d.ppm]]\n", argv[0]);
+            return 1;
+        }
+    }
+    if (batchPath)
+        return runBatch(batchPath, pattern, width, height,
+                        format, indexLayout, detailPixels, simplifyError);
+
     // collected data about application for use in callbacks
     AppContext appctx;
 
@@ -134,17 +224,26 @@ int main(int argc, char *argv[])
     if (! win) return 1;
 
     // initialize context (after GLFW)
+    appctx.pool = new ThreadPool;
     appctx.input = new Input;
     appctx.terrain = new Terrain("terrain.ppm", "pebbles.ppm", 
-                                 "pebbles-norm.ppm", "pebbles-gloss.ppm");
+                                 "pebbles-norm.ppm", "pebbles-gloss.ppm",
+                                 *appctx.pool, format, indexLayout,
+                                 detailPixels, simplifyError);
     appctx.lightmarker = new Marker();
     appctx.scene = new Scene(win, *appctx.lightmarker);
+    appctx.capture = new FrameCapture("frame%05d.ppm");
 
     // loop until GLFW says it's time to quit
+    bool firstFrame = true;
     while (!glfwWindowShouldClose(win)) {
         // check for continuous key updates to view
         appctx.input->keyUpdate(&appctx);
 
+        // continue any texture loading, redraw if one changed
+        if (appctx.terrain->update())
+            appctx.input->redraw = true;
+
         if (appctx.input->redraw) {
             // we're handing the redraw now
             appctx.input->redraw = false;
@@ -155,17 +254,34 @@ int main(int argc, char *argv[])
 
             // draw something
             appctx.scene->update();
-            appctx.terrain->draw();
+            appctx.terrain->draw(*appctx.scene);
             appctx.lightmarker->draw();
 
+            // save frame if recording
+            appctx.capture->capture(appctx.scene->width,
+                                    appctx.scene->height);
+
             // show what we drew
             glfwSwapBuffers(win);
+
+            // report startup cost once the first frame is really done
+            if (firstFrame) {
+                glFinish();
+                printf("time to first frame: %.1f ms\n",
+                       std::chrono::duration<double, std::milli>(
+                           std::chrono::steady_clock::now() - start).count());
+                firstFrame = false;
+            }
         }
 
         // wait for user input
         glfwPollEvents();
     }
 
+    // finish writing captured frames while the GL context still exists
+    delete appctx.capture;
+    appctx.capture = 0;
+
     glfwDestroyWindow(win);
     glfwTerminate();
 
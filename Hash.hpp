@@ -0,0 +1,32 @@
+// 64-bit FNV-1a hash, for cache file keys and checksums
+// Bytes are taken 8 at a time rather than one at a time, so hashing a
+// large elevation file doesn't cost as much as building from it. That
+// makes the results differ from textbook FNV-1a, so keep to this one
+// function for anything saved to disk.
+#ifndef Hash_hpp
+#define Hash_hpp
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+const uint64_t FNV_OFFSET = 0xcbf29ce484222325ull;  // hash of nothing
+const uint64_t FNV_PRIME = 0x100000001b3ull;
+
+// hash size bytes of data, continuing from an earlier hash h
+inline uint64_t hashBytes(const void *data, size_t size,
+                          uint64_t h = FNV_OFFSET)
+{
+    const unsigned char *bytes = (const unsigned char*)data;
+    size_t i = 0;
+    for(; i + 8 <= size; i += 8) {
+        uint64_t word;
+        memcpy(&word, bytes + i, 8);
+        h = (h ^ word) * FNV_PRIME;
+    }
+    for(; i < size; ++i)
+        h = (h ^ bytes[i]) * FNV_PRIME;
+    return h;
+}
+
+#endif
@@ -0,0 +1,339 @@
+// min-max height pyramid for casting rays against the terrain
+
+#include "HeightPyramid.hpp"
+#include "Heightfield.hpp"
+#include "ThreadPool.hpp"
+#include <algorithm>
+#include <float.h>
+#include <math.h>
+
+//
+// ray o + t*d against triangle a, b, c: true with t if it hits for
+// tMin <= t <= tMax. Moller-Trumbore, with a little slack at the edges
+// so a ray through the diagonal or a square edge can't slip between.
+//
+static bool hitTriangle(const glm::vec3 &o, const glm::vec3 &d,
+                        const glm::vec3 &a, const glm::vec3 &b,
+                        const glm::vec3 &c, float tMin, float tMax, float &t)
+{
+    const float slack = 1e-5f;
+    glm::vec3 e1 = b - a, e2 = c - a;
+    glm::vec3 p = glm::cross(d, e2);
+    float det = glm::dot(e1, p);
+    if (det == 0) return false;
+
+    float inv = 1 / det;
+    glm::vec3 s = o - a;
+    float u = glm::dot(s, p) * inv;
+    if (u < -slack || u > 1 + slack) return false;
+    glm::vec3 q = glm::cross(s, e1);
+    float v = glm::dot(d, q) * inv;
+    if (v < -slack || u + v > 1 + slack) return false;
+
+    t = glm::dot(e2, q) * inv;
+    return t >= tMin && t <= tMax;
+}
+
+//
+// build from elevation, at the same heights TerrainMesh would use
+//
+void HeightPyramid::build(const Heightfield &elevation,
+                          const glm::vec3 &mapSize, ThreadPool *pool)
+{
+    width = elevation.width;
+    height = elevation.height;
+    this->mapSize = mapSize;
+
+    unsigned int rowLength = width + 1;
+    float maxval = float(elevation.maxval);
+    heights.resize(size_t(rowLength) * (height + 1));
+    for(unsigned int y=0; y <= height; ++y) {
+        const unsigned short *row = elevation.row(y % height);
+        for(unsigned int x=0; x <= width; ++x)
+            heights[y * rowLength + x] =
+                (float(row[x % width]) / maxval - 0.5f) * mapSize.z;
+    }
+    reduce(pool);
+}
+
+//
+// build from mesh
+//
+void HeightPyramid::build(const TerrainMesh &mesh, ThreadPool *pool)
+{
+    width = unsigned(mesh.gridSize.x);
+    height = unsigned(mesh.gridSize.y);
+    mapSize = mesh.mapSize;
+
+    heights.resize(mesh.numvert);
+    for(unsigned int v=0; v < mesh.numvert; ++v)
+        heights[v] = mesh.vert[v].z;
+    reduce(pool);
+}
+
+//
+// range of one node
+//
+HeightPyramid::Range HeightPyramid::nodeRange(unsigned int level,
+                                              unsigned int nx,
+                                              unsigned int ny) const
+{
+    Range r;
+    if (level == 0) {
+        const float *row0 = &heights[ny * (width + 1) + nx];
+        const float *row1 = row0 + width + 1;
+        r.lo = std::min(std::min(row0[0], row0[1]), std::min(row1[0], row1[1]));
+        r.hi = std::max(std::max(row0[0], row0[1]), std::max(row1[0], row1[1]));
+        return r;
+    }
+
+    // up to 2x2 children, fewer along odd edges
+    unsigned int cx1 = std::min(2*nx + 1, nodesX[level - 1] - 1);
+    unsigned int cy1 = std::min(2*ny + 1, nodesY[level - 1] - 1);
+    r = range(level - 1, 2*nx, 2*ny);
+    for(unsigned int cy=2*ny; cy <= cy1; ++cy) {
+        for(unsigned int cx=2*nx; cx <= cx1; ++cx) {
+            Range c = range(level - 1, cx, cy);
+            r.lo = std::min(r.lo, c.lo);
+            r.hi = std::max(r.hi, c.hi);
+        }
+    }
+    return r;
+}
+
+//
+// fill every level from the one below, starting from the squares
+//
+void HeightPyramid::reduce(ThreadPool *pool)
+{
+    // sizes first, since each level's layout depends on the next
+    unsigned int nx = width, ny = height;
+    for(levels = 1; levels < MAX_LEVELS && (nx > 1 || ny > 1); ++levels) {
+        nodesX[levels - 1] = nx;
+        nodesY[levels - 1] = ny;
+        nx = (nx + 1) / 2;
+        ny = (ny + 1) / 2;
+    }
+    nodesX[levels - 1] = nx;
+    nodesY[levels - 1] = ny;
+    nodesX[levels] = nodesY[levels] = 1;
+
+    // squares come straight from heights, so start at level 1
+    for(unsigned int level=1; level < levels; ++level) {
+        ranges[level].resize(4 * size_t(nodesX[level + 1]) * nodesY[level + 1]);
+        auto rows = [&](unsigned int y0, unsigned int y1) {
+            for(unsigned int y=y0; y < y1; ++y)
+                for(unsigned int x=0; x < nodesX[level]; ++x)
+                    ranges[level][nodeIndex(level, x, y)] =
+                        nodeRange(level, x, y);
+        };
+        if (pool && size_t(nodesX[level]) * nodesY[level] > 4096)
+            pool->parallelFor(0, nodesY[level], rows);
+        else
+            rows(0, nodesY[level]);
+    }
+}
+
+//
+// new heights for edited vertices, then the nodes over them
+//
+void HeightPyramid::update(const TerrainMesh &mesh,
+                           const std::vector<TerrainMesh::Span> &spans)
+{
+    unsigned int rowLength = width + 1;
+    for(size_t s=0; s < spans.size(); ++s) {
+        const TerrainMesh::Span &span = spans[s];
+        for(unsigned int v=span.first; v < span.first + span.count; ++v)
+            heights[v] = mesh.vert[v].z;
+
+        // squares with a corner in the span, then their parents
+        unsigned int y = span.first / rowLength;
+        unsigned int x = span.first % rowLength;
+        unsigned int x0 = x > 0 ? x - 1 : 0;
+        unsigned int x1 = std::min(x + span.count - 1, width - 1);
+        unsigned int y0 = y > 0 ? y - 1 : 0;
+        unsigned int y1 = std::min(y, height - 1);
+        for(unsigned int level=1; level < levels; ++level) {
+            x0 /= 2; x1 /= 2;
+            y0 /= 2; y1 /= 2;
+            for(unsigned int ny=y0; ny <= y1; ++ny)
+                for(unsigned int nx=x0; nx <= x1; ++nx)
+                    ranges[level][nodeIndex(level, nx, ny)] =
+                        nodeRange(level, nx, ny);
+        }
+    }
+}
+
+//
+// both triangles of one square, split along the same diagonal as
+// TerrainMesh, keeping the nearer hit
+//
+bool HeightPyramid::hitSquare(unsigned int x, unsigned int y,
+                              const glm::vec3 &o, const glm::vec3 &d,
+                              float tMin, float tMax, Hit &hit) const
+{
+    const float *row0 = &heights[y * (width + 1) + x];
+    const float *row1 = row0 + width + 1;
+    float fx = float(x), fy = float(y);
+    glm::vec3 p00(fx, fy, row0[0]), p10(fx + 1, fy, row0[1]);
+    glm::vec3 p01(fx, fy + 1, row1[0]), p11(fx + 1, fy + 1, row1[1]);
+
+    float t;
+    bool found = false;
+    if (hitTriangle(o, d, p00, p10, p11, tMin, tMax, t)) {
+        hit.t = tMax = t;
+        hit.normal = glm::cross(p10 - p00, p11 - p00);
+        found = true;
+    }
+    if (hitTriangle(o, d, p00, p11, p01, tMin, tMax, t)) {
+        hit.t = t;
+        hit.normal = glm::cross(p11 - p00, p01 - p00);
+        found = true;
+    }
+    return found;
+}
+
+//
+// walk the nodes the ray crosses, stepping down a level where it might
+// hit and back up when it leaves its parent
+//
+bool HeightPyramid::cast(const Ray &ray, Hit &hit, unsigned int top) const
+{
+    hit.hit = false;
+    if (levels == 0) return false;
+    top = std::min(top, levels - 1);
+
+    // grid space: squares one unit across from 0,0, heights in world units
+    glm::vec3 scale(float(width) / mapSize.x, float(height) / mapSize.y, 1);
+    glm::vec3 o = ray.origin * scale +
+        glm::vec3(0.5f * float(width), 0.5f * float(height), 0);
+    glm::vec3 d = ray.direction * scale;
+
+    // clip to the box around the whole terrain
+    Range root = range(levels - 1, 0, 0);
+    glm::vec3 boxMin(0, 0, root.lo);
+    glm::vec3 boxMax(float(width), float(height), root.hi);
+    float t0 = ray.minT, t1 = ray.maxT;
+    for(int a=0; a < 3; ++a) {
+        if (d[a] == 0) {
+            if (o[a] < boxMin[a] || o[a] > boxMax[a]) return false;
+            continue;
+        }
+        float ta = (boxMin[a] - o[a]) / d[a], tb = (boxMax[a] - o[a]) / d[a];
+        t0 = std::max(t0, std::min(ta, tb));
+        t1 = std::min(t1, std::max(ta, tb));
+    }
+    if (t0 > t1) return false;
+
+    // start in the top level node holding the entry point
+    unsigned int level = top;
+    float size = float(1u << level);
+    glm::vec3 p = o + d * t0;
+    int nx = std::min(std::max(int(floorf(p.x / size)), 0),
+                      int(nodesX[level]) - 1);
+    int ny = std::min(std::max(int(floorf(p.y / size)), 0),
+                      int(nodesY[level]) - 1);
+    int stepX = d.x < 0 ? -1 : 1, stepY = d.y < 0 ? -1 : 1;
+
+    // the ray leaves a node through its far side in x and y, at
+    // (side - o) / d, or never for a ray straight up or down
+    float farX = d.x < 0 ? 0.f : 1.f, farY = d.y < 0 ? 0.f : 1.f;
+    float invX = d.x != 0 ? 1 / d.x : 0, invY = d.y != 0 ? 1 / d.y : 0;
+    float limitX = d.x != 0 ? -FLT_MAX : FLT_MAX;
+    float limitY = d.y != 0 ? -FLT_MAX : FLT_MAX;
+
+    // node ranges are widened a little for rounding in the ray heights
+    float slack = 1e-5f * std::max(fabsf(root.lo), fabsf(root.hi));
+
+    float t = t0;
+    for(;;) {
+        // where the ray leaves this node
+        float x1 = std::min((float(nx) + farX) * size, float(width));
+        float y1 = std::min((float(ny) + farY) * size, float(height));
+        float tx = std::max((x1 - o.x) * invX, limitX);
+        float ty = std::max((y1 - o.y) * invY, limitY);
+        float tExit = std::max(std::min(std::min(tx, ty), t1), t);
+
+        // heights over the node might meet it: look closer
+        Range r = range(level, unsigned(nx), unsigned(ny));
+        float za = o.z + d.z * t, zb = o.z + d.z * tExit;
+        if (std::max(za, zb) >= r.lo - slack &&
+            std::min(za, zb) <= r.hi + slack) {
+            if (level > 0) {
+                // down to whichever child the ray is in now
+                --level;
+                size *= 0.5f;
+                p = o + d * t;
+                nx = std::min(2*nx + (p.x >= float(2*nx + 1) * size),
+                              int(nodesX[level]) - 1);
+                ny = std::min(2*ny + (p.y >= float(2*ny + 1) * size),
+                              int(nodesY[level]) - 1);
+                continue;
+            }
+
+            // a little past the ends too, in case rounding put the hit
+            // just outside this square
+            float pad = 1e-4f * (tExit - t) + 1e-7f * fabsf(tExit);
+            if (hitSquare(unsigned(nx), unsigned(ny), o, d,
+                          std::max(t - pad, ray.minT),
+                          std::min(tExit + pad, ray.maxT), hit)) {
+                hit.hit = true;
+                hit.point = ray.origin + ray.direction * hit.t;
+                hit.normal = glm::normalize(hit.normal * scale);
+                hit.cellX = unsigned(nx);
+                hit.cellY = unsigned(ny);
+                return true;
+            }
+        }
+
+        // on to the next node, if the ray goes that far
+        if (tExit >= t1) return false;
+        t = tExit;
+        int px = nx >> 1, py = ny >> 1;
+        if (tx <= ty)
+            nx += stepX;
+        else
+            ny += stepY;
+        if (nx < 0 || ny < 0 ||
+            nx >= int(nodesX[level]) || ny >= int(nodesY[level]))
+            return false;
+
+        // crossed into another parent: try skipping at the coarser level
+        if (level < top && ((nx >> 1) != px || (ny >> 1) != py)) {
+            ++level;
+            size *= 2;
+            nx >>= 1;
+            ny >>= 1;
+        }
+    }
+}
+
+//
+// many rays at once
+//
+void HeightPyramid::cast(const Ray *rays, Hit *hits, unsigned int count,
+                         ThreadPool *pool) const
+{
+    auto some = [&](unsigned int begin, unsigned int end) {
+        for(unsigned int i=begin; i < end; ++i)
+            cast(rays[i], hits[i]);
+    };
+    if (pool)
+        pool->parallelFor(0, count, some, 256);
+    else
+        some(0, count);
+}
+
+//
+// any hit strictly between the ends
+//
+bool HeightPyramid::occluded(const glm::vec3 &from, const glm::vec3 &to) const
+{
+    Ray ray;
+    ray.origin = from;
+    ray.direction = to - from;
+    ray.minT = 1e-4f;
+    ray.maxT = 1 - 1e-4f;
+    Hit hit;
+    return cast(ray, hit);
+}
@@ -0,0 +1,140 @@
+// min-max height pyramid for casting rays against the terrain
+// CPU only, so it can be used on any thread
+//
+// Level 0 holds the lowest and highest corner of every grid square, and
+// each level up holds the range of 2x2 nodes of the level below, up to
+// a single root. A ray starts at the root and only steps down into a
+// node where its own height over the node overlaps the node's range, so
+// most of the terrain is skipped a whole node at a time, and only a
+// handful of squares get their triangles tested. Triangles are the same
+// two per square as TerrainMesh, so hits match what is drawn.
+#ifndef HeightPyramid_hpp
+#define HeightPyramid_hpp
+
+#include "TerrainMesh.hpp"
+#include <glm/glm.hpp>
+#include <vector>
+
+class Heightfield;
+class ThreadPool;
+
+class HeightPyramid {
+// public types
+public:
+    enum { MAX_LEVELS = 24 };       // enough for 2^23 samples across
+
+    // world space ray, covering origin + t*direction for minT <= t <= maxT
+    struct Ray {
+        glm::vec3 origin, direction;
+        float minT, maxT;
+    };
+
+    // first point where a ray meets the terrain
+    struct Hit {
+        bool hit;                   // false if it never does
+        float t;                    // ray parameter of hit
+        glm::vec3 point;            // world space position
+        glm::vec3 normal;           // world space normal of triangle hit
+        unsigned int cellX, cellY;  // grid square hit
+    };
+
+// private types
+private:
+    struct Range {
+        float lo, hi;               // world space height range
+    };
+
+// private data
+private:
+    // world z of each vertex, which give the range of each square
+    std::vector<float> heights;
+
+    // ranges of the nodes above the squares, from level 1 up, each level
+    // stored as the 2x2 children of each node of the level above, so one
+    // node's children share a cache line
+    std::vector<Range> ranges[MAX_LEVELS];
+    unsigned int nodesX[MAX_LEVELS + 1];        // nodes across each level
+    unsigned int nodesY[MAX_LEVELS + 1];        // nodes down each level
+
+    // no copying
+    HeightPyramid(const HeightPyramid &);
+    HeightPyramid &operator=(const HeightPyramid &);
+
+    // where node nx, ny of level is in ranges
+    size_t nodeIndex(unsigned int level, unsigned int nx,
+                     unsigned int ny) const {
+        return ((size_t(ny >> 1) * nodesX[level + 1] + (nx >> 1)) << 2)
+            + ((ny & 1) << 1) + (nx & 1);
+    }
+
+    // range of node nx, ny at level
+    Range range(unsigned int level, unsigned int nx, unsigned int ny) const {
+        return level ? ranges[level][nodeIndex(level, nx, ny)]
+                     : nodeRange(0, nx, ny);
+    }
+
+    // fill levels from heights
+    void reduce(ThreadPool *pool);
+
+    // compute range of node nx, ny at level from the level below, or
+    // from the corners of the square at level 0
+    Range nodeRange(unsigned int level, unsigned int nx,
+                    unsigned int ny) const;
+
+    // nearest hit on the triangles of square x, y between tMin and tMax,
+    // all in grid space, replacing hit if found
+    bool hitSquare(unsigned int x, unsigned int y, const glm::vec3 &o,
+                   const glm::vec3 &d, float tMin, float tMax,
+                   Hit &hit) const;
+
+    // cast starting from level top rather than the root
+    bool cast(const Ray &ray, Hit &hit, unsigned int top) const;
+
+// public data
+public:
+    unsigned int width, height;     // grid squares, as TerrainMesh
+    glm::vec3 mapSize;              // size of terrain in world space
+    unsigned int levels;            // levels in pyramid, root is levels-1
+
+// public methods
+public:
+    // create empty
+    HeightPyramid() : width(0), height(0), levels(0) {}
+
+    // build from elevation samples, placed as TerrainMesh would
+    // if pool is given, rows of each level are done in parallel across it
+    void build(const Heightfield &elevation, const glm::vec3 &mapSize,
+               ThreadPool *pool = 0);
+
+    // build from mesh vertex heights
+    void build(const TerrainMesh &mesh, ThreadPool *pool = 0);
+
+    // world z of each vertex, (width+1) x (height+1) in [y][x] order,
+    // as TerrainMesh
+    const float *vertexHeights() const { return &heights[0]; }
+
+    // take new heights for the vertices in spans from mesh, after
+    // TerrainMesh::edit, updating just the nodes above them
+    void update(const TerrainMesh &mesh,
+                const std::vector<TerrainMesh::Span> &spans);
+
+    // first hit along ray, return true if there is one
+    bool cast(const Ray &ray, Hit &hit) const { return cast(ray, hit, levels-1); }
+
+    // hits[i] for rays[i], spread across pool if given
+    void cast(const Ray *rays, Hit *hits, unsigned int count,
+              ThreadPool *pool = 0) const;
+
+    // same result as cast, but stepping through every square the ray
+    // crosses, as a reference to check the pyramid against
+    bool castSquares(const Ray &ray, Hit &hit) const {
+        return cast(ray, hit, 0);
+    }
+
+    // true if the terrain blocks the line between two points, as for
+    // line of sight or shadow tests. The ends themselves never count, so
+    // a point on the surface does not block itself.
+    bool occluded(const glm::vec3 &from, const glm::vec3 &to) const;
+};
+
+#endif
@@ -0,0 +1,166 @@
+// single-channel height field
+// stores one 16-bit sample per grid point, rather than a full RGB color,
+// so terrain elevation takes 1/3 the memory of an ImagePPM and can use
+// 16-bit data where 8 bits would produce visible terracing
+
+// it would be cleaner to throw/catch errors, but they just print & exit
+
+#include "Heightfield.hpp"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <float.h>
+
+#ifdef _WIN32
+// don't complain if we use standard IO functions instead of windows-only
+#pragma warning( disable: 4996 )
+#endif
+
+//
+// read one white-space separated header token, skipping comments
+// consumes the single white-space character after the token
+//
+static void readToken(FILE *fp, const char *name, char *token, int size)
+{
+    int c = fgetc(fp);
+    for(;;) {
+        if (c == '#')                   // comment to end of line
+            while (c != '\n' && c != EOF) c = fgetc(fp);
+        else if (c == ' ' || c == '\t' || c == '\r' || c == '\n')
+            c = fgetc(fp);
+        else
+            break;
+    }
+
+    int len = 0;
+    for(; c != EOF && c != ' ' && c != '\t' && c != '\r' && c != '\n';
+        c = fgetc(fp))
+        if (len < size-1) token[len++] = char(c);
+    token[len] = 0;
+
+    if (len == 0) {
+        fprintf(stderr, "bad header in %s\n", name);
+        exit(1);
+    }
+}
+
+//
+// allocate aligned rows
+//
+void Heightfield::allocate(unsigned int w, unsigned int h)
+{
+    width = w;
+    height = h;
+    stride = (w + ROW_ALIGN-1) / ROW_ALIGN * ROW_ALIGN;
+
+    // over-allocate to align start, and zero any row padding
+    storage = new unsigned short[size_t(stride) * h + ROW_ALIGN];
+    size_t misalign = (size_t(storage) / sizeof(unsigned short)) % ROW_ALIGN;
+    samples = storage + (misalign ? ROW_ALIGN - misalign : 0);
+    memset(samples, 0, size_t(stride) * h * sizeof(unsigned short));
+}
+
+//
+// create flat height field
+//
+Heightfield::Heightfield(unsigned int w, unsigned int h, unsigned int max)
+    : maxval(max)
+{
+    allocate(w, h);
+}
+
+//
+// load from file
+//
+Heightfield::Heightfield(const char *name)
+{
+    FILE *fp = fopen(name, "rb");
+    if (!fp) {
+        fprintf(stderr, "error opening %s\n", name);
+        exit(1);
+    }
+
+    // P5 = grey, P6 = color, Pf = grey float, PF = color float
+    char magic[3] = {0};
+    if (fread(magic, 1, 2, fp) != 2 || magic[0] != 'P' ||
+        !strchr("56fF", magic[1])) {
+        fprintf(stderr, "unknown image format %s\n", name);
+        exit(1);
+    }
+    bool pfm = magic[1] == 'f' || magic[1] == 'F';
+    unsigned int channels = (magic[1] == '6' || magic[1] == 'F') ? 3 : 1;
+
+    // size, then maximum value (PNM) or scale and byte order (PFM)
+    char token[32];
+    readToken(fp, name, token, sizeof(token));
+    unsigned int w = atoi(token);
+    readToken(fp, name, token, sizeof(token));
+    unsigned int h = atoi(token);
+    readToken(fp, name, token, sizeof(token));
+    double scale = atof(token);
+    if (w == 0 || h == 0 || scale == 0 || (!pfm && (scale < 0 || scale > 65535))) {
+        fprintf(stderr, "bad header in %s\n", name);
+        exit(1);
+    }
+
+    allocate(w, h);
+
+    // bytes per sample
+    unsigned int bytes = pfm ? 4 : (scale > 255 ? 2 : 1);
+    size_t pixel = channels * bytes;
+    unsigned char *raw = new unsigned char[w * pixel];
+
+    if (!pfm) {
+        // integer samples used as-is, with 16-bit data in big-endian order
+        maxval = (unsigned int)scale;
+        for(unsigned int y=0; y < h; ++y) {
+            if (fread(raw, pixel, w, fp) != w) {
+                fprintf(stderr, "%s is truncated\n", name);
+                exit(1);
+            }
+            unsigned short *out = row(y);
+            if (bytes == 1)
+                for(unsigned int x=0; x < w; ++x)
+                    out[x] = raw[x*pixel];
+            else
+                for(unsigned int x=0; x < w; ++x)
+                    out[x] = (unsigned short)(raw[x*pixel] << 8 | raw[x*pixel+1]);
+        }
+    }
+    else {
+        // PFM rows go bottom to top, with negative scale for little-endian
+        // heights are scaled to the full 16-bit range, so read once as
+        // float to find the range, then quantize in place
+        float *heights = new float[size_t(w) * h];
+        float lo = FLT_MAX, hi = -FLT_MAX;
+        unsigned short one = 1;
+        bool swap = (scale < 0) != (*(unsigned char*)&one == 1);
+        for(unsigned int y=0; y < h; ++y) {
+            if (fread(raw, pixel, w, fp) != w) {
+                fprintf(stderr, "%s is truncated\n", name);
+                exit(1);
+            }
+            float *out = heights + size_t(h-1 - y) * w;
+            for(unsigned int x=0; x < w; ++x) {
+                unsigned char *p = raw + x*pixel, v[4];
+                for(int b=0; b < 4; ++b) v[b] = swap ? p[3-b] : p[b];
+                memcpy(&out[x], v, sizeof(float));
+                if (out[x] < lo) lo = out[x];
+                if (out[x] > hi) hi = out[x];
+            }
+        }
+
+        maxval = 65535;
+        float toSample = hi > lo ? 65535.f / (hi - lo) : 0.f;
+        for(unsigned int y=0; y < h; ++y) {
+            unsigned short *out = row(y);
+            for(unsigned int x=0; x < w; ++x)
+                out[x] = (unsigned short)((heights[size_t(y)*w + x] - lo)
+                                          * toSample + 0.5f);
+        }
+        delete[] heights;
+    }
+
+    delete[] raw;
+    fclose(fp);
+}
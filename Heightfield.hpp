@@ -0,0 +1,56 @@
+// single-channel height field for terrain elevation
+#ifndef Heightfield_hpp
+#define Heightfield_hpp
+
+class Heightfield {
+// public constants
+public:
+    enum { ROW_ALIGN = 16 };    // rows start on 16-sample (32 byte) boundary
+
+// private data
+private:
+    unsigned short *storage;    // allocated memory, including alignment pad
+    unsigned short *samples;    // aligned data in [y][x] order
+
+    // no copying
+    Heightfield(const Heightfield &);
+    Heightfield &operator=(const Heightfield &);
+
+    // allocate aligned storage for width x height samples
+    void allocate(unsigned int w, unsigned int h);
+
+// public data
+public:
+    unsigned int width, height; // size in samples
+    unsigned int stride;        // samples from one row to the next
+    unsigned int maxval;        // sample value for maximum height
+
+// public methods
+public:
+    // load from file
+    // accepts binary PNM grey (P5) or color (P6) with up to 16 bits per
+    // sample, using the first channel of color images, or PFM floating
+    // point (Pf or PF), which is scaled to fill the full 16-bit range
+    Heightfield(const char *filename);
+
+    // create flat height field given size and maximum value
+    Heightfield(unsigned int width, unsigned int height,
+                unsigned int maxval = 65535);
+
+    // destroy when done
+    ~Heightfield() { delete[] storage; }
+
+    // access a sample as Heightfield(x,y)
+    unsigned short operator()(unsigned int x, unsigned int y) const {
+        return samples[y*stride + x];
+    }
+    unsigned short &operator()(unsigned int x, unsigned int y) {
+        return samples[y*stride + x];
+    }
+
+    // start of a row, aligned to ROW_ALIGN samples
+    const unsigned short *row(unsigned int y) const { return samples + y*stride; }
+    unsigned short *row(unsigned int y) { return samples + y*stride; }
+};
+
+#endif
@@ -0,0 +1,182 @@
+// horizon maps for terrain self-shadowing
+
+#include "HorizonMap.hpp"
+#include "CacheFile.hpp"
+#include "HeightPyramid.hpp"
+#include "ThreadPool.hpp"
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+
+namespace {
+    // start of a cache file, followed by the horizons
+    // change CACHE_VERSION if this or the sweep changes
+    const uint32_t CACHE_VERSION = 1;
+    struct CacheHeader {
+        char magic[4];              // "HRZN"
+        uint32_t version;           // CACHE_VERSION
+        uint64_t key;               // from save
+        uint32_t width, height;     // vertices across and down
+        uint32_t directions;        // layers
+        uint32_t pad;               // unused, 0
+    };
+}
+
+//
+// sweep every direction
+//
+void HorizonMap::build(const HeightPyramid &pyramid, ThreadPool *pool,
+                       unsigned int directions)
+{
+    width = pyramid.width;
+    height = pyramid.height;
+    this->directions = directions;
+    horizons.resize(size_t(directions) * width * height);
+
+    const float *z = pyramid.vertexHeights();
+    unsigned int rowLength = width + 1;
+    float cellX = pyramid.mapSize.x / float(width);
+    float cellY = pyramid.mapSize.y / float(height);
+
+    for(unsigned int d=0; d < directions; ++d) {
+        // direction in squares, stepped one square at a time along
+        // whichever axis it moves further in
+        float angle = 6.2831853f * float(d) / float(directions);
+        float gx = cosf(angle) / cellX, gy = sinf(angle) / cellY;
+        bool alongX = fabsf(gx) >= fabsf(gy);
+        float major = alongX ? gx : gy, minor = alongX ? gy : gx;
+        unsigned int period = alongX ? width : height;
+        unsigned int lines = alongX ? height : width;
+
+        // walking back against the direction, so the points already on
+        // the hull are the ones ahead
+        bool backward = major > 0;
+        float stepMinor = -minor / fabsf(major);
+        float stepLength = alongX
+            ? sqrtf(cellX * cellX + stepMinor * cellY * stepMinor * cellY)
+            : sqrtf(cellY * cellY + stepMinor * cellX * stepMinor * cellX);
+        unsigned char *out = &horizons[size_t(d) * width * height];
+
+        // the lines are all the same shape, only shifted across, so
+        // where they cross each row or column of vertices can be worked
+        // out once: the vertex they are at or just past, relative to
+        // where they start, and how far past
+        std::vector<unsigned int> along(2 * period), across(2 * period);
+        std::vector<float> past(2 * period);
+        for(unsigned int j=0; j < 2 * period; ++j) {
+            along[j] = backward ? (period - j % period) % period : j % period;
+            float m = float(j) * stepMinor, m0 = floorf(m);
+            int v = int(m0) % int(lines);
+            across[j] = v < 0 ? v + lines : v;
+            past[j] = m - m0;
+        }
+
+        auto sweep = [&](unsigned int k0, unsigned int k1) {
+            // distance along the line and height of each hull point
+            std::vector<float> hullT(2 * period), hullZ(2 * period);
+            for(unsigned int k=k0; k < k1; ++k) {
+                unsigned int n = 0;
+                for(unsigned int j=0; j < 2 * period; ++j) {
+                    // interpolate between the vertices the line passes
+                    unsigned int u = along[j], v0 = k + across[j];
+                    if (v0 >= lines) v0 -= lines;
+                    unsigned int v1 = v0 + 1;
+                    float f = past[j];
+                    float h0 = alongX ? z[v0 * rowLength + u]
+                                      : z[u * rowLength + v0];
+                    float h1 = alongX ? z[v1 * rowLength + u]
+                                      : z[u * rowLength + v1];
+                    float h = h0 + f * (h1 - h0);
+                    float t = float(j) * stepLength;
+
+                    // drop the top of the hull while the point below it
+                    // is at least as high as seen from here
+                    while (n >= 2 && (hullZ[n-1] - h) * (t - hullT[n-2]) <=
+                                     (hullZ[n-2] - h) * (t - hullT[n-1]))
+                        --n;
+
+                    // the nearest vertex gets this horizon
+                    if (j >= period) {
+                        unsigned int v = f < 0.5f ? v0 : v1 % lines;
+                        unsigned int x = alongX ? u : v;
+                        unsigned int y = alongX ? v : u;
+                        float slope = n ? (hullZ[n-1] - h) / (t - hullT[n-1])
+                                        : 0;
+                        float sine = slope > 0
+                            ? slope / sqrtf(1 + slope * slope) : 0;
+                        out[y * width + x] = (unsigned char)(255 * sine + 0.5f);
+                    }
+                    hullT[n] = t;
+                    hullZ[n] = h;
+                    ++n;
+                }
+            }
+        };
+        if (pool)
+            pool->parallelFor(0, lines, sweep);
+        else
+            sweep(0, lines);
+    }
+}
+
+//
+// write header and horizons to cache file
+//
+bool HorizonMap::save(const char *name, uint64_t key) const
+{
+    CacheHeader head;
+    memset(&head, 0, sizeof(head));
+    memcpy(head.magic, "HRZN", 4);
+    head.version = CACHE_VERSION;
+    head.key = key;
+    head.width = width;
+    head.height = height;
+    head.directions = directions;
+
+    // written aside and swapped in, so other instances reading the old
+    // one never see it part way
+    CacheFile cache(name);
+    FILE *fp = cache.file();
+    if (!fp)
+        return false;
+    fwrite(&head, sizeof(head), 1, fp);
+    fwrite(&horizons[0], 1, horizons.size(), fp);
+    return cache.commit();
+}
+
+//
+// read cache file if it matches
+//
+bool HorizonMap::load(const char *name, uint64_t key, unsigned int directions)
+{
+    FILE *fp = fopen(name, "rb");
+    if (!fp)
+        return false;
+
+    // must be exactly the header and the horizons it describes
+    fseek(fp, 0, SEEK_END);
+    long size = ftell(fp);
+    fseek(fp, 0, SEEK_SET);
+    CacheHeader head;
+    bool found = fread(&head, sizeof(head), 1, fp) == 1 &&
+        memcmp(head.magic, "HRZN", 4) == 0 &&
+        head.version == CACHE_VERSION && head.key == key &&
+        head.directions == directions && head.width && head.height &&
+        double(size) == sizeof(head) +
+            double(directions) * head.width * head.height;
+    if (found) {
+        width = head.width;
+        height = head.height;
+        this->directions = directions;
+        horizons.resize(size_t(directions) * width * height);
+        found = fread(&horizons[0], 1, horizons.size(), fp) ==
+            horizons.size();
+    }
+    fclose(fp);
+
+    if (! found) {
+        width = height = this->directions = 0;
+        horizons.clear();
+    }
+    return found;
+}
@@ -0,0 +1,79 @@
+// horizon maps for terrain self-shadowing
+// CPU only, so it can be built on any thread
+//
+// For each of a set of compass directions, and each grid vertex, how
+// high the horizon is looking that way from that vertex, as the sine of
+// its elevation angle. A light is hidden from a point when it is below
+// the horizon in the light's direction, so the fragment shader can
+// shadow any light position with a couple of texture reads.
+//
+// Each direction is a sweep: the grid is cut into lines running that
+// way, and each line walked back from its far end, keeping the convex
+// hull of the heights passed so far. The hull's tangent from each new
+// point is that point's horizon, and points the new one hides are
+// dropped for good, so the work per vertex is constant on average,
+// however far away the horizon is. The terrain repeats, so every line is
+// walked around twice, with horizons kept from the second time only.
+//
+// Sweeping a large map takes a while, so Terrain saves the result in a
+// cache file next to the elevation image and reads it back on later
+// runs, like the TerrainMesh cache.
+#ifndef HorizonMap_hpp
+#define HorizonMap_hpp
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+class HeightPyramid;
+class ThreadPool;
+
+class HorizonMap {
+// public types
+public:
+    enum { DIRECTIONS = 16 };       // default number of directions
+
+// private data
+private:
+    // no copying
+    HorizonMap(const HorizonMap &);
+    HorizonMap &operator=(const HorizonMap &);
+
+// public data
+public:
+    unsigned int width, height;     // vertices across and down
+    unsigned int directions;        // evenly spaced, starting along +x
+
+    // horizon sine for vertex x, y toward direction d, from 0 (level or
+    // below) to 255 (straight up), at [(d * height + y) * width + x],
+    // ready to upload as a texture array with a layer per direction
+    std::vector<unsigned char> horizons;
+
+// public methods
+public:
+    // create empty
+    HorizonMap() : width(0), height(0), directions(0) {}
+
+    // sweep the vertex heights of pyramid in each direction, which is
+    // 2 pi d / directions radians counter-clockwise from +x for
+    // direction d. If pool is given, lines are done in parallel.
+    void build(const HeightPyramid &pyramid, ThreadPool *pool = 0,
+               unsigned int directions = DIRECTIONS);
+
+    // write to cache file name, marked with key, which should identify
+    // the heights, as TerrainMesh::cacheKey does
+    // returns false if the file can't be written
+    bool save(const char *name, uint64_t key) const;
+
+    // read cache file name, if it was saved with key and directions
+    // returns false, leaving this empty, if it is missing or doesn't match
+    bool load(const char *name, uint64_t key,
+              unsigned int directions = DIRECTIONS);
+
+    // horizon sine at vertex x, y toward direction d
+    float horizon(unsigned int d, unsigned int x, unsigned int y) const {
+        return horizons[(size_t(d) * height + y) * width + x] / 255.f;
+    }
+};
+
+#endif
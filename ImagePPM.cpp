@@ -6,6 +6,10 @@
 // after the header, there is one more white-space character, then
 // raw uncompressed byte data in [height][width][rgb] order
 
+// when possible, the file is memory mapped and image points directly at
+// the pixel data in the mapping, so no copy is made. Files that can't be
+// mapped (pipes, etc.) are read into an allocated array instead.
+
 // it would be cleaner to throw/catch errors, but they just print & exit
 
 #include "ImagePPM.hpp"
@@ -25,6 +29,82 @@
 // create from file
 //
 ImagePPM::ImagePPM(const char *name)
+{
+    // use pixels directly from mapped file, only reading on failure
+    if (! mapImage(name))
+        readImage(name);
+}
+
+//
+// skip white space and comments in a mapped header
+// return next non-space character position
+//
+static const unsigned char *skipSpace(const unsigned char *p,
+                                      const unsigned char *end)
+{
+    while (p < end) {
+        if (*p == '#')                          // comment to end of line
+            while (p < end && *p != '\n') ++p;
+        else if (*p == ' ' || *p == '\t' || *p == '\r' || *p == '\n')
+            ++p;
+        else
+            break;
+    }
+    return p;
+}
+
+//
+// read one decimal header value from a mapped header
+// return position after the number, or NULL if there isn't one
+//
+static const unsigned char *readValue(const unsigned char *p,
+                                      const unsigned char *end,
+                                      unsigned int &value)
+{
+    p = skipSpace(p, end);
+    if (p == end || *p < '0' || *p > '9')
+        return 0;
+
+    for(value = 0; p < end && *p >= '0' && *p <= '9'; ++p)
+        value = value*10 + (*p - '0');
+    return p;
+}
+
+//
+// map file and parse header directly from mapped bytes
+//
+bool ImagePPM::mapImage(const char *name)
+{
+    if (! file.map(name))
+        return false;
+
+    const unsigned char *p = file.data(), *end = p + file.size();
+    unsigned int maxval;
+    if (file.size() < 2 || p[0] != 'P' || p[1] != '6' ||
+        !(p = readValue(p+2, end, width)) ||
+        !(p = readValue(p, end, height)) ||
+        !(p = readValue(p, end, maxval)) ||
+        maxval > 255 || p == end) {
+        // leave unusual files to the stdio reader to report
+        file.unmap();
+        return false;
+    }
+    ++p;                        // skip final white space before data
+
+    // make sure all of the data is actually there
+    if (size_t(end - p) / sizeof(color_type) < size_t(width) * height) {
+        file.unmap();
+        return false;
+    }
+
+    image = (color_type*)(p);
+    return true;
+}
+
+//
+// read image with stdio
+//
+void ImagePPM::readImage(const char *name)
 {
     // open file
     FILE *fp = fopen(name,"rb");
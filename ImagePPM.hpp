@@ -2,6 +2,7 @@
 #ifndef ImagePPM_hpp
 #define ImagePPM_hpp
 
+#include "MappedFile.hpp"
 #include <glm/glm.hpp>
 
 struct ImagePPM {
@@ -10,16 +11,30 @@ struct ImagePPM {
     unsigned int width, height; // image size
     color_type *image;          // image data in [y][x][color] order
 
+private:
+    MappedFile file;            // if mapped, image points into this
+
+    // parse header and point image into mapped file
+    // return false if mapped data isn't a complete 8-bit P6 file
+    bool mapImage(const char *filename);
+
+    // read header and image data with stdio, for files that can't be mapped
+    void readImage(const char *filename);
+
 // public methods
 public:
     // create from file
+    // maps the file and uses its pixels in place if possible
     ImagePPM(const char *filename);
 
     // create blank image given size
     ImagePPM(unsigned int width, unsigned int height);
 
     // destroy when done
-    ~ImagePPM() { delete[] image; }
+    ~ImagePPM() { if (! file.mapped()) delete[] image; }
+
+    // true if image data is a view into the mapped file
+    bool mapped() const { return file.mapped(); }
 
     // access a pixel as ImagePPM(x,y)
     color_type operator()(unsigned int tx, unsigned int ty) const {
@@ -29,6 +44,9 @@ public:
         return image[ty*width + tx];
     }
 
+    // if mapped, read the file data now rather than at first use
+    void prefetch() const { file.prefetch(); }
+
     // write image as a PPM
     void write(const char *filename) const;
 
@@ -5,12 +5,14 @@
 #include "Scene.hpp"
 #include "Terrain.hpp"
 #include "Marker.hpp"
+#include "FrameCapture.hpp"
 
 // using core modern OpenGL
 #include <GL/glew.h>
 #include <GLFW/glfw3.h>
 
 #include <math.h>
+#include <stdio.h>
 
 #ifndef F_PI
 #define F_PI 3.1415926f
@@ -20,8 +22,13 @@
 // called when a mouse button is pressed. 
 // Remember where we were, and what mouse button it was.
 //
-void Input::mousePress(GLFWwindow *win, int b, int action)
+void Input::mousePress(GLFWwindow *win, int b, int action,
+                       AppContext *appctx)
 {
+    // pick while the cursor is still where the user clicked
+    if (action == GLFW_PRESS && b == GLFW_MOUSE_BUTTON_RIGHT)
+        pick(win, appctx);
+
     if (action == GLFW_PRESS) {
         // hide cursor, record button
         glfwSetInputMode(win, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
@@ -34,6 +41,46 @@ void Input::mousePress(GLFWwindow *win, int b, int action)
     }
 }
 
+//
+// cast a ray from the eye through the cursor into the terrain, and
+// print where it hits, and whether the light can see that point
+//
+void Input::pick(GLFWwindow *win, AppContext *appctx)
+{
+    // cursor position is in window coordinates, not framebuffer pixels
+    double x, y;
+    int width, height;
+    glfwGetCursorPos(win, &x, &y);
+    glfwGetWindowSize(win, &width, &height);
+    if (width <= 0 || height <= 0) return;
+
+    // near and far plane points under the cursor back to world space
+    const Scene::ShaderData &sdata = appctx->scene->sdata;
+    glm::mat4 toWorld = sdata.viewInverse * sdata.projectionInverse;
+    float nx = float(2 * x / width - 1), ny = float(1 - 2 * y / height);
+    glm::vec4 nearPt = toWorld * glm::vec4(nx, ny, -1, 1);
+    glm::vec4 farPt = toWorld * glm::vec4(nx, ny, 1, 1);
+
+    HeightPyramid::Ray ray;
+    ray.origin = glm::vec3(nearPt.x, nearPt.y, nearPt.z) / nearPt.w;
+    ray.direction = glm::vec3(farPt.x, farPt.y, farPt.z) / farPt.w
+        - ray.origin;
+    ray.minT = 0;
+    ray.maxT = 1;
+
+    const HeightPyramid &terrain = appctx->terrain->heightPyramid();
+    HeightPyramid::Hit hit;
+    if (! terrain.cast(ray, hit)) {
+        printf("pick: no terrain under cursor\n");
+        return;
+    }
+    printf("pick: square %u,%u at (%.2f, %.2f, %.2f), "
+           "normal (%.3f, %.3f, %.3f), %s\n", hit.cellX, hit.cellY,
+           hit.point.x, hit.point.y, hit.point.z,
+           hit.normal.x, hit.normal.y, hit.normal.z,
+           terrain.occluded(hit.point, sdata.lightpos) ? "in shadow" : "lit");
+}
+
 //
 // called when the mouse moves
 // use difference between oldX,oldY and x,y to define a rotation
@@ -97,11 +144,22 @@ void Input::keyPress(GLFWwindow *win, int key, AppContext *appctx)
         redraw = true;          // need to redraw
         break;
 
+    case 'T':                   // reload textures
+        appctx->terrain->updateTextures();
+        break;
+
     case 'F':                   // toggle fog on or off
         appctx->scene->sdata.fog = 1 - appctx->scene->sdata.fog;
         redraw = true;          // need to redraw
         break;
 
+    case 'C':                   // toggle frame capture on or off
+        if (appctx->capture->recording())
+            appctx->capture->stop();
+        else
+            appctx->capture->start();
+        break;
+
     case GLFW_KEY_ESCAPE:                    // Escape: exit
         glfwSetWindowShouldClose(win, true);
         break;
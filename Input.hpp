@@ -15,6 +15,11 @@ private:
     double updateTime;          // time (in seconds) of last update
     float panRate, tiltRate;    // for key change, orbiting rate in radians/sec
 
+// private methods
+private:
+    // report the terrain point under the cursor
+    void pick(GLFWwindow *win, AppContext *ctx);
+
 // public data
 public:
     bool redraw;                // true if we need to redraw
@@ -26,7 +31,8 @@ public:
               panRate(0), tiltRate(0), redraw(true) {}
 
     // handle mouse press / release
-    void mousePress(GLFWwindow *win, int button, int action);
+    // left button orbits the view, right button picks a terrain point
+    void mousePress(GLFWwindow *win, int button, int action, AppContext *ctx);
 
     // handle mouse motion
     void mouseMove(GLFWwindow *win, Scene *scene, double x, double y);
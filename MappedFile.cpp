@@ -0,0 +1,131 @@
+// memory mapped file access
+// maps with mmap on unix-like systems or MapViewOfFile on windows
+
+#include "MappedFile.hpp"
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+//
+// create without mapping anything
+//
+MappedFile::MappedFile() : base(0), length(0)
+{
+#ifdef _WIN32
+    mapHandle = 0;
+#endif
+}
+
+#ifdef _WIN32
+//
+// map using windows file mapping objects
+//
+bool MappedFile::map(const char *name, bool sequential)
+{
+    unmap();
+
+    HANDLE file = CreateFileA(name, GENERIC_READ, FILE_SHARE_READ, 0,
+                              OPEN_EXISTING,
+                              sequential ? FILE_FLAG_SEQUENTIAL_SCAN
+                                         : FILE_ATTRIBUTE_NORMAL, 0);
+    if (file == INVALID_HANDLE_VALUE)
+        return false;
+
+    // only regular files with some data in them can be mapped
+    LARGE_INTEGER fileSize;
+    if (GetFileType(file) != FILE_TYPE_DISK ||
+        !GetFileSizeEx(file, &fileSize) || fileSize.QuadPart == 0) {
+        CloseHandle(file);
+        return false;
+    }
+
+    // copy-on-write mapping of the whole file
+    mapHandle = CreateFileMappingA(file, 0, PAGE_WRITECOPY, 0, 0, 0);
+    CloseHandle(file);          // mapping keeps its own reference
+    if (!mapHandle)
+        return false;
+
+    base = (unsigned char*)MapViewOfFile(mapHandle, FILE_MAP_COPY, 0, 0, 0);
+    if (!base) {
+        CloseHandle(mapHandle);
+        mapHandle = 0;
+        return false;
+    }
+    length = size_t(fileSize.QuadPart);
+    return true;
+}
+
+//
+// release windows mapping
+//
+void MappedFile::unmap()
+{
+    if (base) UnmapViewOfFile(base);
+    if (mapHandle) CloseHandle(mapHandle);
+    base = 0;
+    mapHandle = 0;
+    length = 0;
+}
+
+#else
+//
+// map using mmap
+//
+bool MappedFile::map(const char *name, bool sequential)
+{
+    unmap();
+
+    int fd = open(name, O_RDONLY);
+    if (fd < 0)
+        return false;
+
+    // only regular files with some data in them can be mapped
+    struct stat info;
+    if (fstat(fd, &info) != 0 || !S_ISREG(info.st_mode) || info.st_size == 0) {
+        close(fd);
+        return false;
+    }
+
+    // private mapping: writes go to copy-on-write pages, never the file
+    void *addr = mmap(0, size_t(info.st_size), PROT_READ | PROT_WRITE,
+                      MAP_PRIVATE, fd, 0);
+    close(fd);                  // mapping keeps its own reference
+    if (addr == MAP_FAILED)
+        return false;
+
+    // tell the kernel to read ahead aggressively
+    if (sequential)
+        madvise(addr, size_t(info.st_size), MADV_SEQUENTIAL);
+
+    base = (unsigned char*)addr;
+    length = size_t(info.st_size);
+    return true;
+}
+
+//
+// release mmap mapping
+//
+void MappedFile::unmap()
+{
+    if (base) munmap(base, length);
+    base = 0;
+    length = 0;
+}
+#endif
+
+//
+// touch one byte per page to fault the whole file into memory
+//
+void MappedFile::prefetch() const
+{
+    volatile unsigned char sum = 0;
+    for(size_t i=0; i < length; i += 4096)
+        sum += base[i];
+}
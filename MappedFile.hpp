@@ -0,0 +1,46 @@
+// read-only memory mapping of an entire file
+#ifndef MappedFile_hpp
+#define MappedFile_hpp
+
+#include <stddef.h>
+
+class MappedFile {
+// private data
+private:
+    unsigned char *base;        // start of mapped file, or NULL if not mapped
+    size_t length;              // size of mapping in bytes
+#ifdef _WIN32
+    void *mapHandle;            // windows file mapping object
+#endif
+
+    // mappings cannot be shared, so no copying
+    MappedFile(const MappedFile &);
+    MappedFile &operator=(const MappedFile &);
+
+// public methods
+public:
+    // create without mapping anything
+    MappedFile();
+
+    // unmap when done
+    ~MappedFile() { unmap(); }
+
+    // map a file, returning false if it can't be mapped (missing,
+    // empty, pipe or other unmappable stream).  Pages are copy-on-write,
+    // so the contents can be modified in memory without changing the file.
+    // Set sequential if data will be read mostly front to back.
+    bool map(const char *filename, bool sequential = true);
+
+    // read the mapped pages now, so later access won't wait for the disk
+    void prefetch() const;
+
+    // release mapping (if any)
+    void unmap();
+
+    // mapped data and size
+    bool mapped() const { return base != 0; }
+    unsigned char *data() const { return base; }
+    size_t size() const { return length; }
+};
+
+#endif
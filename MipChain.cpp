@@ -0,0 +1,96 @@
+// read a baked texture mipmap chain and upload it to OpenGL
+
+#include "MipChain.hpp"
+#include "BlockCompress.hpp"
+#include <string.h>
+
+// OpenGL, just for loadTexture
+#include <GL/glew.h>
+#include <GLFW/glfw3.h>
+
+//
+// map file and check that every level is really there
+//
+bool MipChain::load(const char *name)
+{
+    header = 0;
+    level = 0;
+    if (! file.map(name))
+        return false;
+
+    const Header *head = (const Header*)file.data();
+    if (file.size() < sizeof(Header) ||
+        memcmp(head->magic, "MIPC", 4) != 0 || head->version != VERSION ||
+        head->format > BC5 || head->levels == 0 ||
+        (file.size() - sizeof(Header)) / sizeof(Level) < head->levels) {
+        file.unmap();
+        return false;
+    }
+
+    const Level *levels = (const Level*)(head + 1);
+    for(unsigned int l=0; l < head->levels; ++l) {
+        if (levels[l].size != levelBytes(Format(head->format),
+                                         levels[l].width, levels[l].height) ||
+            levels[l].offset > file.size() ||
+            levels[l].size > file.size() - levels[l].offset) {
+            file.unmap();
+            return false;
+        }
+    }
+
+    header = head;
+    level = levels;
+    return true;
+}
+
+//
+// upload all levels
+//
+void MipChain::loadTexture(unsigned int textureID) const
+{
+    glBindTexture(GL_TEXTURE_2D, textureID);
+
+    // small levels have rows that aren't a multiple of 4 bytes
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    for(unsigned int l=0; l < levels(); ++l) {
+        unsigned int w = level[l].width, h = level[l].height;
+        switch (format()) {
+        case RGB8:
+            glTexImage2D(GL_TEXTURE_2D, l, GL_RGB, w, h, 0,
+                         GL_RGB, GL_UNSIGNED_BYTE, data(l));
+            break;
+
+        case BC1:
+            // S3TC is an extension, so decode here if it's missing
+            if (GLEW_EXT_texture_compression_s3tc)
+                glCompressedTexImage2D(GL_TEXTURE_2D, l,
+                                       GL_COMPRESSED_RGB_S3TC_DXT1_EXT, w, h, 0,
+                                       GLsizei(level[l].size), data(l));
+            else {
+                unsigned char *rgb = new unsigned char[size_t(w) * h * 3];
+                decodeBC1(data(l), w, h, rgb);
+                glTexImage2D(GL_TEXTURE_2D, l, GL_RGB, w, h, 0,
+                             GL_RGB, GL_UNSIGNED_BYTE, rgb);
+                delete[] rgb;
+            }
+            break;
+
+        case BC4:
+            glCompressedTexImage2D(GL_TEXTURE_2D, l, GL_COMPRESSED_RED_RGTC1,
+                                   w, h, 0, GLsizei(level[l].size), data(l));
+            break;
+
+        case BC5:
+            glCompressedTexImage2D(GL_TEXTURE_2D, l, GL_COMPRESSED_RG_RGTC2,
+                                   w, h, 0, GLsizei(level[l].size), data(l));
+            break;
+        }
+    }
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, 0);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, levels()-1);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER,
+                    GL_LINEAR_MIPMAP_LINEAR);
+    glBindTexture(GL_TEXTURE_2D, 0);
+}
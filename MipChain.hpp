@@ -0,0 +1,84 @@
+// pre-built chain of texture mipmap levels
+//
+// File layout, all values in native byte order:
+//   MipChain::Header
+//   MipChain::Level for each level, largest first
+//   level data, each starting on a 16-byte boundary
+// made offline by the BakeMips tool so textures can be uploaded with all
+// levels in place, rather than making the driver generate them
+#ifndef MipChain_hpp
+#define MipChain_hpp
+
+#include "MappedFile.hpp"
+#include <stdint.h>
+
+class MipChain {
+// public types
+public:
+    enum { VERSION = 1 };
+
+    // texel format of level data
+    enum Format {
+        RGB8,                   // 8-bit r,g,b in [y][x][color] order
+        BC1,                    // rgb in 8-byte 4x4 blocks, for color
+        BC4,                    // red in 8-byte 4x4 blocks, for gloss
+        BC5                     // red & green in 16-byte 4x4 blocks,
+                                // for normals with z rebuilt in the shader
+    };
+
+    struct Header {
+        char magic[4];          // "MIPC"
+        uint32_t version;       // MipChain::VERSION
+        uint32_t format;        // MipChain::Format for all levels
+        uint32_t levels;        // number of levels that follow
+    };
+
+    struct Level {
+        uint32_t width, height; // level size in texels
+        uint64_t offset;        // file position of level data
+        uint64_t size;          // bytes of level data
+    };
+
+// private data
+private:
+    MappedFile file;            // level data is used directly from here
+    const Header *header;       // header in mapped file
+    const Level *level;         // level table in mapped file
+
+// public methods
+public:
+    // bytes of data for one level of a given format
+    static uint64_t levelBytes(Format format,
+                               unsigned int width, unsigned int height) {
+        uint64_t blocks = uint64_t((width + 3) / 4) * ((height + 3) / 4);
+        switch (format) {
+        case BC1: case BC4: return blocks * 8;
+        case BC5: return blocks * 16;
+        default: return uint64_t(width) * height * 3;
+        }
+    }
+
+    // create empty
+    MipChain() : header(0), level(0) {}
+
+    // map a baked file, return false if it's missing or not valid
+    bool load(const char *filename);
+
+    // number of levels and info about each
+    unsigned int levels() const { return header ? header->levels : 0; }
+    Format format() const { return Format(header->format); }
+    const Level &info(unsigned int l) const { return level[l]; }
+
+    // level data
+    const unsigned char *data(unsigned int l) const {
+        return file.data() + level[l].offset;
+    }
+
+    // read all levels now, rather than at first use
+    void prefetch() const { file.prefetch(); }
+
+    // load all levels into an OpenGL texture
+    void loadTexture(unsigned int textureID) const;
+};
+
+#endif
@@ -0,0 +1,192 @@
+// ambient occlusion baked from the terrain heights
+
+#include "OcclusionMap.hpp"
+#include "CacheFile.hpp"
+#include "HeightPyramid.hpp"
+#include "ThreadPool.hpp"
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+
+namespace {
+    // start of a cache file, followed by the visibility
+    // change CACHE_VERSION if this or the bake changes
+    const uint32_t CACHE_VERSION = 1;
+    struct CacheHeader {
+        char magic[4];              // "OCCL"
+        uint32_t version;           // CACHE_VERSION
+        uint64_t key;               // from save
+        uint32_t width, height;     // vertices across and down
+        uint32_t directions;        // looked in
+        float radius;               // asked for
+    };
+
+    // one place to look at: grid offset from the vertex, and one over
+    // its distance in world units
+    struct Sample {
+        int dx, dy;
+        int offset;             // in the vertex array, if it doesn't wrap
+        float invDistance;
+    };
+}
+
+//
+// look around every vertex
+//
+void OcclusionMap::build(const HeightPyramid &pyramid, float radius,
+                         ThreadPool *pool, unsigned int directions)
+{
+    width = pyramid.width;
+    height = pyramid.height;
+    this->directions = directions;
+    this->radius = radius;
+    visibility.resize(size_t(width) * height);
+
+    const float *z = pyramid.vertexHeights();
+    unsigned int rowLength = width + 1;
+    float cellX = pyramid.mapSize.x / float(width);
+    float cellY = pyramid.mapSize.y / float(height);
+    radius = std::min(radius, 0.5f * std::min(pyramid.mapSize.x,
+                                              pyramid.mapSize.y));
+
+    // the same samples for every vertex: out along each direction at
+    // distances growing by about 40% a step, skipping any that land
+    // on the same vertex as the last
+    std::vector<Sample> samples;
+    std::vector<unsigned int> firstSample(directions + 1);
+    float cell = std::min(cellX, cellY);
+    for(unsigned int d=0; d < directions; ++d) {
+        firstSample[d] = unsigned(samples.size());
+        float angle = 6.2831853f * float(d) / float(directions);
+        float cx = cosf(angle), cy = sinf(angle);
+        for(float r = cell; r <= radius; r = std::max(r + cell, 1.4f * r)) {
+            Sample s;
+            s.dx = int(floorf(r * cx / cellX + 0.5f));
+            s.dy = int(floorf(r * cy / cellY + 0.5f));
+            if (s.dx == 0 && s.dy == 0) continue;
+            if (samples.size() > firstSample[d] &&
+                s.dx == samples.back().dx && s.dy == samples.back().dy)
+                continue;
+            s.offset = s.dy * int(rowLength) + s.dx;
+            float wx = float(s.dx) * cellX, wy = float(s.dy) * cellY;
+            s.invDistance = 1 / sqrtf(wx * wx + wy * wy);
+            samples.push_back(s);
+        }
+    }
+    firstSample[directions] = unsigned(samples.size());
+
+    // vertices at least this far from every edge never wrap
+    int reach = 0;
+    for(size_t i=0; i < samples.size(); ++i)
+        reach = std::max(reach, std::max(abs(samples[i].dx),
+                                         abs(samples[i].dy)));
+
+    auto bake = [&](unsigned int y0, unsigned int y1) {
+        for(unsigned int y=y0; y < y1; ++y) {
+            bool inY = int(y) >= reach && int(y) + reach < int(height);
+            for(unsigned int x=0; x < width; ++x) {
+                const float *here = z + y * rowLength + x;
+                bool inside = inY && int(x) >= reach &&
+                              int(x) + reach < int(width);
+                float seen = 0;
+                for(unsigned int d=0; d < directions; ++d) {
+                    // steepest rise toward any sample
+                    float slope = 0;
+                    for(unsigned int i=firstSample[d]; i < firstSample[d+1];
+                        ++i) {
+                        float rise;
+                        if (inside)
+                            rise = here[samples[i].offset] - *here;
+                        else {
+                            // wrap around
+                            int sx = int(x) + samples[i].dx;
+                            int sy = int(y) + samples[i].dy;
+                            if (sx < 0) sx += width;
+                            else if (sx >= int(width)) sx -= width;
+                            if (sy < 0) sy += height;
+                            else if (sy >= int(height)) sy -= height;
+                            rise = z[sy * rowLength + sx] - *here;
+                        }
+                        slope = std::max(slope, rise * samples[i].invDistance);
+                    }
+
+                    // sin^2 of the horizon angle is hidden
+                    seen += 1 / (1 + slope * slope);
+                }
+                visibility[y * width + x] =
+                    (unsigned char)(255 * seen / float(directions) + 0.5f);
+            }
+        }
+    };
+    if (pool)
+        pool->parallelFor(0, height, bake);
+    else
+        bake(0, height);
+}
+
+//
+// write header and visibility to cache file
+//
+bool OcclusionMap::save(const char *name, uint64_t key) const
+{
+    CacheHeader head;
+    memset(&head, 0, sizeof(head));
+    memcpy(head.magic, "OCCL", 4);
+    head.version = CACHE_VERSION;
+    head.key = key;
+    head.width = width;
+    head.height = height;
+    head.directions = directions;
+    head.radius = radius;
+
+    // never in place: another instance may be reading it
+    CacheFile cache(name);
+    FILE *fp = cache.file();
+    if (!fp)
+        return false;
+    fwrite(&head, sizeof(head), 1, fp);
+    fwrite(&visibility[0], 1, visibility.size(), fp);
+    return cache.commit();
+}
+
+//
+// read cache file if it matches
+//
+bool OcclusionMap::load(const char *name, uint64_t key, float radius,
+                        unsigned int directions)
+{
+    FILE *fp = fopen(name, "rb");
+    if (!fp)
+        return false;
+
+    // must be exactly the header and the visibility it describes
+    fseek(fp, 0, SEEK_END);
+    long size = ftell(fp);
+    fseek(fp, 0, SEEK_SET);
+    CacheHeader head;
+    bool found = fread(&head, sizeof(head), 1, fp) == 1 &&
+        memcmp(head.magic, "OCCL", 4) == 0 &&
+        head.version == CACHE_VERSION && head.key == key &&
+        head.directions == directions && head.radius == radius &&
+        head.width && head.height &&
+        double(size) == sizeof(head) + double(head.width) * head.height;
+    if (found) {
+        width = head.width;
+        height = head.height;
+        this->directions = directions;
+        this->radius = radius;
+        visibility.resize(size_t(width) * height);
+        found = fread(&visibility[0], 1, visibility.size(), fp) ==
+            visibility.size();
+    }
+    fclose(fp);
+
+    if (! found) {
+        width = height = this->directions = 0;
+        this->radius = 0;
+        visibility.clear();
+    }
+    return found;
+}
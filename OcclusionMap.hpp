@@ -0,0 +1,74 @@
+// ambient occlusion baked from the terrain heights
+// CPU only, so it can be built on any thread
+//
+// For each grid vertex, how much of an evenly lit sky it sees, found
+// from the horizon: in each of a set of directions, the highest
+// elevation angle to any vertex within a radius. Those are sampled at
+// distances growing from one grid square out to the radius, so nearby
+// bumps are all seen, while far ground, which hides less of the sky,
+// costs only a few samples. Under a horizon at angle h all around, a
+// level surface gets 1 - sin^2 h of the sky's light, so the result is
+// that averaged over the directions.
+//
+// Baking takes a while on a large terrain, so it can be saved to a cache
+// file and read back on later runs, like the horizons.
+#ifndef OcclusionMap_hpp
+#define OcclusionMap_hpp
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+class HeightPyramid;
+class ThreadPool;
+
+class OcclusionMap {
+// public types
+public:
+    enum { DIRECTIONS = 16 };       // default number of directions
+
+// private data
+private:
+    // no copying
+    OcclusionMap(const OcclusionMap &);
+    OcclusionMap &operator=(const OcclusionMap &);
+
+// public data
+public:
+    unsigned int width, height;     // vertices across and down
+    unsigned int directions;        // looked in, once built
+    float radius;                   // world units asked for, once built
+
+    // fraction of the sky seen from vertex x, y, from 0 (none) to 255
+    // (all), at [y * width + x], ready to upload as a texture
+    std::vector<unsigned char> visibility;
+
+// public methods
+public:
+    // create empty
+    OcclusionMap() : width(0), height(0), directions(0), radius(0) {}
+
+    // bake from the vertex heights of pyramid, looking up to radius
+    // world units away, limited to half the terrain size since it
+    // repeats. If pool is given, rows are done in parallel.
+    void build(const HeightPyramid &pyramid, float radius,
+               ThreadPool *pool = 0, unsigned int directions = DIRECTIONS);
+
+    // write to cache file name, marked with key, which should identify
+    // the heights, as TerrainMesh::cacheKey does
+    // returns false if the file can't be written
+    bool save(const char *name, uint64_t key) const;
+
+    // read cache file name, if it was saved with key, radius and
+    // directions
+    // returns false, leaving this empty, if it is missing or doesn't match
+    bool load(const char *name, uint64_t key, float radius,
+              unsigned int directions = DIRECTIONS);
+
+    // fraction of the sky seen from vertex x, y
+    float visible(unsigned int x, unsigned int y) const {
+        return visibility[size_t(y) * width + x] / 255.f;
+    }
+};
+
+#endif
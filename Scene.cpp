@@ -22,10 +22,29 @@
 //
 // create and initialize view
 //
-Scene::Scene(GLFWwindow *win, Marker &lightmarker) : 
-    viewSph(glm::vec3(0.f, -80.5f, 500.f)),
-    lightSph(glm::vec3(F_PI/2.f, F_PI/4.f, 300.f)) // Light position is in radians.
+Scene::Scene(GLFWwindow *win, Marker &lightmarker)
 {
+    int w, h;
+    glfwGetFramebufferSize(win, &w, &h);
+    init(w, h, lightmarker);
+}
+
+//
+// create and initialize view for offscreen rendering
+//
+Scene::Scene(int w, int h, Marker &lightmarker)
+{
+    init(w, h, lightmarker);
+}
+
+//
+// initial view, shared by both constructors
+//
+void Scene::init(int w, int h, Marker &lightmarker)
+{
+    viewSph = glm::vec3(0.f, -80.5f, 500.f);
+    lightSph = glm::vec3(F_PI/2.f, F_PI/4.f, 300.f); // Light position is in radians.
+
     // create uniform buffer objects
     glGenBuffers(NUM_BUFFERS, bufferIDs);
     glBindBuffer(GL_UNIFORM_BUFFER, bufferIDs[UNIFORM_BUFFER]);
@@ -34,7 +53,7 @@ Scene::Scene(GLFWwindow *win, Marker &lightmarker) :
                      bufferIDs[UNIFORM_BUFFER]);
 
     // initialize scene data
-    viewport(win);
+    viewport(w, h);
     view();
     light(lightmarker);
     sdata.fog = 0;                    // fog off
@@ -62,7 +81,18 @@ void Scene::view()
 void Scene::viewport(GLFWwindow *win)
 {
     // get window dimensions
-    glfwGetFramebufferSize(win, &width, &height);
+    int w, h;
+    glfwGetFramebufferSize(win, &w, &h);
+    viewport(w, h);
+}
+
+//
+// adjust projection for a new image size
+//
+void Scene::viewport(int w, int h)
+{
+    width = w;
+    height = h;
 
     // this viewport makes a 1 to 1 mapping of physical pixels to GL
     // "logical" pixels
@@ -15,6 +15,11 @@ private:
     enum {UNIFORM_BUFFER, NUM_BUFFERS};
     unsigned int bufferIDs[NUM_BUFFERS];
 
+// private methods
+private:
+    // set up uniform buffer and initial view for a given size
+    void init(int width, int height, Marker &lightMarker);
+
 // public data
 public:
     struct ShaderData {
@@ -35,8 +40,12 @@ public:
     // create with initial window size and orbit location
     Scene(GLFWwindow *win, Marker &lightMarker);
 
+    // create for an offscreen image of a given size
+    Scene(int width, int height, Marker &lightMarker);
+
     // set up new window viewport and projection
     void viewport(GLFWwindow *win);
+    void viewport(int width, int height);
 
     // set view using orbitAngle
     void view();
@@ -1,44 +1,71 @@
 // functions to load shaders
 
 #include "Shader.hpp"
+#include "CacheFile.hpp"
+#include "Hash.hpp"
 
 // using core modern OpenGL
 #include <GL/glew.h>
 #include <GLFW/glfw3.h>
 
+#include <stdint.h>
 #include <stdio.h>
+#include <string.h>
+#include <chrono>
+#include <string>
 
 #ifdef _WIN32
 // don't complain if we use standard IO functions instead of windows-only
 #pragma warning( disable: 4996 )
 #endif
 
+namespace {
+    // start of a program binary cache file, followed by the binary
+    // change CACHE_VERSION if this changes
+    const uint32_t CACHE_VERSION = 1;
+    struct CacheHeader {
+        char magic[4];              // "GLPB"
+        uint32_t version;           // CACHE_VERSION
+        uint64_t key;               // hash of sources and driver
+        uint64_t checksum;          // hash of binary
+        uint32_t format;            // from glGetProgramBinary
+        uint32_t length;            // bytes of binary
+    };
+}
+
 //
-// load and compile a single shader
-// id is an existing shader object
-// shader type is defined by shader object type
+// read whole shader file
+// returns new[] array the caller deletes, or null if it can't be read
 //
-bool loadShader(unsigned int id, const char *file)
+static GLchar *readShader(const char *file, GLint &size)
 {
     // open file
     FILE *f = fopen(file, "rb");
     if (! f) {
         fprintf(stderr, "unable to open shader %s\n", file);
-        return false;           // error
+        return 0;               // error
     }
 
     // get file size
     // seek to end of file is more cross-platform than fstat
     fseek(f, 0, SEEK_END);
-    int size = ftell(f);
+    size = ftell(f);
     fseek(f, 0, SEEK_SET);
 
-    // read entire file and compile as shader
+    // read entire file
     GLchar *shader = new GLchar[size];
     fread(shader, 1, size, f);
-    glShaderSource(id, 1, (const GLchar**)(&shader), &size);
+    fclose(f);
+    return shader;
+}
+
+//
+// compile source into shader object id, reporting any errors
+//
+static bool compileShader(unsigned int id, const GLchar *shader, GLint size)
+{
+    glShaderSource(id, 1, &shader, &size);
     glCompileShader(id);
-    delete[] shader;
 
     // report compile errors
     GLint success;
@@ -62,6 +89,105 @@ bool loadShader(unsigned int id, const char *file)
     return true;                // success
 }
 
+//
+// load and compile a single shader
+// id is an existing shader object
+// shader type is defined by shader object type
+//
+bool loadShader(unsigned int id, const char *file)
+{
+    GLint size;
+    GLchar *shader = readShader(file, size);
+    if (! shader)
+        return false;           // error
+    bool success = compileShader(id, shader, size);
+    delete[] shader;
+    return success;
+}
+
+//
+// true if the driver can save and reload linked programs
+//
+static bool binarySupported()
+{
+    if (! GLEW_ARB_get_program_binary)
+        return false;
+    GLint formats = 0;
+    glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+    return formats > 0;
+}
+
+//
+// link progID from cache file name if it was saved for key
+// returns false if there is no such file, or the driver won't take it
+//
+static bool loadBinary(unsigned int progID, const char *name, uint64_t key)
+{
+    FILE *fp = fopen(name, "rb");
+    if (! fp)
+        return false;
+
+    CacheHeader head;
+    char *binary = 0;
+    bool found = fread(&head, sizeof(head), 1, fp) == 1 &&
+        memcmp(head.magic, "GLPB", 4) == 0 &&
+        head.version == CACHE_VERSION && head.key == key;
+    if (found) {
+        binary = new char[head.length];
+        found = fread(binary, 1, head.length, fp) == head.length &&
+            hashBytes(binary, head.length) == head.checksum;
+    }
+    fclose(fp);
+
+    // the driver can still turn it down, say if it was updated without
+    // changing its version string
+    bool linked = false;
+    if (found) {
+        glProgramBinary(progID, head.format, binary, head.length);
+        GLint success;
+        glGetProgramiv(progID, GL_LINK_STATUS, &success);
+        linked = success != 0;
+        if (! linked)
+            fprintf(stderr, "shader cache %s rejected, recompiling\n", name);
+    }
+    delete[] binary;
+    return linked;
+}
+
+//
+// save linked progID to cache file name, under key
+//
+static void saveBinary(unsigned int progID, const char *name, uint64_t key)
+{
+    GLint length = 0;
+    glGetProgramiv(progID, GL_PROGRAM_BINARY_LENGTH, &length);
+    if (length <= 0)
+        return;
+
+    CacheHeader head;
+    memset(&head, 0, sizeof(head));
+    memcpy(head.magic, "GLPB", 4);
+    head.version = CACHE_VERSION;
+    head.key = key;
+    char *binary = new char[length];
+    GLenum format;
+    glGetProgramBinary(progID, length, 0, &format, binary);
+    head.format = format;
+    head.length = length;
+    head.checksum = hashBytes(binary, length);
+
+    // swapped in whole, in case another instance is loading it
+    CacheFile cache(name);
+    bool written = false;
+    if (FILE *fp = cache.file()) {
+        fwrite(&head, sizeof(head), 1, fp);
+        fwrite(binary, 1, length, fp);
+        written = cache.commit();
+    }
+    if (! written)
+        fprintf(stderr, "warning: can't write shader cache %s\n", name);
+    delete[] binary;
+}
 
 //
 // load a set of shaders
@@ -70,36 +196,98 @@ bool loadShaders(unsigned int progID,
                  unsigned int numComponents,
                  ShaderInfo *components)
 {
-    // load shader code
-    for(unsigned int i=0; i<numComponents; ++i) {
-        if (! loadShader(components[i].id, components[i].file))
-            return false;       // error
+    std::chrono::steady_clock::time_point start =
+        std::chrono::steady_clock::now();
+
+    // read all shader code
+    GLchar **shaders = new GLchar*[numComponents];
+    GLint *sizes = new GLint[numComponents];
+    unsigned int numRead = 0;
+    for(; numRead < numComponents; ++numRead) {
+        shaders[numRead] = readShader(components[numRead].file,
+                                      sizes[numRead]);
+        if (! shaders[numRead])
+            break;
+    }
+
+    // cache file named for the component files, keyed to their types and
+    // code, and to the exact driver, since binaries only work on the one
+    // that made them
+    std::string names;
+    uint64_t key = FNV_OFFSET;
+    const GLenum driverStrings[] = {
+        GL_VENDOR, GL_RENDERER, GL_VERSION, GL_SHADING_LANGUAGE_VERSION
+    };
+    for(unsigned int i=0; i < 4; ++i) {
+        const char *str = (const char*)glGetString(driverStrings[i]);
+        if (str)
+            key = hashBytes(str, strlen(str) + 1, key);
+    }
+    for(unsigned int i=0; i < numRead; ++i) {
+        GLint type;
+        glGetShaderiv(components[i].id, GL_SHADER_TYPE, &type);
+        key = hashBytes(&type, sizeof(type), key);
+        key = hashBytes(&sizes[i], sizeof(sizes[i]), key);
+        key = hashBytes(shaders[i], sizes[i], key);
+        names += (i ? "+" : "") + std::string(components[i].file);
     }
+    std::string cacheName = names + ".glbin";
 
-    // link shader programs
-    // don't attach until everything compiles successfully to avoid
-    // extraneous attach affecting next attempt to link if there was an error
-    for(unsigned int i=0; i<numComponents; ++i)
-        glAttachShader(progID, components[i].id);
-    glLinkProgram(progID);
+    // use the cache if we can, otherwise compile and link
+    bool cached = binarySupported();
+    bool hit = false, success = numRead == numComponents;
+    if (success && cached)
+        hit = loadBinary(progID, cacheName.c_str(), key);
+    if (success && ! hit) {
+        // load shader code
+        for(unsigned int i=0; success && i<numComponents; ++i)
+            success = compileShader(components[i].id, shaders[i], sizes[i]);
+    }
+    for(unsigned int i=0; i < numRead; ++i)
+        delete[] shaders[i];
+    delete[] shaders;
+    delete[] sizes;
+    if (! success)
+        return false;           // error
 
-    // report link errors
-    GLint success;
-    glGetProgramiv(progID, GL_LINK_STATUS, &success);
-    if (! success) {
-        // how big is the message?
-        GLsizei infoLen;
-        glGetProgramiv(progID, GL_INFO_LOG_LENGTH, &infoLen);
+    if (! hit) {
+        // link shader programs
+        // don't attach until everything compiles successfully to avoid
+        // extraneous attach affecting next attempt to link if there was
+        // an error
+        for(unsigned int i=0; i<numComponents; ++i)
+            glAttachShader(progID, components[i].id);
+        if (cached)
+            glProgramParameteri(progID, GL_PROGRAM_BINARY_RETRIEVABLE_HINT,
+                                GL_TRUE);
+        glLinkProgram(progID);
 
-        // print the message
-        char *infoLog = new char[infoLen];
-        glGetProgramInfoLog(progID, infoLen, 0, infoLog);
-        fprintf(stderr, "%s", infoLog);
+        // report link errors
+        GLint linked;
+        glGetProgramiv(progID, GL_LINK_STATUS, &linked);
+        if (! linked) {
+            // how big is the message?
+            GLsizei infoLen;
+            glGetProgramiv(progID, GL_INFO_LOG_LENGTH, &infoLen);
 
-        // free the message buffer
-        delete[] infoLog;
-        return false;           // error
+            // print the message
+            char *infoLog = new char[infoLen];
+            glGetProgramInfoLog(progID, infoLen, 0, infoLog);
+            fprintf(stderr, "%s", infoLog);
+
+            // free the message buffer
+            delete[] infoLog;
+            return false;       // error
+        }
+
+        if (cached)
+            saveBinary(progID, cacheName.c_str(), key);
     }
 
+    printf("shaders %s: %s, %.1f ms\n", names.c_str(),
+           hit ? "cache hit" : cached ? "cache miss, compiled"
+                                      : "compiled, no cache",
+           std::chrono::duration<double, std::milli>(
+               std::chrono::steady_clock::now() - start).count());
     return true;                // success
 }
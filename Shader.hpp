@@ -17,6 +17,11 @@ bool loadShader(unsigned int id, const char *file);
 // progID is the program object
 // components[numComponents] is a list of shader components to link
 // return false on compile error
+// if the driver supports program binaries, the linked program is saved
+// to a file named for the components, e.g. terrain.vert+terrain.frag.glbin,
+// and loaded from there next time instead of compiling, as long as the
+// shader code and driver are the same. Prints whether it was a hit and
+// how long it took.
 bool loadShaders(unsigned int progID, 
                  unsigned int numComponents,
                  ShaderInfo *components);
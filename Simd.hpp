@@ -0,0 +1,39 @@
+// which SIMD instructions the SSE2 and AVX2 code paths can use
+// Any x86 build has SSE2, so USE_SSE2 is defined and its intrinsics are
+// included. AVX2 code is compiled function by function with TARGET_AVX2
+// and only run if cpuHasAVX2() says so. Other CPUs get neither, and
+// everything falls back to scalar code.
+#ifndef Simd_hpp
+#define Simd_hpp
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#include <immintrin.h>
+#define USE_SSE2
+#ifdef _MSC_VER
+#include <intrin.h>
+#define TARGET_AVX2
+#else
+#define TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+
+// true if the CPU and OS support AVX2
+// asks the CPU every time, so keep the answer
+inline bool cpuHasAVX2()
+{
+#ifdef _MSC_VER
+    int info[4];
+    __cpuid(info, 1);
+    bool osxsave = (info[2] & (1 << 27)) != 0;
+    bool avx = (info[2] & (1 << 28)) != 0;
+    if (!osxsave || !avx || (_xgetbv(0) & 6) != 6)
+        return false;
+    __cpuidex(info, 7, 0);
+    return (info[1] & (1 << 5)) != 0;
+#else
+    return __builtin_cpu_supports("avx2") != 0;
+#endif
+}
+#endif
+
+#endif
@@ -2,134 +2,526 @@
 
 #include "Terrain.hpp"
 #include "AppContext.hpp"
-#include "ImagePPM.hpp"
+#include "Scene.hpp"
+#include "Frustum.hpp"
+#include "TextureFile.hpp"
+#include "Heightfield.hpp"
+#include "HorizonMap.hpp"
+#include "OcclusionMap.hpp"
+#include "ThreadPool.hpp"
+#include "TerrainRTIN.hpp"
+#include "TerrainSampler.hpp"
 
 // using core modern OpenGL
 #include <GL/glew.h>
 #include <GLFW/glfw3.h>
 
+#include <float.h>
+#include <math.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <algorithm>
+#include <chrono>
+#include <future>
+#include <string>
+
+//
+// world space box around grid vertices x0..x1, y0..y1 inclusive,
+// wrapping like TerrainMesh
+//
+static void gridBounds(const Heightfield &elevation, const glm::vec3 &mapSize,
+                       unsigned int x0, unsigned int y0,
+                       unsigned int x1, unsigned int y1,
+                       glm::vec3 &boxMin, glm::vec3 &boxMax)
+{
+    unsigned int w = elevation.width, h = elevation.height;
+    unsigned short lo = 0xffff, hi = 0;
+    for(unsigned int y=y0; y <= y1; ++y) {
+        const unsigned short *row = elevation.row(y % h);
+        for(unsigned int x=x0; x <= x1; ++x) {
+            lo = std::min(lo, row[x % w]);
+            hi = std::max(hi, row[x % w]);
+        }
+    }
+    glm::vec3 gridSize(float(w), float(h), float(elevation.maxval));
+    boxMin = (glm::vec3(float(x0), float(y0), float(lo)) / gridSize - 0.5f)
+        * mapSize;
+    boxMax = (glm::vec3(float(x1), float(y1), float(hi)) / gridSize - 0.5f)
+        * mapSize;
+}
+
+//
+// how much detail a patch of grid vertices x0..x1, y0..y1 has beyond
+// the bilinear surface through its corners: the standard deviation of
+// the difference, in elevation sample units
+//
+static float patchRoughness(const Heightfield &elevation,
+                            unsigned int x0, unsigned int y0,
+                            unsigned int x1, unsigned int y1)
+{
+    unsigned int w = elevation.width, h = elevation.height;
+    float h00 = elevation(x0 % w, y0 % h), h10 = elevation(x1 % w, y0 % h);
+    float h01 = elevation(x0 % w, y1 % h), h11 = elevation(x1 % w, y1 % h);
+    double sum = 0, sum2 = 0;
+    for(unsigned int y=y0; y <= y1; ++y) {
+        float v = float(y - y0) / float(y1 - y0);
+        for(unsigned int x=x0; x <= x1; ++x) {
+            float u = float(x - x0) / float(x1 - x0);
+            float smooth = (1-v) * (h00 + u*(h10 - h00))
+                         + v * (h01 + u*(h11 - h01));
+            double d = elevation(x % w, y % h) - smooth;
+            sum += d;
+            sum2 += d*d;
+        }
+    }
+    double n = double(x1 - x0 + 1) * double(y1 - y0 + 1);
+    double mean = sum / n;
+    return float(sqrt(std::max(sum2 / n - mean*mean, 0.)));
+}
+
+//
+// cache file for elevationFile: same name with a different extension
+//
+static std::string cacheFile(const char *elevationFile, const char *extension)
+{
+    std::string name(elevationFile);
+    return name.substr(0, name.find_last_of('.')) + extension;
+}
 
 //
 // load the terrain data
 //
 Terrain::Terrain(const char *elevationPPM, const char *texturePPM,
-                 const char *normalPPM, const char *glossPPM)
+                 const char *normalPPM, const char *glossPPM,
+                 ThreadPool &pool, VertexFormat format,
+                 unsigned int indexLayout, float detailPixels,
+                 float simplifyError)
+    : format(format), uploaded(false), heights(0), detailPixels(detailPixels),
+      nextQuery(0), patchTriangles(0)
 {
-    // buffer objects to be used later
-    glGenTextures(NUM_TEXTURES, textureIDs);
-    glGenBuffers(NUM_BUFFERS, bufferIDs);
-    glGenVertexArrays(1, &varrayID);
+    counts.chunksTested = counts.chunksCulled = counts.chunksDrawn = 0;
+    counts.triangles = 0;
+    for(int i=0; i<NUM_QUERIES; ++i)
+        queryPending[i] = false;
+    meshCounts.gridTriangles = meshCounts.triangles = 0;
+    meshCounts.maxError = 0;
+
+    // start reading all images and building the mesh in the background
+    // only the thread with the GL context can upload, so the workers
+    // just get the data ready
+    const char *texturePPMs[NUM_TEXTURES];
+    texturePPMs[COLOR_TEXTURE] = texturePPM;
+    texturePPMs[NORMAL_TEXTURE] = normalPPM;
+    texturePPMs[GLOSS_TEXTURE] = glossPPM;
+    for(int i=0; i<NUM_TEXTURES; ++i)
+        textureFiles[i] = texturePPMs[i];
+
+    std::future<TextureFile*> textures[NUM_TEXTURES];
+    for(int i=0; i<NUM_TEXTURES; ++i) {
+        const char *name = texturePPMs[i];
+        textures[i] = pool.async<TextureFile*>([name]() {
+            return new TextureFile(name);
+        });
+    }
 
-    // load albedo, normal & gloss image into a named textures
-    ImagePPM(texturePPM).loadTexture(textureIDs[COLOR_TEXTURE]);
-    ImagePPM(normalPPM).loadTexture(textureIDs[NORMAL_TEXTURE]);
-    ImagePPM(glossPPM).loadTexture(textureIDs[GLOSS_TEXTURE]);
+    TerrainMesh *geometry = &mesh;
+    TerrainIndices *triangles = &indices;
+    std::vector<glm::vec3> *boxes = &chunkBounds;
+    TerrainQuadtree *tree = &lod;
+    HeightPyramid *rays = &pyramid;
+    std::vector<float> *detail = &patchDetail;
+    Heightfield **elevationOut = &heights;
+    glm::vec3 *mapSizeOut = &mapSize;
+    ThreadPool *workers = &pool;
+    std::future<void> meshReady = pool.async<void>([=]() {
+        // terrain is 512x512x50 world units
+        glm::vec3 mapSize(512, 512, 50);
+        *mapSizeOut = mapSize;
+
+        // LOD chunks need only the heights, which go to the GPU as they
+        // are, and the quadtree to choose chunks
+        if (format == LOD_CHUNKS) {
+            Heightfield *elevation = new Heightfield(elevationPPM);
+            tree->build(*elevation, mapSize, workers);
+            rays->build(*elevation, mapSize, workers);
+            *elevationOut = elevation;
+            return;
+        }
 
-    // load terrain heights
-    ImagePPM elevation(elevationPPM);
-    unsigned int w = elevation.width, h = elevation.height;
-    gridSize = glm::vec3(float(w), float(h), 255.f);
-
-    // world dimensions
-    mapSize = glm::vec3(512, 512, 50);
-
-    // build vertex, normal and texture coordinate arrays
-    // * x & y are the position in the terrain grid
-    // * idx is the linear array index for each vertex
-    numvert = (w + 1) * (h + 1);
-    vert = new glm::vec3[numvert];
-    dPdu = new glm::vec3[numvert];
-    dPdv = new glm::vec3[numvert];
-    norm = new glm::vec3[numvert];
-    texcoord = new glm::vec2[numvert];
-
-    for(unsigned int y=0, idx=0;  y <= h;  ++y) {
-        for(unsigned int x=0;  x <= w;  ++idx, ++x) {
-            // 3d vertex location: x,y from grid location, z from terrain data
-            vert[idx] = (glm::vec3(float(x), float(y), elevation(x%w, y%h).r)
-                         / gridSize - 0.5f) * mapSize;
-
-            // compute normal & tangents from partial derivatives:
-            //   position =
-            //     (u / gridSize.x - .5) * mapSize.x
-            //     (v / gridSize.y - .5) * mapSize.y
-            //     (elevation / gridSize.z - .5) * mapSize.z
-            //   the u-tangent is the per-component partial derivative by u:
-            //      mapSize.x / gridSize.x
-            //      0
-            //      d(elevation(u,v))/du * mapSize.z / gridSize.z
-            //   the v-tangent is the partial derivative by v
-            //      0
-            //      mapSize.y / gridSize.y
-            //      d(elevation(u,v))/du * mapSize.z / gridSize.z
-            //   the normal is the cross product of these
-
-            // first approximate du = d(elevation(u,v))/du (and dv)
-            // be careful to wrap indices to 0 <= x < w and 0 <= y < h
-            float du = (elevation((x+1)%w, y%h).r - elevation((x+w-1)%w, y%h).r)
-                * 0.5f * mapSize.z / gridSize.z;
-            float dv = (elevation(x%w, (y+1)%h).r - elevation(x%w, (y+h-1)%h).r)
-                * 0.5f * mapSize.z / gridSize.z;
-
-            // final tangents and normal using these
-            dPdu[idx] = glm::normalize(glm::vec3(mapSize.x/gridSize.x, 0, du));
-            dPdv[idx] = glm::normalize(glm::vec3(0, mapSize.y/gridSize.y, dv));
-            norm[idx] = glm::normalize(glm::cross(dPdu[idx], dPdv[idx]));
-
-            // 2D texture coordinate for rocks texture, from grid location
-            texcoord[idx] = glm::vec2(float(x),float(y)) / gridSize.xy;
-        }
-    }
-
-    // build index array linking sets of three vertices into triangles
-    // two triangles per square in the grid. Each vertex index is
-    // essentially its unfolded grid array position. Be careful that
-    // each triangle ends up in counter-clockwise order
-    numtri = 2*w*h;
-    indices = new glm::uvec3[numtri];
-    for(unsigned int y=0, idx=0; y<h; ++y) {
-        for(unsigned int x=0; x<w; ++x, idx+=2) {
-            indices[idx][0] = (w+1)* y    + x;
-            indices[idx][1] = (w+1)* y    + x+1;
-            indices[idx][2] = (w+1)*(y+1) + x+1;
-
-            indices[idx+1][0] = (w+1)* y    + x;
-            indices[idx+1][1] = (w+1)*(y+1) + x+1;
-            indices[idx+1][2] = (w+1)*(y+1) + x;
-        }
-    }
-
-    // load vertex and index array to GPU
-    glBindBuffer(GL_ARRAY_BUFFER, bufferIDs[POSITION_BUFFER]);
-    glBufferData(GL_ARRAY_BUFFER, numvert*sizeof(glm::vec3), vert, GL_STATIC_DRAW);
-
-    glBindBuffer(GL_ARRAY_BUFFER, bufferIDs[TANGENT_BUFFER]);
-    glBufferData(GL_ARRAY_BUFFER, numvert*sizeof(glm::vec3), dPdu, GL_STATIC_DRAW);
-
-    glBindBuffer(GL_ARRAY_BUFFER, bufferIDs[BITANGENT_BUFFER]);
-    glBufferData(GL_ARRAY_BUFFER, numvert*sizeof(glm::vec3), dPdv, GL_STATIC_DRAW);
-
-    glBindBuffer(GL_ARRAY_BUFFER, bufferIDs[NORMAL_BUFFER]);
-    glBufferData(GL_ARRAY_BUFFER, numvert*sizeof(glm::vec3), norm, GL_STATIC_DRAW);
-
-    glBindBuffer(GL_ARRAY_BUFFER, bufferIDs[UV_BUFFER]);
-    glBufferData(GL_ARRAY_BUFFER, numvert*sizeof(glm::vec2), texcoord, 
-                 GL_STATIC_DRAW);
+        // the procedural grid needs only the heights, and a box around
+        // each band of rows for culling
+        if (format == PROCEDURAL_GRID) {
+            Heightfield *elevation = new Heightfield(elevationPPM);
+            unsigned int w = elevation->width, h = elevation->height;
+            glm::vec3 gridSize(float(w), float(h), float(elevation->maxval));
+            unsigned int bands = (h + GRID_BAND - 1) / GRID_BAND;
+            boxes->resize(2 * bands);
+            for(unsigned int b=0; b < bands; ++b) {
+                unsigned int y0 = b * GRID_BAND;
+                gridBounds(*elevation, mapSize, 0, y0,
+                           w, std::min(y0 + GRID_BAND, h),
+                           (*boxes)[2*b], (*boxes)[2*b+1]);
+            }
+            rays->build(*elevation, mapSize, workers);
+            *elevationOut = elevation;
+            return;
+        }
 
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, bufferIDs[INDEX_BUFFER]);
-    glBufferData(GL_ELEMENT_ARRAY_BUFFER, 
-                 numtri*sizeof(glm::uvec3), indices, GL_STATIC_DRAW);
+        // tessellated patches need the heights, and a box and roughness
+        // for each patch, relative to the roughest
+        if (format == TESSELLATED_PATCHES) {
+            Heightfield *elevation = new Heightfield(elevationPPM);
+            unsigned int w = elevation->width, h = elevation->height;
+            unsigned int across = (w + PATCH_SIZE - 1) / PATCH_SIZE;
+            unsigned int down = (h + PATCH_SIZE - 1) / PATCH_SIZE;
+            boxes->resize(2 * across * down);
+            detail->resize(across * down);
+            float roughest = 0;
+            for(unsigned int p=0; p < across * down; ++p) {
+                unsigned int x0 = p % across * PATCH_SIZE;
+                unsigned int y0 = p / across * PATCH_SIZE;
+                unsigned int x1 = std::min(x0 + PATCH_SIZE, w);
+                unsigned int y1 = std::min(y0 + PATCH_SIZE, h);
+                gridBounds(*elevation, mapSize, x0, y0, x1, y1,
+                           (*boxes)[2*p], (*boxes)[2*p+1]);
+                (*detail)[p] = patchRoughness(*elevation, x0, y0, x1, y1);
+                roughest = std::max(roughest, (*detail)[p]);
+            }
+            for(unsigned int p=0; p < across * down && roughest > 0; ++p)
+                (*detail)[p] /= roughest;
+            rays->build(*elevation, mapSize, workers);
+            *elevationOut = elevation;
+            return;
+        }
 
-    glBindBuffer(GL_ARRAY_BUFFER, 0);
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+        // use cached mesh (same name but .mesh extension) if it's current
+        std::string cacheName = cacheFile(elevationPPM, ".mesh");
+        uint64_t key = TerrainMesh::cacheKey(elevationPPM, mapSize);
+        if (! geometry->load(cacheName.c_str(), key)) {
+            // otherwise load terrain heights, build, and cache for next time
+            Heightfield elevation(elevationPPM);
+            geometry->build(elevation, mapSize, workers);
+            if (! geometry->save(cacheName.c_str(), key))
+                fprintf(stderr, "warning: can't write mesh cache %s\n",
+                        cacheName.c_str());
+        }
+        rays->build(*geometry, workers);
+
+        // draw order for the mesh triangles, or for just enough of them
+        if (simplifyError > 0) {
+            TerrainRTIN rtin;
+            rtin.build(*geometry, workers);
+            // small tiles can't merge into large triangles
+            if (rtin.tileSize < TerrainRTIN::MAX_TILE &&
+                rtin.tileSize < std::min(rtin.width, rtin.height))
+                fprintf(stderr, "warning: %ux%u terrain only allows %u "
+                        "square tiles, so simplifies poorly\n",
+                        rtin.width, rtin.height, rtin.tileSize);
+            triangles->buildSimplified(*geometry, rtin, simplifyError,
+                                       indexLayout);
+        }
+        else
+            triangles->build(unsigned(geometry->gridSize.x),
+                             unsigned(geometry->gridSize.y), indexLayout);
+
+        // bounding box of each chunk's vertices, for culling
+        unsigned int rowLength = unsigned(geometry->gridSize.x) + 1;
+        boxes->resize(2 * triangles->numchunk);
+        for(unsigned int c=0; c < triangles->numchunk; ++c) {
+            const TerrainIndices::Chunk &chunk = triangles->chunks[c];
+            const glm::vec3 *row = geometry->vert +
+                chunk.firstRow * rowLength + chunk.firstColumn;
+            glm::vec3 boxMin = *row, boxMax = *row;
+            for(unsigned int y=0; y <= chunk.rows; ++y, row += rowLength) {
+                for(unsigned int x=0; x <= chunk.columns; ++x) {
+                    boxMin = glm::min(boxMin, row[x]);
+                    boxMax = glm::max(boxMax, row[x]);
+                }
+            }
+            (*boxes)[2*c] = boxMin;
+            (*boxes)[2*c+1] = boxMax;
+        }
+    });
+
+    // meanwhile, set up GL objects and compile shaders here
+    glGenTextures(NUM_TEXTURES, textureIDs);
+    glGenTextures(1, &heightTextureID);
+    glGenTextures(1, &detailTextureID);
+    glGenTextures(1, &horizonTextureID);
+    glGenTextures(1, &occlusionTextureID);
+    uploadHorizons(0);
+    uploadOcclusion(0);
+    glGenBuffers(NUM_BUFFERS, bufferIDs);
+    glGenVertexArrays(1, &varrayID);
+    glGenQueries(NUM_QUERIES, primitiveQueries);
 
-    // initial shader load
     shaderParts[0].id = glCreateShader(GL_VERTEX_SHADER);
-    shaderParts[0].file = "terrain.vert";
+    shaderParts[0].file = format == PACKED_VERTICES ? "terrain-packed.vert"
+                        : format == LOD_CHUNKS ? "terrain-lod.vert"
+                        : format == PROCEDURAL_GRID ? "terrain-grid.vert"
+                        : format == TESSELLATED_PATCHES ? "terrain-tess.vert"
+                        : "terrain.vert";
     shaderParts[1].id = glCreateShader(GL_FRAGMENT_SHADER);
     shaderParts[1].file = "terrain.frag";
+    numShaderParts = 2;
+    if (format == TESSELLATED_PATCHES) {
+        shaderParts[2].id = glCreateShader(GL_TESS_CONTROL_SHADER);
+        shaderParts[2].file = "terrain-tess.tesc";
+        shaderParts[3].id = glCreateShader(GL_TESS_EVALUATION_SHADER);
+        shaderParts[3].file = "terrain-tess.tese";
+        numShaderParts = 4;
+    }
     shaderID = glCreateProgram();
     updateShaders();
+
+    // upload albedo, normal, gloss and mesh in whatever order they finish
+    bool textureDone[NUM_TEXTURES] = {false};
+    bool meshDone = false;
+    for(int remaining = NUM_TEXTURES + 1; remaining > 0; ) {
+        for(int i=0; i<NUM_TEXTURES; ++i) {
+            if (!textureDone[i] && textures[i].wait_for(
+                    std::chrono::milliseconds(1)) == std::future_status::ready) {
+                TextureFile *texture = textures[i].get();
+                texture->loadTexture(textureIDs[i]);
+                delete texture;
+                textureDone[i] = true;
+                --remaining;
+            }
+        }
+        if (!meshDone && meshReady.wait_for(
+                std::chrono::milliseconds(1)) == std::future_status::ready) {
+            meshReady.get();
+
+            // shadows and ambient occlusion aren't needed for the first
+            // frame, so draw without them until they're read back or
+            // baked, for update() to upload
+            std::string elevationFile(elevationPPM);
+            std::string horizonFile = cacheFile(elevationPPM, ".horizons");
+            std::string occlusionFile = cacheFile(elevationPPM, ".occlusion");
+            horizonsReady = pool.async<HorizonMap*>([=]() {
+                HorizonMap *horizons = new HorizonMap;
+                uint64_t key = TerrainMesh::cacheKey(elevationFile.c_str(),
+                                                     rays->mapSize);
+                if (! horizons->load(horizonFile.c_str(), key) ||
+                    horizons->width != rays->width ||
+                    horizons->height != rays->height) {
+                    horizons->build(*rays, workers);
+                    if (! horizons->save(horizonFile.c_str(), key))
+                        fprintf(stderr, "warning: can't write horizon "
+                                "cache %s\n", horizonFile.c_str());
+                }
+                return horizons;
+            });
+            occlusionReady = pool.async<OcclusionMap*>([=]() {
+                // hollows and valleys up to about 16 world units across
+                const float radius = 16;
+                OcclusionMap *occlusion = new OcclusionMap;
+                uint64_t key = TerrainMesh::cacheKey(elevationFile.c_str(),
+                                                     rays->mapSize);
+                if (! occlusion->load(occlusionFile.c_str(), key, radius) ||
+                    occlusion->width != rays->width ||
+                    occlusion->height != rays->height) {
+                    occlusion->build(*rays, radius, workers);
+                    if (! occlusion->save(occlusionFile.c_str(), key))
+                        fprintf(stderr, "warning: can't write occlusion "
+                                "cache %s\n", occlusionFile.c_str());
+                }
+                return occlusion;
+            });
+            uploadMesh();
+            meshDone = true;
+            --remaining;
+        }
+    }
+}
+
+//
+// load vertex and index array to GPU
+//
+void Terrain::uploadMesh()
+{
+    // the procedural grid needs nothing but the heights
+    bool meshFormat = format == SEPARATE_VERTICES ||
+                      format == PACKED_VERTICES;
+    if (meshFormat) {
+        gridSize = mesh.gridSize;
+        meshCounts.gridTriangles = 2 * unsigned(gridSize.x * gridSize.y);
+        for(unsigned int c=0; c < indices.numchunk; ++c)
+            meshCounts.triangles += indices.chunks[c].triangles;
+        meshCounts.maxError = indices.maxError;
+    }
+    else
+        uploadHeights();
+
+    if (format == LOD_CHUNKS) {
+        // every node uses the same LEAF_SIZE grid of squares, one
+        // quadrant after another so any set of quadrants is easy to draw
+        const unsigned int N = TerrainQuadtree::LEAF_SIZE, HALF = N/2;
+        uint16_t *grid = new uint16_t[6*N*N], *index = grid;
+        for(unsigned int q=0; q < 4; ++q) {
+            unsigned int x0 = (q & 1) * HALF, y0 = (q >> 1) * HALF;
+            for(unsigned int y=y0; y < y0 + HALF; ++y) {
+                uint16_t v0 = uint16_t(y * (N+1)), v1 = uint16_t(v0 + N+1);
+                for(unsigned int x=x0; x < x0 + HALF; ++x) {
+                    // same triangles as TerrainMesh
+                    *index++ = uint16_t(v0 + x);
+                    *index++ = uint16_t(v0 + x+1);
+                    *index++ = uint16_t(v1 + x+1);
+
+                    *index++ = uint16_t(v0 + x);
+                    *index++ = uint16_t(v1 + x+1);
+                    *index++ = uint16_t(v1 + x);
+                }
+            }
+        }
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, bufferIDs[INDEX_BUFFER]);
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER, 6*N*N*sizeof(uint16_t), grid,
+                     GL_STATIC_DRAW);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+        delete[] grid;
+    }
+    else if (format == PACKED_VERTICES) {
+        // interleaved, everything in one buffer
+        TerrainMesh::PackedVertex *packed =
+            new TerrainMesh::PackedVertex[mesh.numvert];
+        mesh.pack(packed);
+        glBindBuffer(GL_ARRAY_BUFFER, bufferIDs[POSITION_BUFFER]);
+        glBufferData(GL_ARRAY_BUFFER,
+                     mesh.numvert*sizeof(TerrainMesh::PackedVertex), packed,
+                     GL_STATIC_DRAW);
+        delete[] packed;
+    }
+    else if (format == SEPARATE_VERTICES) {
+        glBindBuffer(GL_ARRAY_BUFFER, bufferIDs[POSITION_BUFFER]);
+        glBufferData(GL_ARRAY_BUFFER, mesh.numvert*sizeof(glm::vec3), mesh.vert,
+                     GL_STATIC_DRAW);
+
+        glBindBuffer(GL_ARRAY_BUFFER, bufferIDs[TANGENT_BUFFER]);
+        glBufferData(GL_ARRAY_BUFFER, mesh.numvert*sizeof(glm::vec3), mesh.dPdu,
+                     GL_STATIC_DRAW);
+
+        glBindBuffer(GL_ARRAY_BUFFER, bufferIDs[BITANGENT_BUFFER]);
+        glBufferData(GL_ARRAY_BUFFER, mesh.numvert*sizeof(glm::vec3), mesh.dPdv,
+                     GL_STATIC_DRAW);
+
+        glBindBuffer(GL_ARRAY_BUFFER, bufferIDs[NORMAL_BUFFER]);
+        glBufferData(GL_ARRAY_BUFFER, mesh.numvert*sizeof(glm::vec3), mesh.norm,
+                     GL_STATIC_DRAW);
+
+        glBindBuffer(GL_ARRAY_BUFFER, bufferIDs[UV_BUFFER]);
+        glBufferData(GL_ARRAY_BUFFER, mesh.numvert*sizeof(glm::vec2),
+                     mesh.texcoord, GL_STATIC_DRAW);
+    }
+
+    if (meshFormat) {
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, bufferIDs[INDEX_BUFFER]);
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER,
+                     size_t(indices.numindex) * indices.indexBytes(),
+                     indices.index16 ? (void*)indices.index16
+                                     : (void*)indices.index32,
+                     GL_STATIC_DRAW);
+    }
+
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+
+    // shaders were set up before the grid size was known
+    uploaded = true;
+    glUseProgram(shaderID);
+    setGridUniforms();
+    glUseProgram(0);
+}
+
+//
+// load elevation samples as they are, as integers for texelFetch
+//
+void Terrain::uploadHeights()
+{
+    gridSize = glm::vec3(float(heights->width), float(heights->height),
+                         float(heights->maxval));
+
+    glBindTexture(GL_TEXTURE_2D, heightTextureID);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 2);
+    glPixelStorei(GL_UNPACK_ROW_LENGTH, heights->stride);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_R16UI, heights->width, heights->height,
+                 0, GL_RED_INTEGER, GL_UNSIGNED_SHORT, heights->row(0));
+    glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, 0);
+
+    // patch roughness, one texel per patch
+    if (! patchDetail.empty()) {
+        glBindTexture(GL_TEXTURE_2D, detailTextureID);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_R32F, patchesAcross(),
+                     GLsizei(patchDetail.size() / patchesAcross()),
+                     0, GL_RED, GL_FLOAT, &patchDetail[0]);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, 0);
+    }
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    // the texture is the only copy from now on
+    delete heights;
+    heights = 0;
+}
+
+//
+// load horizon sines as one layer per direction, filtered across the
+// terrain but not between directions, which the shader does itself
+// with no horizons, a single level horizon, which shadows nothing
+//
+void Terrain::uploadHorizons(HorizonMap *horizons)
+{
+    static const unsigned char level = 0;
+    glBindTexture(GL_TEXTURE_2D_ARRAY, horizonTextureID);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    if (horizons)
+        glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_R8, horizons->width,
+                     horizons->height, horizons->directions, 0, GL_RED,
+                     GL_UNSIGNED_BYTE, &horizons->horizons[0]);
+    else
+        glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_R8, 1, 1, 1, 0, GL_RED,
+                     GL_UNSIGNED_BYTE, &level);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAX_LEVEL, 0);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+
+    // the texture is the only copy from now on
+    delete horizons;
+}
+
+//
+// load sky visibility, one texel per vertex
+// with no visibility, one texel that sees all of the sky
+//
+void Terrain::uploadOcclusion(OcclusionMap *occlusion)
+{
+    static const unsigned char open = 255;
+    glBindTexture(GL_TEXTURE_2D, occlusionTextureID);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    if (occlusion)
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_R8, occlusion->width,
+                     occlusion->height, 0, GL_RED, GL_UNSIGNED_BYTE,
+                     &occlusion->visibility[0]);
+    else
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_R8, 1, 1, 0, GL_RED,
+                     GL_UNSIGNED_BYTE, &open);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, 0);
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    delete occlusion;
 }
 
 //
@@ -137,35 +529,62 @@ Terrain::Terrain(const char *elevationPPM, const char *texturePPM,
 //
 Terrain::~Terrain()
 {
-    glDeleteShader(shaderParts[0].id);
-    glDeleteShader(shaderParts[1].id);
+    // background work uses the pyramid, so let it finish
+    if (horizonsReady.valid())
+        delete horizonsReady.get();
+    if (occlusionReady.valid())
+        delete occlusionReady.get();
+
+    for(unsigned int i=0; i < numShaderParts; ++i)
+        glDeleteShader(shaderParts[i].id);
     glDeleteProgram(shaderID);
     glDeleteTextures(NUM_TEXTURES, textureIDs);
+    glDeleteTextures(1, &heightTextureID);
+    glDeleteTextures(1, &detailTextureID);
+    glDeleteTextures(1, &horizonTextureID);
+    glDeleteTextures(1, &occlusionTextureID);
+    glDeleteQueries(NUM_QUERIES, primitiveQueries);
     glDeleteBuffers(NUM_BUFFERS, bufferIDs);
     glDeleteVertexArrays(1, &varrayID);
+}
 
-    delete[] indices;
-    delete[] texcoord;
-    delete[] norm;
-    delete[] dPdv;
-    delete[] dPdu;
-    delete[] vert;
+//
+// reload textures, streaming them in over several frames
+//
+void Terrain::updateTextures()
+{
+    for(int i=0; i<NUM_TEXTURES; ++i)
+        streamer.replace(textureFiles[i].c_str(), &textureIDs[i]);
 }
 
 //
-// load (or replace) texture
+// upload the next part of any textures being reloaded
 //
-void Terrain::updateTexture(const char *ppm, unsigned int textureID)
+bool Terrain::update()
 {
-    ImagePPM texture(ppm);
-    glBindTexture(GL_TEXTURE_2D, textureID);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, 
-                 texture.width, texture.height, 0,
-                 GL_RGB, GL_UNSIGNED_BYTE, texture.image);
-    glGenerateMipmap(GL_TEXTURE_2D);
-    glTexParameteri(GL_TEXTURE_2D,GL_TEXTURE_MAG_FILTER,
-                    GL_LINEAR_MIPMAP_LINEAR);
-    glBindTexture(GL_TEXTURE_2D, 0);
+    bool changed = streamer.update();
+    if (horizonsReady.valid() && horizonsReady.wait_for(
+            std::chrono::seconds(0)) == std::future_status::ready) {
+        uploadHorizons(horizonsReady.get());
+        changed = true;
+    }
+    if (occlusionReady.valid() && occlusionReady.wait_for(
+            std::chrono::seconds(0)) == std::future_status::ready) {
+        uploadOcclusion(occlusionReady.get());
+        changed = true;
+    }
+    return changed;
+}
+
+//
+// wait for and upload anything still in the background
+//
+void Terrain::finishLoading()
+{
+    if (horizonsReady.valid())
+        uploadHorizons(horizonsReady.get());
+    if (occlusionReady.valid())
+        uploadOcclusion(occlusionReady.get());
 }
 
 //
@@ -173,8 +592,7 @@ void Terrain::updateTexture(const char *ppm, unsigned int textureID)
 //
 void Terrain::updateShaders()
 {
-    loadShaders(shaderID, sizeof(shaderParts)/sizeof(*shaderParts), 
-                shaderParts);
+    loadShaders(shaderID, numShaderParts, shaderParts);
     glUseProgram(shaderID);
 
     // (re)connect view and projection matrices
@@ -186,34 +604,64 @@ void Terrain::updateShaders()
     glUniform1i(glGetUniformLocation(shaderID, "colorTexture"), COLOR_TEXTURE);
     glUniform1i(glGetUniformLocation(shaderID, "normalTexture"), NORMAL_TEXTURE);
     glUniform1i(glGetUniformLocation(shaderID, "glossTexture"), GLOSS_TEXTURE);
+    glUniform1i(glGetUniformLocation(shaderID, "heights"), NUM_TEXTURES);
+    glUniform1i(glGetUniformLocation(shaderID, "patchDetail"),
+                NUM_TEXTURES + 1);
+    glUniform1i(glGetUniformLocation(shaderID, "horizons"), NUM_TEXTURES + 2);
+    glUniform1i(glGetUniformLocation(shaderID, "occlusion"), NUM_TEXTURES + 3);
 
     // re-connect attribute arrays
     glBindVertexArray(varrayID);
 
-    GLint positionAttrib = glGetAttribLocation(shaderID, "vPosition");
-    glBindBuffer(GL_ARRAY_BUFFER, bufferIDs[POSITION_BUFFER]);
-    glVertexAttribPointer(positionAttrib, 3, GL_FLOAT, GL_FALSE, 0, 0);
-    glEnableVertexAttribArray(positionAttrib);
-
-    GLint tangentAttrib = glGetAttribLocation(shaderID, "vTangent");
-    glBindBuffer(GL_ARRAY_BUFFER, bufferIDs[TANGENT_BUFFER]);
-    glVertexAttribPointer(tangentAttrib, 3, GL_FLOAT, GL_FALSE, 0, 0);
-    glEnableVertexAttribArray(tangentAttrib);
-
-    GLint bitangentAttrib = glGetAttribLocation(shaderID, "vBitangent");
-    glBindBuffer(GL_ARRAY_BUFFER, bufferIDs[BITANGENT_BUFFER]);
-    glVertexAttribPointer(bitangentAttrib, 3, GL_FLOAT, GL_FALSE, 0, 0);
-    glEnableVertexAttribArray(bitangentAttrib);
-
-    GLint normalAttrib = glGetAttribLocation(shaderID, "vNormal");
-    glBindBuffer(GL_ARRAY_BUFFER, bufferIDs[NORMAL_BUFFER]);
-    glVertexAttribPointer(normalAttrib, 3, GL_FLOAT, GL_FALSE, 0, 0);
-    glEnableVertexAttribArray(normalAttrib);
-
-    GLint uvAttrib = glGetAttribLocation(shaderID, "vUV");
-    glBindBuffer(GL_ARRAY_BUFFER, bufferIDs[UV_BUFFER]);
-    glVertexAttribPointer(uvAttrib, 2, GL_FLOAT, GL_FALSE, 0, 0);
-    glEnableVertexAttribArray(uvAttrib);
+    if (format == LOD_CHUNKS || format == PROCEDURAL_GRID ||
+        format == TESSELLATED_PATCHES) {
+        // no attributes, everything comes from gl_VertexID and heights
+        setGridUniforms();
+    }
+    else if (format == PACKED_VERTICES) {
+        // one interleaved buffer
+        // height stays an integer sample value, as in Heightfield
+        GLsizei stride = sizeof(TerrainMesh::PackedVertex);
+        glBindBuffer(GL_ARRAY_BUFFER, bufferIDs[POSITION_BUFFER]);
+
+        GLint normalAttrib = glGetAttribLocation(shaderID, "vNormal");
+        glVertexAttribPointer(normalAttrib, 2, GL_SHORT, GL_TRUE, stride,
+            (void*)offsetof(TerrainMesh::PackedVertex, normal));
+        glEnableVertexAttribArray(normalAttrib);
+
+        GLint heightAttrib = glGetAttribLocation(shaderID, "vHeight");
+        glVertexAttribPointer(heightAttrib, 1, GL_UNSIGNED_SHORT, GL_FALSE,
+            stride, (void*)offsetof(TerrainMesh::PackedVertex, height));
+        glEnableVertexAttribArray(heightAttrib);
+
+        setGridUniforms();
+    }
+    else {
+        GLint positionAttrib = glGetAttribLocation(shaderID, "vPosition");
+        glBindBuffer(GL_ARRAY_BUFFER, bufferIDs[POSITION_BUFFER]);
+        glVertexAttribPointer(positionAttrib, 3, GL_FLOAT, GL_FALSE, 0, 0);
+        glEnableVertexAttribArray(positionAttrib);
+
+        GLint tangentAttrib = glGetAttribLocation(shaderID, "vTangent");
+        glBindBuffer(GL_ARRAY_BUFFER, bufferIDs[TANGENT_BUFFER]);
+        glVertexAttribPointer(tangentAttrib, 3, GL_FLOAT, GL_FALSE, 0, 0);
+        glEnableVertexAttribArray(tangentAttrib);
+
+        GLint bitangentAttrib = glGetAttribLocation(shaderID, "vBitangent");
+        glBindBuffer(GL_ARRAY_BUFFER, bufferIDs[BITANGENT_BUFFER]);
+        glVertexAttribPointer(bitangentAttrib, 3, GL_FLOAT, GL_FALSE, 0, 0);
+        glEnableVertexAttribArray(bitangentAttrib);
+
+        GLint normalAttrib = glGetAttribLocation(shaderID, "vNormal");
+        glBindBuffer(GL_ARRAY_BUFFER, bufferIDs[NORMAL_BUFFER]);
+        glVertexAttribPointer(normalAttrib, 3, GL_FLOAT, GL_FALSE, 0, 0);
+        glEnableVertexAttribArray(normalAttrib);
+
+        GLint uvAttrib = glGetAttribLocation(shaderID, "vUV");
+        glBindBuffer(GL_ARRAY_BUFFER, bufferIDs[UV_BUFFER]);
+        glVertexAttribPointer(uvAttrib, 2, GL_FLOAT, GL_FALSE, 0, 0);
+        glEnableVertexAttribArray(uvAttrib);
+    }
 
     // turn off everything we enabled
     glBindBuffer(GL_ARRAY_BUFFER, 0);
@@ -221,10 +669,170 @@ void Terrain::updateShaders()
     glUseProgram(0);
 }
 
+//
+// change heights on the CPU, then send just the changed vertex runs
+//
+void Terrain::editHeights(int x0, int y0, unsigned int w, unsigned int h,
+                          const float *delta)
+{
+    if (format != SEPARATE_VERTICES && format != PACKED_VERTICES)
+        return;
+
+    // shadows and occlusion may still be coming from the pyramid, so let
+    // them finish before changing it; update() uploads them as usual
+    if (horizonsReady.valid())
+        horizonsReady.wait();
+    if (occlusionReady.valid())
+        occlusionReady.wait();
+
+    editSpans.clear();
+    mesh.edit(x0, y0, w, h, delta, editSpans);
+    pyramid.update(mesh, editSpans);
+
+    if (format == PACKED_VERTICES) {
+        glBindBuffer(GL_ARRAY_BUFFER, bufferIDs[POSITION_BUFFER]);
+        for(size_t s=0; s < editSpans.size(); ++s) {
+            const TerrainMesh::Span &span = editSpans[s];
+            editPacked.resize(span.count);
+            mesh.pack(&editPacked[0], span.first, span.count);
+            glBufferSubData(GL_ARRAY_BUFFER,
+                            span.first * sizeof(TerrainMesh::PackedVertex),
+                            span.count * sizeof(TerrainMesh::PackedVertex),
+                            &editPacked[0]);
+        }
+    }
+    else {
+        // texture coordinates never change
+        const glm::vec3 *arrays[] = { mesh.vert, mesh.dPdu, mesh.dPdv,
+                                      mesh.norm };
+        const unsigned int buffers[] = { POSITION_BUFFER, TANGENT_BUFFER,
+                                         BITANGENT_BUFFER, NORMAL_BUFFER };
+        for(int b=0; b < 4; ++b) {
+            glBindBuffer(GL_ARRAY_BUFFER, bufferIDs[buffers[b]]);
+            for(size_t s=0; s < editSpans.size(); ++s) {
+                const TerrainMesh::Span &span = editSpans[s];
+                glBufferSubData(GL_ARRAY_BUFFER,
+                                span.first * sizeof(glm::vec3),
+                                span.count * sizeof(glm::vec3),
+                                arrays[b] + span.first);
+            }
+        }
+    }
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+    // grow the culling box of any chunk the changes touch
+    // (boxes never shrink, which is safe, if not as tight as a rebuild)
+    unsigned int rowLength = unsigned(mesh.gridSize.x) + 1;
+    for(size_t s=0; s < editSpans.size(); ++s) {
+        const TerrainMesh::Span &span = editSpans[s];
+        unsigned int y = span.first / rowLength;
+        unsigned int x0 = span.first % rowLength, x1 = x0 + span.count - 1;
+        float lo = mesh.vert[span.first].z, hi = lo;
+        for(unsigned int v=span.first; v < span.first + span.count; ++v) {
+            lo = std::min(lo, mesh.vert[v].z);
+            hi = std::max(hi, mesh.vert[v].z);
+        }
+        for(unsigned int c=0; c < indices.numchunk; ++c) {
+            const TerrainIndices::Chunk &chunk = indices.chunks[c];
+            if (y < chunk.firstRow || y > chunk.firstRow + chunk.rows ||
+                x1 < chunk.firstColumn ||
+                x0 > chunk.firstColumn + chunk.columns)
+                continue;
+            chunkBounds[2*c].z = std::min(chunkBounds[2*c].z, lo);
+            chunkBounds[2*c+1].z = std::max(chunkBounds[2*c+1].z, hi);
+        }
+    }
+}
+
+//
+// copy of heights as they are now
+//
+TerrainSampler *Terrain::groundSnapshot() const
+{
+    return new TerrainSampler(pyramid);
+}
+
+//
+// grid layout for rebuilding positions and texture coordinates from
+// the vertex number, needs shader program in use
+//
+void Terrain::setGridUniforms()
+{
+    // mesh may still be building on another thread
+    if (! uploaded) return;
+
+    // LOD chunks all use the same small grid
+    glUniform3fv(glGetUniformLocation(shaderID, "gridSize"), 1, &gridSize[0]);
+    glUniform3fv(glGetUniformLocation(shaderID, "mapSize"), 1, &mapSize[0]);
+    glUniform1i(glGetUniformLocation(shaderID, "gridWidth"),
+                format == LOD_CHUNKS ? TerrainQuadtree::LEAF_SIZE + 1
+                                     : int(gridSize.x) + 1);
+    glUniform1i(glGetUniformLocation(shaderID, "patchSize"), PATCH_SIZE);
+    glUniform1i(glGetUniformLocation(shaderID, "patchesAcross"),
+                patchesAcross());
+}
+
+//
+// pick nodes for the current view and draw them
+// needs shader program, vertex array and textures bound
+//
+void Terrain::drawChunks(const Scene &scene, const Frustum &view)
+{
+    // camera position in world space, and pixels per world unit at
+    // distance 1 for the current projection and image height
+    const glm::vec4 &eye = scene.sdata.viewInverse[3];
+    glm::vec3 camera(eye.x, eye.y, eye.z);
+    float pixelsPerUnit = scene.sdata.projectionMat[1][1] * scene.height / 2;
+
+    float range[TerrainQuadtree::MAX_LEVELS];
+    lod.ranges(pixelsPerUnit, detailPixels, range);
+    TerrainQuadtree::CullCount cull = {0, 0};
+    lod.select(camera, range, view, selection, cull);
+    counts.chunksTested = cull.tested;
+    counts.chunksCulled = cull.culled;
+    counts.chunksDrawn = unsigned(selection.size());
+
+    GLint originLoc = glGetUniformLocation(shaderID, "nodeOrigin");
+    GLint stepLoc = glGetUniformLocation(shaderID, "nodeStep");
+    GLint morphLoc = glGetUniformLocation(shaderID, "morphRange");
+
+    // indices per quadrant
+    const unsigned int N = TerrainQuadtree::LEAF_SIZE;
+    const GLsizei quadrant = 6 * (N/2) * (N/2);
+
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, bufferIDs[INDEX_BUFFER]);
+    for(size_t n=0; n < selection.size(); ++n) {
+        const TerrainQuadtree::Selection &node = selection[n];
+
+        // morph to the next level over the far end of this level's range
+        float nearEnd = node.level ? range[node.level-1] : 0;
+        float farEnd = range[node.level];
+        float morphStart = nearEnd +
+            TerrainQuadtree::MORPH_START * (farEnd - nearEnd);
+
+        glUniform2f(originLoc, float(node.x), float(node.y));
+        glUniform1f(stepLoc, float(1u << node.level));
+        glUniform2f(morphLoc, morphStart, farEnd);
+
+        if (node.quadrants == 0xf) {
+            glDrawElements(GL_TRIANGLES, 4*quadrant, GL_UNSIGNED_SHORT, 0);
+            counts.triangles += 2*N*N;
+        }
+        else {
+            for(unsigned int q=0; q < 4; ++q) {
+                if (! (node.quadrants & (1u << q))) continue;
+                glDrawElements(GL_TRIANGLES, quadrant, GL_UNSIGNED_SHORT,
+                               (void*)(q * quadrant * sizeof(uint16_t)));
+                counts.triangles += N*N/2;
+            }
+        }
+    }
+}
+
 //
 // this is called every time the terrain needs to be redrawn 
 //
-void Terrain::draw() const
+void Terrain::draw(const Scene &scene)
 {
     // enable shaders
     glUseProgram(shaderID);
@@ -235,18 +843,162 @@ void Terrain::draw() const
         glActiveTexture(GL_TEXTURE0 + i);
         glBindTexture(GL_TEXTURE_2D, textureIDs[i]);
     }
-
-    // draw the triangles for each three indices
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, bufferIDs[INDEX_BUFFER]);
-    glDrawElements(GL_TRIANGLES, 3*numtri, GL_UNSIGNED_INT, 0);
+    glActiveTexture(GL_TEXTURE0 + NUM_TEXTURES);
+    glBindTexture(GL_TEXTURE_2D, heightTextureID);
+    glActiveTexture(GL_TEXTURE0 + NUM_TEXTURES + 1);
+    glBindTexture(GL_TEXTURE_2D, detailTextureID);
+    glActiveTexture(GL_TEXTURE0 + NUM_TEXTURES + 2);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, horizonTextureID);
+    glActiveTexture(GL_TEXTURE0 + NUM_TEXTURES + 3);
+    glBindTexture(GL_TEXTURE_2D, occlusionTextureID);
+
+    // world space view frustum
+    Frustum view(scene.sdata.projectionMat * scene.sdata.viewMat);
+    counts.chunksTested = counts.chunksCulled = counts.chunksDrawn = 0;
+    counts.triangles = 0;
+    if (format == LOD_CHUNKS)
+        drawChunks(scene, view);
+    else if (format == PROCEDURAL_GRID)
+        drawGrid(view);
+    else if (format == TESSELLATED_PATCHES)
+        drawPatches(scene, view);
+    else
+        drawMesh(view);
 
     // turn of whatever we turned on
-    for(int i=0; i<NUM_TEXTURES; ++i) {
+    for(int i=0; i<=NUM_TEXTURES+1; ++i) {
         glActiveTexture(GL_TEXTURE0 + i);
         glBindTexture(GL_TEXTURE_2D, 0);
     }
+    glActiveTexture(GL_TEXTURE0 + NUM_TEXTURES + 2);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+    glActiveTexture(GL_TEXTURE0 + NUM_TEXTURES + 3);
+    glBindTexture(GL_TEXTURE_2D, 0);
+    glActiveTexture(GL_TEXTURE0);
     glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
     glBindVertexArray(0);
     glUseProgram(0);
 }
 
+//
+// draw the mesh chunks in view
+// needs shader program and vertex array bound
+//
+void Terrain::drawMesh(const Frustum &view)
+{
+    // draw the triangles, in one call per chunk of indices
+    GLenum mode = indices.strips() ? GL_TRIANGLE_STRIP : GL_TRIANGLES;
+    GLenum type = indices.indexBytes() == 2 ? GL_UNSIGNED_SHORT
+                                            : GL_UNSIGNED_INT;
+    if (indices.strips()) {
+        glEnable(GL_PRIMITIVE_RESTART);
+        glPrimitiveRestartIndex(indices.restartIndex());
+    }
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, bufferIDs[INDEX_BUFFER]);
+    for(unsigned int c=0; c < indices.numchunk; ++c) {
+        const TerrainIndices::Chunk &chunk = indices.chunks[c];
+        ++counts.chunksTested;
+        if (view.test(chunkBounds[2*c], chunkBounds[2*c+1]) ==
+            Frustum::OUTSIDE) {
+            ++counts.chunksCulled;
+            continue;
+        }
+        ++counts.chunksDrawn;
+        counts.triangles += chunk.triangles;
+        glDrawElementsBaseVertex(mode, chunk.count, type,
+            (void*)(size_t(chunk.first) * indices.indexBytes()),
+            chunk.baseVertex);
+    }
+    if (indices.strips())
+        glDisable(GL_PRIMITIVE_RESTART);
+}
+
+
+//
+// draw each band of rows in view as instanced strips, one per row
+// needs shader program, vertex array and heights bound
+//
+void Terrain::drawGrid(const Frustum &view)
+{
+    unsigned int w = unsigned(gridSize.x), h = unsigned(gridSize.y);
+    GLint firstRowLoc = glGetUniformLocation(shaderID, "firstRow");
+    for(unsigned int y0=0, band=0; y0 < h; y0 += GRID_BAND, ++band) {
+        ++counts.chunksTested;
+        if (view.test(chunkBounds[2*band], chunkBounds[2*band+1]) ==
+            Frustum::OUTSIDE) {
+            ++counts.chunksCulled;
+            continue;
+        }
+        unsigned int rows = std::min(unsigned(GRID_BAND), h - y0);
+        ++counts.chunksDrawn;
+        counts.triangles += 2 * w * rows;
+        glUniform1i(firstRowLoc, int(y0));
+        glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, 2*(w+1), rows);
+    }
+}
+
+//
+// draw the patches in view, each one run of patches at a time, and let
+// the GPU decide how finely to divide them
+// needs shader program, vertex array, heights and patch detail bound
+//
+void Terrain::drawPatches(const Scene &scene, const Frustum &view)
+{
+    // pixels per world unit at distance 1, to size patch edges on screen
+    float pixelsPerUnit = scene.sdata.projectionMat[1][1] * scene.height / 2;
+    glUniform1f(glGetUniformLocation(shaderID, "pixelsPerUnit"),
+                pixelsPerUnit);
+    glUniform1f(glGetUniformLocation(shaderID, "tessPixels"), detailPixels);
+
+    // only the GPU knows how many triangles it made, so report the count
+    // from the latest draw it has finished, checking the oldest first,
+    // since they finish in order
+    for(unsigned int i=0; i < NUM_QUERIES; ++i) {
+        unsigned int q = (nextQuery + i) % NUM_QUERIES;
+        if (! queryPending[q])
+            continue;
+        GLuint available;
+        glGetQueryObjectuiv(primitiveQueries[q], GL_QUERY_RESULT_AVAILABLE,
+                            &available);
+        if (! available)
+            break;
+        glGetQueryObjectuiv(primitiveQueries[q], GL_QUERY_RESULT,
+                            &patchTriangles);
+        queryPending[q] = false;
+    }
+    counts.triangles = patchTriangles;
+
+    // if the GPU is so far behind that every query is still waiting,
+    // don't count this draw
+    unsigned int query = nextQuery;
+    bool counting = ! queryPending[query];
+    if (counting)
+        glBeginQuery(GL_PRIMITIVES_GENERATED, primitiveQueries[query]);
+
+    // each patch is four corners, drawn in runs of neighbours in view
+    glPatchParameteri(GL_PATCH_VERTICES, 4);
+    unsigned int numPatches = unsigned(patchDetail.size());
+    unsigned int first = 0, count = 0;
+    for(unsigned int p=0; p < numPatches; ++p) {
+        ++counts.chunksTested;
+        if (view.test(chunkBounds[2*p], chunkBounds[2*p+1]) ==
+            Frustum::OUTSIDE) {
+            ++counts.chunksCulled;
+            if (count)
+                glDrawArrays(GL_PATCHES, GLint(4*first), GLsizei(4*count));
+            count = 0;
+            continue;
+        }
+        ++counts.chunksDrawn;
+        if (! count) first = p;
+        ++count;
+    }
+    if (count)
+        glDrawArrays(GL_PATCHES, GLint(4*first), GLsizei(4*count));
+
+    if (counting) {
+        glEndQuery(GL_PRIMITIVES_GENERATED);
+        queryPending[query] = true;
+        nextQuery = (query + 1) % NUM_QUERIES;
+    }
+}
@@ -2,26 +2,114 @@
 #ifndef Terrain_hpp
 #define Terrain_hpp
 
-#define GLM_SWIZZLE
-
+#include "HeightPyramid.hpp"
 #include "Shader.hpp"
+#include "TerrainMesh.hpp"
+#include "TerrainIndices.hpp"
+#include "TerrainQuadtree.hpp"
+#include "TextureStreamer.hpp"
 #include <glm/glm.hpp>
+#include <future>
+#include <string>
+#include <vector>
+
+class Frustum;
+class Heightfield;
+class HorizonMap;
+class OcclusionMap;
+class Scene;
+class TerrainSampler;
+class ThreadPool;
 
 // terrain data and rendering methods
 class Terrain {
+// public types
+public:
+    // how vertices are given to the GPU
+    //   SEPARATE_VERTICES: float arrays for position, tangents, normal and
+    //     texture coordinate, 56 bytes per vertex
+    //   PACKED_VERTICES: interleaved TerrainMesh::PackedVertex, 8 bytes
+    //     per vertex, unpacked by terrain-packed.vert
+    //   LOD_CHUNKS: no vertex data, just the elevation in a 16-bit
+    //     texture, drawn as the TerrainQuadtree nodes picked for the view
+    //     each frame by terrain-lod.vert
+    //   PROCEDURAL_GRID: no vertex or index data, just the elevation
+    //     texture, drawn at full resolution as one instanced triangle
+    //     strip per row by terrain-grid.vert
+    //   TESSELLATED_PATCHES: the elevation texture, drawn as square
+    //     patches that the GPU subdivides according to their size on
+    //     screen and roughness, by terrain-tess.vert, .tesc and .tese
+    enum VertexFormat { SEPARATE_VERTICES, PACKED_VERTICES, LOD_CHUNKS,
+                        PROCEDURAL_GRID, TESSELLATED_PATCHES };
+
+    // what the last draw did
+    // chunks are TerrainIndices chunks, TerrainQuadtree nodes for
+    // LOD_CHUNKS, bands of GRID_BAND rows for PROCEDURAL_GRID, or patches
+    // for TESSELLATED_PATCHES, where triangles are counted by the GPU,
+    // from the latest draw it has finished
+    struct DrawStats {
+        unsigned int chunksTested;  // bounding boxes tested against view
+        unsigned int chunksCulled;  // chunks skipped as out of view
+        unsigned int chunksDrawn;   // chunks drawn
+        unsigned int triangles;     // triangles sent to the GPU
+    };
+
+    // mesh size, for SEPARATE_VERTICES and PACKED_VERTICES
+    struct MeshStats {
+        unsigned int gridTriangles; // triangles in the full grid
+        unsigned int triangles;     // triangles in the mesh as drawn
+        float maxError;             // world space height error, if simplified
+    };
+
 // private data
 private:
-    glm::vec3 gridSize;             // elevation grid size
-    glm::vec3 mapSize;              // size of terrain in world space
-
-    unsigned int numvert;       // total vertices
-    glm::vec3 *vert;                // per-vertex position
-    glm::vec3 *dPdu, *dPdv;         // per-vertex tangents
-    glm::vec3 *norm;                // per-vertex normal
-    glm::vec2 *texcoord;            // per-vertex texture coordinate
-    
-    unsigned int numtri;        // total triangles
-    glm::uvec3 *indices; // 3 vertex indices per triangle
+    TerrainMesh mesh;               // geometry
+    glm::vec3 gridSize, mapSize;    // as TerrainMesh, once uploaded
+    TerrainIndices indices;         // triangles in drawing order
+    std::vector<glm::vec3> chunkBounds; // min and max of each chunk
+    VertexFormat format;            // vertex layout on GPU
+    bool uploaded;                  // true once mesh is on the GPU
+
+    // for formats that draw from the elevation texture
+    Heightfield *heights;           // elevation, until it is uploaded
+    float detailPixels;             // screen space detail target
+
+    // for PROCEDURAL_GRID, rows of squares in each chunk
+    enum { GRID_BAND = 64 };
+
+    // for LOD_CHUNKS
+    TerrainQuadtree lod;            // chunks and their errors
+    std::vector<TerrainQuadtree::Selection> selection;  // last frame's
+
+    // for TESSELLATED_PATCHES
+    // patches of PATCH_SIZE squares, subdivided up to 64 times, which is
+    // full resolution
+    enum { PATCH_SIZE = 64 };
+    std::vector<float> patchDetail; // roughness, 1 for the roughest
+
+    // ring of GL queries counting triangles, so results can be read once
+    // the GPU has them without waiting
+    enum { NUM_QUERIES = 4 };
+    unsigned int primitiveQueries[NUM_QUERIES];
+    bool queryPending[NUM_QUERIES]; // true if query has a result to read
+    unsigned int nextQuery;         // next to use, and oldest in use
+    unsigned int patchTriangles;    // latest count read back
+
+    // for ray casts and picking, in every format
+    HeightPyramid pyramid;
+
+    // horizons for shadows and sky visibility for ambient light, read
+    // from cache or baked from the pyramid in the background, and
+    // uploaded by update() once ready
+    std::future<HorizonMap*> horizonsReady;
+    std::future<OcclusionMap*> occlusionReady;
+
+    // for editing, reused from one edit to the next
+    std::vector<TerrainMesh::Span> editSpans;           // vertices changed
+    std::vector<TerrainMesh::PackedVertex> editPacked;  // and packed
+
+    DrawStats counts;               // from last draw
+    MeshStats meshCounts;           // once uploaded
 
     // GL vertex array object IDs
     unsigned int varrayID;
@@ -29,33 +117,127 @@ private:
     // GL texture IDs
     enum {COLOR_TEXTURE, NORMAL_TEXTURE, GLOSS_TEXTURE, NUM_TEXTURES};
     unsigned int textureIDs[NUM_TEXTURES];
+    std::string textureFiles[NUM_TEXTURES];     // where each came from
+    TextureStreamer streamer;                   // for replacing textures
+    unsigned int heightTextureID;   // elevation
+    unsigned int detailTextureID;   // patchDetail, one texel per patch
+    unsigned int horizonTextureID;  // HorizonMap, a layer per direction
+    unsigned int occlusionTextureID; // OcclusionMap, sky seen from each vertex
 
     // GL buffer object IDs
+    // with PACKED_VERTICES, all vertex data is in POSITION_BUFFER
     enum {POSITION_BUFFER, TANGENT_BUFFER, BITANGENT_BUFFER, NORMAL_BUFFER, 
           UV_BUFFER, INDEX_BUFFER, NUM_BUFFERS};
     unsigned int bufferIDs[NUM_BUFFERS];
 
     // GL shaders
+    // vertex and fragment, with tessellation control and evaluation in
+    // between for TESSELLATED_PATCHES
     unsigned int shaderID;      // ID for shader program
-    ShaderInfo shaderParts[2];  // vertex & fragment shader info
+    ShaderInfo shaderParts[4];  // shader info
+    unsigned int numShaderParts;    // how many of shaderParts are used
+
+// private methods
+private:
+    // load mesh vertex and index arrays to GPU
+    void uploadMesh();
+
+    // load heights to texture, for formats that draw from it
+    void uploadHeights();
+
+    // load horizons to a texture array for shadows, then delete them
+    // with none, a single level horizon that shadows nothing
+    void uploadHorizons(HorizonMap *horizons);
+
+    // load sky visibility to a texture for ambient light, then delete it
+    // with none, a single texel of open sky
+    void uploadOcclusion(OcclusionMap *occlusion);
+
+    // tell shader the mesh grid layout, for all but SEPARATE_VERTICES
+    void setGridUniforms();
+
+    // draw the mesh, one index chunk at a time, skipping any out of view
+    void drawMesh(const Frustum &view);
+
+    // choose and draw quadtree nodes in view, for LOD_CHUNKS
+    void drawChunks(const Scene &scene, const Frustum &view);
+
+    // draw bands of rows in view, for PROCEDURAL_GRID
+    void drawGrid(const Frustum &view);
+
+    // draw patches in view, for TESSELLATED_PATCHES
+    void drawPatches(const Scene &scene, const Frustum &view);
+
+    // patches per row of the grid
+    int patchesAcross() const {
+        return (int(gridSize.x) + PATCH_SIZE - 1) / PATCH_SIZE;
+    }
 
 // public methods
 public:
     // load terrain, given elevation image and surface texture
+    // elevation can be any format Heightfield reads
+    // images are read and the mesh built using threads from pool
+    // indexLayout is a combination of TerrainIndices::Layout flags
+    // detailPixels is the largest error allowed on screen for LOD_CHUNKS,
+    // or the triangle size to aim for with TESSELLATED_PATCHES
+    // if simplifyError is above 0, SEPARATE_VERTICES and PACKED_VERTICES
+    // draw a TerrainRTIN mesh with no more than that height error in
+    // world units instead of the full grid (and ignore indexLayout but
+    // for SHORT)
     Terrain(const char *elevationPPM, const char *texturePPM,
-            const char *normalPPM, const char *glossPPM);
+            const char *normalPPM, const char *glossPPM, ThreadPool &pool,
+            VertexFormat format = SEPARATE_VERTICES,
+            unsigned int indexLayout = TerrainIndices::BLOCKS |
+                TerrainIndices::STRIPS | TerrainIndices::SHORT,
+            float detailPixels = 1, float simplifyError = 0);
 
     // clean up allocated memory
     ~Terrain();
 
-    // load/reload a texture
-    void updateTexture(const char *ppm, unsigned int textureID);
+    // reload all textures from disk in the background
+    // the old textures are used until the new ones are ready
+    void updateTextures();
+
+    // call once per frame to continue any texture reloads, and upload
+    // shadows and ambient occlusion once they are ready
+    // returns true if a texture changed, so the terrain needs redrawing
+    bool update();
+
+    // wait for anything still loading in the background and upload it,
+    // for when every frame must be complete
+    void finishLoading();
 
     // load/reload shaders
     void updateShaders();
 
-    // draw this terrain object
-    void draw() const;
+    // add delta[j*w + i] world units to the height of elevation sample
+    // x0+i, y0+j for a w x h rectangle, wrapping around the edges, and
+    // update just the vertices that change on the GPU
+    // for SEPARATE_VERTICES and PACKED_VERTICES only; a simplified mesh
+    // keeps its triangles, so its error bound is for the original heights,
+    // and shadows and ambient occlusion stay as they were for the
+    // original heights too
+    void editHeights(int x0, int y0, unsigned int w, unsigned int h,
+                     const float *delta);
+
+    // draw the parts of this terrain object in the scene's view
+    void draw(const Scene &scene);
+
+    // counts for the last draw
+    const DrawStats &drawStats() const { return counts; }
+
+    // mesh size and error, once loaded
+    const MeshStats &meshStats() const { return meshCounts; }
+
+    // heights for casting rays against the full resolution terrain, for
+    // picking and line of sight, kept up to date by editHeights
+    const HeightPyramid &heightPyramid() const { return pyramid; }
+
+    // new copy of the current heights for looking up ground height and
+    // normal, which any thread can use while the terrain is edited
+    // caller deletes it when done
+    TerrainSampler *groundSnapshot() const;
 };
 
 #endif
@@ -0,0 +1,587 @@
+//
+// TerrainBench: time and check terrain mesh building
+//
+// usage: TerrainBench [-n size]... [-b size]... [-i size]... [-r size]...
+//                     [-s size]... [-a size]... [-j threads] [heightmap]...
+//
+// Kernels: runs on each heightmap file given, or on synthetic square
+// heightfields of each -n size (default 4096 and 16384). For each vertex
+// kernel the CPU supports, it times computing every vertex row by row,
+// then compares every output float against the scalar kernel, reporting
+// the number that differ at all and the largest difference in units in
+// the last place (ULP). Rows are computed into a reused buffer rather
+// than a full mesh, so large sizes fit in memory.
+//
+// Scaling: times complete TerrainMesh builds of each heightmap file, and
+// of synthetic heightfields of each -b size (default 4096), with 1 up to
+// -j threads (default one per hardware thread), and checks that every
+// array matches the single-threaded build exactly. This needs memory for
+// two whole meshes, about 160 bytes per vertex.
+//
+// Indices: for the grid of each heightmap file, and square grids of each
+// -i size (default 1024 and 4096), builds every TerrainIndices layout and
+// reports its size and simulated vertex cache performance: ACMR (vertices
+// transformed per triangle, 0.5 at best) and ATVR (transforms per vertex,
+// 1 at best) for 16 and 32 entry FIFO caches. No GPU needed.
+//
+// Rays: for each heightmap file, and synthetic heightfields of each -r
+// size (default 1024 and 4096), builds a HeightPyramid and times casting
+// a million random rays from above the terrain at shallow angles, on one
+// thread and in batches across -j threads, in millions of rays per
+// second. A sample of the rays is also cast by walking every square they
+// cross, which must give the same hits, and is timed for comparison.
+//
+// Samples: for each heightmap file, and synthetic heightfields of each
+// -s size (default 4096), times TerrainSampler height, normal and slope
+// lookups at 4 million random points, some well off the terrain so they
+// wrap, with each kernel the CPU supports and then across -j threads,
+// comparing every output float against the scalar kernel.
+//
+// Occlusion: for each heightmap file, and synthetic heightfields of each
+// -a size (default 1024 and 2048), times OcclusionMap bakes with a 16
+// world unit radius, as Terrain uses, on 1 up to -j threads, and checks
+// that every texel matches the single-threaded bake.
+//
+
+#include "TerrainMesh.hpp"
+#include "Heightfield.hpp"
+#include "TerrainIndices.hpp"
+#include "HeightPyramid.hpp"
+#include "OcclusionMap.hpp"
+#include "TerrainSampler.hpp"
+#include "ThreadPool.hpp"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <float.h>
+#include <math.h>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+#ifdef _WIN32
+// don't complain if we use standard IO functions instead of windows-only
+#pragma warning( disable: 4996 )
+#endif
+
+// same world size Terrain uses
+static const glm::vec3 MAP_SIZE(512, 512, 50);
+
+namespace {
+    // output for one row of vertices
+    struct Row {
+        std::vector<glm::vec3> vert, dPdu, dPdv, norm;
+        std::vector<glm::vec2> texcoord;
+
+        explicit Row(unsigned int n)
+            : vert(n), dPdu(n), dPdv(n), norm(n), texcoord(n) {}
+
+        void build(const Heightfield &elevation, unsigned int y,
+                   TerrainMesh::Kernel kernel) {
+            TerrainMesh::buildRow(elevation, MAP_SIZE, y, &vert[0], &dPdu[0],
+                                  &dPdv[0], &norm[0], &texcoord[0], kernel);
+        }
+    };
+
+    // differences between two sets of floats
+    struct Diff {
+        unsigned long long count;   // floats with different bits
+        unsigned int maxULP;        // largest difference in ULP
+
+        Diff() : count(0), maxULP(0) {}
+
+        void compare(const float *a, const float *b, size_t n);
+        template <typename T>
+        void compare(const std::vector<T> &a, const std::vector<T> &b) {
+            compare(&a[0].x, &b[0].x, a.size() * sizeof(T) / sizeof(float));
+        }
+    };
+
+    //
+    // count differing floats and track largest ULP distance
+    //
+    void Diff::compare(const float *a, const float *b, size_t n)
+    {
+        for(size_t i=0; i < n; ++i) {
+            int ia, ib;
+            memcpy(&ia, &a[i], sizeof(int));
+            memcpy(&ib, &b[i], sizeof(int));
+            if (ia == ib) continue;
+            ++count;
+
+            // map sign-magnitude to ordered integers, so adjacent floats
+            // are adjacent integers, even across zero
+            long long oa = ia < 0 ? (long long)(0x80000000u - ia) : ia;
+            long long ob = ib < 0 ? (long long)(0x80000000u - ib) : ib;
+            long long ulp = oa > ob ? oa - ob : ob - oa;
+            if (ulp > maxULP) maxULP = ulp > 0xffffffff ? 0xffffffffu
+                                                        : (unsigned int)ulp;
+        }
+    }
+
+    const char *kernelName[] = { "auto", "scalar", "sse2", "avx2" };
+}
+
+//
+// rolling hills plus noise, filling the full 16-bit range
+//
+static Heightfield *synthesize(unsigned int size)
+{
+    Heightfield *elevation = new Heightfield(size, size);
+    unsigned int seed = 12345;
+    float scale = 6.2831853f / float(size);
+    for(unsigned int y=0; y < size; ++y) {
+        unsigned short *row = elevation->row(y);
+        float sy = sinf(3 * y * scale);
+        for(unsigned int x=0; x < size; ++x) {
+            seed = seed * 1664525u + 1013904223u;
+            float noise = float(seed >> 24) / 255.f;
+            float h = 0.5f + 0.3f * sinf(2 * x * scale) * sy
+                + 0.15f * sinf(17 * (x + y) * scale) + 0.04f * noise;
+            row[x] = (unsigned short)(h * 65535.f);
+        }
+    }
+    return elevation;
+}
+
+//
+// time and compare every kernel on one height field
+//
+static void benchKernels(const char *name, const Heightfield &elevation)
+{
+    unsigned int w = elevation.width, h = elevation.height;
+    double verts = double(w+1) * double(h+1);
+    printf("%s: %ux%u, %.0f vertices\n", name, w, h, verts);
+
+    Row row(w+1), ref(w+1);
+    double scalarTime = 0;
+    for(int k = TerrainMesh::KERNEL_SCALAR; k <= TerrainMesh::KERNEL_AVX2; ++k) {
+        TerrainMesh::Kernel kernel = TerrainMesh::Kernel(k);
+        if (! TerrainMesh::kernelSupported(kernel)) {
+            printf("  %-6s  not supported on this CPU\n", kernelName[k]);
+            continue;
+        }
+
+        // timing
+        std::chrono::steady_clock::time_point start =
+            std::chrono::steady_clock::now();
+        for(unsigned int y=0; y <= h; ++y)
+            row.build(elevation, y, kernel);
+        double seconds = std::chrono::duration<double>(
+            std::chrono::steady_clock::now() - start).count();
+        if (kernel == TerrainMesh::KERNEL_SCALAR) scalarTime = seconds;
+        printf("  %-6s %8.1f ms %8.1f Mvert/s  %5.2fx",
+               kernelName[k], 1000 * seconds, verts / seconds / 1e6,
+               scalarTime / seconds);
+
+        // comparison against scalar
+        if (kernel == TerrainMesh::KERNEL_SCALAR) {
+            printf("\n");
+            continue;
+        }
+        Diff diff;
+        for(unsigned int y=0; y <= h; ++y) {
+            row.build(elevation, y, kernel);
+            ref.build(elevation, y, TerrainMesh::KERNEL_SCALAR);
+            diff.compare(row.vert, ref.vert);
+            diff.compare(row.dPdu, ref.dPdu);
+            diff.compare(row.dPdv, ref.dPdv);
+            diff.compare(row.norm, ref.norm);
+            diff.compare(row.texcoord, ref.texcoord);
+        }
+        if (diff.count == 0)
+            printf("  bitwise identical\n");
+        else
+            printf("  %llu floats differ, max %u ULP\n",
+                   diff.count, diff.maxULP);
+    }
+}
+
+//
+// true if both meshes have identical arrays
+//
+static bool sameMesh(const TerrainMesh &a, const TerrainMesh &b)
+{
+    return a.numvert == b.numvert && a.numtri == b.numtri
+        && memcmp(a.vert, b.vert, a.numvert * sizeof(glm::vec3)) == 0
+        && memcmp(a.dPdu, b.dPdu, a.numvert * sizeof(glm::vec3)) == 0
+        && memcmp(a.dPdv, b.dPdv, a.numvert * sizeof(glm::vec3)) == 0
+        && memcmp(a.norm, b.norm, a.numvert * sizeof(glm::vec3)) == 0
+        && memcmp(a.texcoord, b.texcoord, a.numvert * sizeof(glm::vec2)) == 0
+        && memcmp(a.indices, b.indices, a.numtri * sizeof(glm::uvec3)) == 0;
+}
+
+//
+// time whole mesh builds on 1 to maxThreads threads
+//
+static void benchScaling(const char *name, const Heightfield &elevation,
+                         unsigned int maxThreads)
+{
+    printf("%s: %ux%u, full build\n", name, elevation.width, elevation.height);
+
+    // single threaded reference, also warms up the allocator
+    TerrainMesh serial;
+    std::chrono::steady_clock::time_point start =
+        std::chrono::steady_clock::now();
+    serial.build(elevation, MAP_SIZE);
+    double serialTime = std::chrono::duration<double>(
+        std::chrono::steady_clock::now() - start).count();
+    printf("  %2u thread  %8.1f ms   1.00x\n", 1, 1000 * serialTime);
+
+    for(unsigned int threads=2; threads <= maxThreads; ++threads) {
+        // parallelFor works on the calling thread too
+        ThreadPool pool(threads - 1);
+        TerrainMesh mesh;
+        start = std::chrono::steady_clock::now();
+        mesh.build(elevation, MAP_SIZE, &pool);
+        double seconds = std::chrono::duration<double>(
+            std::chrono::steady_clock::now() - start).count();
+        printf("  %2u threads %8.1f ms  %5.2fx  %s\n", threads,
+               1000 * seconds, serialTime / seconds,
+               sameMesh(mesh, serial) ? "identical" : "DIFFERENT");
+    }
+}
+
+//
+// name for a set of TerrainIndices::Layout flags
+//
+static const char *layoutName(unsigned int layout, char *name)
+{
+    name[0] = 0;
+    if (layout & TerrainIndices::BLOCKS) strcat(name, "+blocks");
+    if (layout & TerrainIndices::STRIPS) strcat(name, "+strips");
+    if (layout & TerrainIndices::SHORT)  strcat(name, "+short");
+    return name[0] ? name + 1 : "rows";
+}
+
+//
+// size and vertex cache statistics for every index layout
+//
+static void benchIndices(const char *name, unsigned int w, unsigned int h)
+{
+    printf("%s: %ux%u grid, index layouts\n", name, w, h);
+    printf("  %-24s %6s %9s %8s %6s %6s %6s %6s\n", "layout", "chunks",
+           "MB", "ms", "ACMR16", "ATVR16", "ACMR32", "ATVR32");
+
+    // every layout at the default block size, then blocks for a 32 cache
+    struct { unsigned int layout, blockSize; } tests[] = {
+        { 0, 0 }, { 1, 0 }, { 2, 0 }, { 3, 0 },
+        { 4, 0 }, { 5, 0 }, { 6, 0 }, { 7, 0 },
+        { 1, 14 }, { 7, 14 } };
+    for(size_t t=0; t < sizeof(tests)/sizeof(*tests); ++t) {
+        unsigned int blockSize = tests[t].blockSize
+            ? tests[t].blockSize : unsigned(TerrainIndices::BLOCK_SIZE);
+        TerrainIndices indices;
+        std::chrono::steady_clock::time_point start =
+            std::chrono::steady_clock::now();
+        indices.build(w, h, tests[t].layout, blockSize);
+        double seconds = std::chrono::duration<double>(
+            std::chrono::steady_clock::now() - start).count();
+        TerrainIndices::Stats s16 = indices.stats(16);
+        TerrainIndices::Stats s32 = indices.stats(32);
+
+        char label[64], flags[32];
+        sprintf(label, "%s", layoutName(indices.usedLayout(), flags));
+        if (tests[t].blockSize)
+            sprintf(label + strlen(label), " (%u)", blockSize);
+        printf("  %-24s %6u %9.2f %8.1f %6.3f %6.3f %6.3f %6.3f\n", label,
+               indices.numchunk,
+               double(indices.numindex) * indices.indexBytes() / (1 << 20),
+               1000 * seconds, s16.acmr, s16.atvr, s32.acmr, s32.atvr);
+    }
+}
+
+//
+// time and check ray casts against one height field
+//
+static void benchRays(const char *name, const Heightfield &elevation,
+                      unsigned int maxThreads)
+{
+    printf("%s: %ux%u, ray casts\n", name, elevation.width, elevation.height);
+
+    HeightPyramid pyramid;
+    std::chrono::steady_clock::time_point start =
+        std::chrono::steady_clock::now();
+    pyramid.build(elevation, MAP_SIZE);
+    double seconds = std::chrono::duration<double>(
+        std::chrono::steady_clock::now() - start).count();
+    printf("  build      %8.1f ms, %u levels\n", 1000 * seconds,
+           pyramid.levels);
+
+    // from just above the highest point, 2 to 30 degrees below horizontal
+    const unsigned int count = 1 << 20;
+    std::vector<HeightPyramid::Ray> rays(count);
+    std::vector<HeightPyramid::Hit> hits(count);
+    unsigned int seed = 54321;
+    for(unsigned int i=0; i < count; ++i) {
+        float r[4];
+        for(int j=0; j < 4; ++j) {
+            seed = seed * 1664525u + 1013904223u;
+            r[j] = float(seed >> 8) / float(1 << 24);
+        }
+        float heading = 6.2831853f * r[2];
+        float dip = 0.0349f + 0.4887f * r[3];
+        rays[i].origin = glm::vec3((r[0] - 0.5f) * MAP_SIZE.x,
+                                   (r[1] - 0.5f) * MAP_SIZE.y,
+                                   0.5f * MAP_SIZE.z);
+        rays[i].direction = glm::vec3(cosf(heading) * cosf(dip),
+                                      sinf(heading) * cosf(dip), -sinf(dip));
+        rays[i].minT = 0;
+        rays[i].maxT = FLT_MAX;
+    }
+
+    // one thread, then batches across the pool
+    start = std::chrono::steady_clock::now();
+    for(unsigned int i=0; i < count; ++i)
+        pyramid.cast(rays[i], hits[i]);
+    double serialTime = std::chrono::duration<double>(
+        std::chrono::steady_clock::now() - start).count();
+    unsigned int hitCount = 0;
+    for(unsigned int i=0; i < count; ++i)
+        hitCount += hits[i].hit;
+    printf("  %2u thread  %8.1f ms %8.2f Mrays/s  %4.1f%% hit\n", 1,
+           1000 * serialTime, count / serialTime / 1e6,
+           100. * hitCount / count);
+
+    if (maxThreads > 1) {
+        ThreadPool pool(maxThreads - 1);
+        start = std::chrono::steady_clock::now();
+        pyramid.cast(&rays[0], &hits[0], count, &pool);
+        seconds = std::chrono::duration<double>(
+            std::chrono::steady_clock::now() - start).count();
+        printf("  %2u threads %8.1f ms %8.2f Mrays/s  %5.2fx\n", maxThreads,
+               1000 * seconds, count / seconds / 1e6, serialTime / seconds);
+    }
+
+    // every square along a sample of the rays, which must agree
+    const unsigned int sample = count / 64;
+    std::vector<HeightPyramid::Hit> walked(sample);
+    start = std::chrono::steady_clock::now();
+    for(unsigned int i=0; i < sample; ++i)
+        pyramid.castSquares(rays[i], walked[i]);
+    seconds = std::chrono::duration<double>(
+        std::chrono::steady_clock::now() - start).count();
+    unsigned int differ = 0;
+    for(unsigned int i=0; i < sample; ++i) {
+        const HeightPyramid::Hit &a = hits[i], &b = walked[i];
+        if (a.hit != b.hit || (a.hit && (a.cellX != b.cellX ||
+                                         a.cellY != b.cellY ||
+                                         fabsf(a.t - b.t) > 1e-4f * b.t)))
+            ++differ;
+    }
+    printf("  squares    %8.1f ms %8.2f Mrays/s  %5.2fx slower, "
+           "%u of %u differ\n", 1000 * seconds, sample / seconds / 1e6,
+           seconds / sample / (serialTime / count), differ, sample);
+}
+
+//
+// time and compare TerrainSampler kernels on one height field
+//
+static void benchSamples(const char *name, const Heightfield &elevation,
+                         unsigned int maxThreads)
+{
+    printf("%s: %ux%u, ground samples\n", name, elevation.width,
+           elevation.height);
+    TerrainSampler sampler(elevation, MAP_SIZE);
+
+    // anywhere on the terrain or one terrain size around it
+    const unsigned int count = 1 << 22;
+    std::vector<glm::vec2> xy(count);
+    unsigned int seed = 97531;
+    for(unsigned int i=0; i < count; ++i) {
+        float r[2];
+        for(int j=0; j < 2; ++j) {
+            seed = seed * 1664525u + 1013904223u;
+            r[j] = float(seed >> 8) / float(1 << 24);
+        }
+        float spread = i % 4 ? 1.f : 3.f;
+        xy[i] = glm::vec2((r[0] - 0.5f) * spread * MAP_SIZE.x,
+                          (r[1] - 0.5f) * spread * MAP_SIZE.y);
+    }
+
+    std::vector<float> height(count), slope(count);
+    std::vector<glm::vec3> normal(count);
+    std::vector<float> refHeight(count), refSlope(count);
+    std::vector<glm::vec3> refNormal(count);
+    double scalarTime = 0;
+    for(int k = TerrainMesh::KERNEL_SCALAR; k <= TerrainMesh::KERNEL_AVX2; ++k) {
+        TerrainMesh::Kernel kernel = TerrainMesh::Kernel(k);
+        if (! TerrainMesh::kernelSupported(kernel)) {
+            printf("  %-6s  not supported on this CPU\n", kernelName[k]);
+            continue;
+        }
+        bool scalar = kernel == TerrainMesh::KERNEL_SCALAR;
+
+        std::chrono::steady_clock::time_point start =
+            std::chrono::steady_clock::now();
+        sampler.sample(&xy[0], count, scalar ? &refHeight[0] : &height[0],
+                       scalar ? &refNormal[0] : &normal[0],
+                       scalar ? &refSlope[0] : &slope[0], 0, kernel);
+        double seconds = std::chrono::duration<double>(
+            std::chrono::steady_clock::now() - start).count();
+        if (scalar) scalarTime = seconds;
+        printf("  %-6s %8.1f ms %8.1f Msamples/s  %5.2fx", kernelName[k],
+               1000 * seconds, count / seconds / 1e6, scalarTime / seconds);
+
+        if (scalar) {
+            printf("\n");
+            continue;
+        }
+        Diff diff;
+        diff.compare(&height[0], &refHeight[0], count);
+        diff.compare(normal, refNormal);
+        diff.compare(&slope[0], &refSlope[0], count);
+        if (diff.count == 0)
+            printf("  bitwise identical\n");
+        else
+            printf("  %llu floats differ, max %u ULP\n",
+                   diff.count, diff.maxULP);
+    }
+
+    if (maxThreads > 1) {
+        ThreadPool pool(maxThreads - 1);
+        std::chrono::steady_clock::time_point start =
+            std::chrono::steady_clock::now();
+        sampler.sample(&xy[0], count, &height[0], &normal[0], &slope[0],
+                       &pool);
+        double seconds = std::chrono::duration<double>(
+            std::chrono::steady_clock::now() - start).count();
+        printf("  %2u threads%5.1f ms %8.1f Msamples/s  %5.2fx\n",
+               maxThreads, 1000 * seconds, count / seconds / 1e6,
+               scalarTime / seconds);
+    }
+}
+
+//
+// time ambient occlusion bakes on 1 to maxThreads threads
+//
+static void benchOcclusion(const char *name, const Heightfield &elevation,
+                           unsigned int maxThreads)
+{
+    printf("%s: %ux%u, occlusion bake\n", name, elevation.width,
+           elevation.height);
+    HeightPyramid pyramid;
+    pyramid.build(elevation, MAP_SIZE);
+
+    OcclusionMap serial;
+    std::chrono::steady_clock::time_point start =
+        std::chrono::steady_clock::now();
+    serial.build(pyramid, 16);
+    double serialTime = std::chrono::duration<double>(
+        std::chrono::steady_clock::now() - start).count();
+    double texels = double(serial.width) * double(serial.height);
+    printf("  %2u thread  %8.1f ms %8.2f Mtexel/s   1.00x\n", 1,
+           1000 * serialTime, texels / serialTime / 1e6);
+
+    for(unsigned int threads=2; threads <= maxThreads; ++threads) {
+        ThreadPool pool(threads - 1);
+        OcclusionMap occlusion;
+        start = std::chrono::steady_clock::now();
+        occlusion.build(pyramid, 16, &pool);
+        double seconds = std::chrono::duration<double>(
+            std::chrono::steady_clock::now() - start).count();
+        printf("  %2u threads %8.1f ms %8.2f Mtexel/s  %5.2fx  %s\n",
+               threads, 1000 * seconds, texels / seconds / 1e6,
+               serialTime / seconds,
+               occlusion.visibility == serial.visibility ? "identical"
+                                                         : "DIFFERENT");
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    std::vector<unsigned int> sizes, buildSizes, indexSizes, raySizes;
+    std::vector<unsigned int> sampleSizes, occlusionSizes;
+    unsigned int maxThreads = std::thread::hardware_concurrency();
+    int arg = 1;
+    for(; arg < argc && argv[arg][0] == '-'; ++arg) {
+        if (strcmp(argv[arg], "-n") == 0 && arg+1 < argc && atoi(argv[arg+1]) > 0)
+            sizes.push_back(atoi(argv[++arg]));
+        else if (strcmp(argv[arg], "-b") == 0 && arg+1 < argc && atoi(argv[arg+1]) > 0)
+            buildSizes.push_back(atoi(argv[++arg]));
+        else if (strcmp(argv[arg], "-i") == 0 && arg+1 < argc && atoi(argv[arg+1]) > 0)
+            indexSizes.push_back(atoi(argv[++arg]));
+        else if (strcmp(argv[arg], "-r") == 0 && arg+1 < argc && atoi(argv[arg+1]) > 0)
+            raySizes.push_back(atoi(argv[++arg]));
+        else if (strcmp(argv[arg], "-s") == 0 && arg+1 < argc && atoi(argv[arg+1]) > 0)
+            sampleSizes.push_back(atoi(argv[++arg]));
+        else if (strcmp(argv[arg], "-a") == 0 && arg+1 < argc && atoi(argv[arg+1]) > 0)
+            occlusionSizes.push_back(atoi(argv[++arg]));
+        else if (strcmp(argv[arg], "-j") == 0 && arg+1 < argc && atoi(argv[arg+1]) > 0)
+            maxThreads = atoi(argv[++arg]);
+        else {
+            fprintf(stderr, "usage: %s [-n size]... [-b size]... [-i size]... "
+                    "[-r size]... [-s size]... [-a size]...\n"
+                    "    [-j threads] [heightmap]...\n", argv[0]);
+            return 1;
+        }
+    }
+    if (arg == argc && sizes.empty() && buildSizes.empty() &&
+        indexSizes.empty() && raySizes.empty() && sampleSizes.empty() &&
+        occlusionSizes.empty()) {
+        sizes.push_back(4096);
+        sizes.push_back(16384);
+        buildSizes.push_back(4096);
+        indexSizes.push_back(1024);
+        indexSizes.push_back(4096);
+        raySizes.push_back(1024);
+        raySizes.push_back(4096);
+        sampleSizes.push_back(4096);
+        occlusionSizes.push_back(1024);
+        occlusionSizes.push_back(2048);
+    }
+    if (maxThreads < 1) maxThreads = 1;
+
+    for(; arg < argc; ++arg) {
+        Heightfield elevation(argv[arg]);
+        benchKernels(argv[arg], elevation);
+        benchScaling(argv[arg], elevation, maxThreads);
+        benchIndices(argv[arg], elevation.width, elevation.height);
+        benchRays(argv[arg], elevation, maxThreads);
+        benchSamples(argv[arg], elevation, maxThreads);
+        benchOcclusion(argv[arg], elevation, maxThreads);
+    }
+
+    char name[32];
+    for(size_t i=0; i < sizes.size(); ++i) {
+        sprintf(name, "synthetic %u", sizes[i]);
+        Heightfield *elevation = synthesize(sizes[i]);
+        benchKernels(name, *elevation);
+        delete elevation;
+    }
+
+    for(size_t i=0; i < buildSizes.size(); ++i) {
+        sprintf(name, "synthetic %u", buildSizes[i]);
+        Heightfield *elevation = synthesize(buildSizes[i]);
+        benchScaling(name, *elevation, maxThreads);
+        delete elevation;
+    }
+
+    for(size_t i=0; i < indexSizes.size(); ++i) {
+        sprintf(name, "synthetic %u", indexSizes[i]);
+        benchIndices(name, indexSizes[i], indexSizes[i]);
+    }
+
+    for(size_t i=0; i < raySizes.size(); ++i) {
+        sprintf(name, "synthetic %u", raySizes[i]);
+        Heightfield *elevation = synthesize(raySizes[i]);
+        benchRays(name, *elevation, maxThreads);
+        delete elevation;
+    }
+
+    for(size_t i=0; i < sampleSizes.size(); ++i) {
+        sprintf(name, "synthetic %u", sampleSizes[i]);
+        Heightfield *elevation = synthesize(sampleSizes[i]);
+        benchSamples(name, *elevation, maxThreads);
+        delete elevation;
+    }
+
+    for(size_t i=0; i < occlusionSizes.size(); ++i) {
+        sprintf(name, "synthetic %u", occlusionSizes[i]);
+        Heightfield *elevation = synthesize(occlusionSizes[i]);
+        benchOcclusion(name, *elevation, maxThreads);
+        delete elevation;
+    }
+
+    return 0;
+}
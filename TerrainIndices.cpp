@@ -0,0 +1,275 @@
+// index buffer layouts for drawing a terrain grid
+
+#include "TerrainIndices.hpp"
+#include "TerrainRTIN.hpp"
+#include <string.h>
+#include <algorithm>
+
+namespace {
+    // block position and its place along the Morton curve
+    struct Block {
+        uint32_t key;               // x and y bits interleaved
+        unsigned int x, y;          // block column and row
+        bool operator<(const Block &b) const { return key < b.key; }
+    };
+
+    // spread the low 16 bits of v out to the even bits
+    uint32_t spreadBits(uint32_t v)
+    {
+        v &= 0xffff;
+        v = (v | (v << 8)) & 0x00ff00ff;
+        v = (v | (v << 4)) & 0x0f0f0f0f;
+        v = (v | (v << 2)) & 0x33333333;
+        v = (v | (v << 1)) & 0x55555555;
+        return v;
+    }
+}
+
+//
+// free arrays
+//
+void TerrainIndices::clear()
+{
+    delete[] index16;
+    delete[] index32;
+    delete[] chunks;
+    index16 = 0;  index32 = 0;  chunks = 0;
+    numindex = numchunk = 0;
+    layout = ROWS;
+    maxError = 0;
+}
+
+//
+// build index and chunk arrays
+//
+void TerrainIndices::build(unsigned int w, unsigned int h,
+                           unsigned int requested, unsigned int blockSize)
+{
+    clear();
+    layout = requested;
+    unsigned int rowLength = w + 1;
+
+    // squares per chunk: all of them, unless we need to keep the vertex
+    // numbers in each chunk below the 16-bit restart index
+    unsigned int chunkRows = h;
+    if (layout & SHORT) {
+        unsigned int vertexRows = 0xffff / rowLength;
+        if (vertexRows >= 2 && vertexRows - 1 < h)
+            chunkRows = vertexRows - 1;
+        else if (vertexRows < 2)
+            layout &= ~SHORT;
+    }
+
+    // block size, with whole chunks of rows as one block for ROWS
+    unsigned int blockW = w, blockH = chunkRows;
+    if (layout & BLOCKS) {
+        blockW = blockSize < w ? blockSize : w;
+        blockH = blockSize < chunkRows ? blockSize : chunkRows;
+        if (chunkRows < h)          // whole blocks per chunk
+            chunkRows = chunkRows / blockH * blockH;
+    }
+
+    uint32_t restart = (layout & SHORT) ? 0xffff : 0xffffffff;
+    std::vector<uint32_t> index;
+    std::vector<Chunk> chunkList;
+    index.reserve((layout & STRIPS) ? size_t(w*2 + 4) * h : size_t(w) * h * 6);
+    std::vector<Block> blocks;
+    for(unsigned int chunkY=0; chunkY < h; chunkY += chunkRows) {
+        unsigned int chunkEnd = std::min(chunkY + chunkRows, h);
+        Chunk chunk;
+        chunk.first = (unsigned int)index.size();
+        chunk.baseVertex = (layout & SHORT) ? chunkY * rowLength : 0;
+        chunk.firstRow = chunkY;
+        chunk.rows = chunkEnd - chunkY;
+        chunk.firstColumn = 0;
+        chunk.columns = w;
+        chunk.triangles = 2 * w * chunk.rows;
+
+        // blocks of this chunk in Morton order
+        blocks.clear();
+        for(unsigned int by=0; by*blockH < chunkEnd - chunkY; ++by) {
+            for(unsigned int bx=0; bx*blockW < w; ++bx) {
+                Block b = { spreadBits(bx) | spreadBits(by) << 1, bx, by };
+                blocks.push_back(b);
+            }
+        }
+        std::sort(blocks.begin(), blocks.end());
+
+        for(size_t b=0; b < blocks.size(); ++b) {
+            unsigned int x0 = blocks[b].x * blockW;
+            unsigned int x1 = std::min(x0 + blockW, w);
+            unsigned int y0 = chunkY + blocks[b].y * blockH;
+            unsigned int y1 = std::min(y0 + blockH, chunkEnd);
+            for(unsigned int y=y0; y < y1; ++y) {
+                // vertex numbers for this row and the next
+                uint32_t v0 = y * rowLength - chunk.baseVertex;
+                uint32_t v1 = v0 + rowLength;
+
+                if (layout & STRIPS) {
+                    // alternate next row and this row, which gives the
+                    // same counter-clockwise triangles as below
+                    for(unsigned int x=x0; x <= x1; ++x) {
+                        index.push_back(v1 + x);
+                        index.push_back(v0 + x);
+                    }
+                    index.push_back(restart);
+                }
+                else {
+                    for(unsigned int x=x0; x < x1; ++x) {
+                        index.push_back(v0 + x);
+                        index.push_back(v0 + x+1);
+                        index.push_back(v1 + x+1);
+
+                        index.push_back(v0 + x);
+                        index.push_back(v1 + x+1);
+                        index.push_back(v1 + x);
+                    }
+                }
+            }
+        }
+
+        chunk.count = (unsigned int)index.size() - chunk.first;
+        chunkList.push_back(chunk);
+    }
+
+    store(index, chunkList);
+}
+
+//
+// build index and chunk arrays from simplified tiles
+//
+void TerrainIndices::buildSimplified(const TerrainMesh &mesh,
+                                     const TerrainRTIN &rtin, float bound,
+                                     unsigned int requested)
+{
+    clear();
+
+    // 16-bit if every vertex of a tile is within reach of its first
+    unsigned int rowLength = rtin.width + 1;
+    layout = requested & SHORT;
+    if (rtin.tileSize * rowLength + rtin.tileSize >= 0xffff)
+        layout = ROWS;
+
+    std::vector<uint32_t> index;
+    std::vector<Chunk> chunkList;
+    for(unsigned int ty=0; ty < rtin.tilesY; ++ty) {
+        for(unsigned int tx=0; tx < rtin.tilesX; ++tx) {
+            Chunk chunk;
+            chunk.first = (unsigned int)index.size();
+            chunk.firstRow = ty * rtin.tileSize;
+            chunk.rows = rtin.tileSize;
+            chunk.firstColumn = tx * rtin.tileSize;
+            chunk.columns = rtin.tileSize;
+            chunk.baseVertex = (layout & SHORT)
+                ? chunk.firstRow * rowLength + chunk.firstColumn : 0;
+
+            maxError = std::max(maxError,
+                                rtin.extract(mesh, tx, ty, bound, index));
+            for(size_t i=chunk.first; i < index.size(); ++i)
+                index[i] -= chunk.baseVertex;
+
+            chunk.count = (unsigned int)index.size() - chunk.first;
+            chunk.triangles = chunk.count / 3;
+            chunkList.push_back(chunk);
+        }
+    }
+
+    store(index, chunkList);
+}
+
+//
+// copy out at final size
+// either list can be empty, and [0] of an empty vector is undefined
+//
+void TerrainIndices::store(const std::vector<uint32_t> &index,
+                           const std::vector<Chunk> &chunkList)
+{
+    numindex = (unsigned int)index.size();
+    if (layout & SHORT) {
+        index16 = new uint16_t[numindex];
+        for(unsigned int i=0; i < numindex; ++i)
+            index16[i] = uint16_t(index[i]);
+    }
+    else {
+        index32 = new uint32_t[numindex];
+        if (numindex)
+            memcpy(index32, &index[0], numindex * sizeof(uint32_t));
+    }
+    numchunk = (unsigned int)chunkList.size();
+    chunks = new Chunk[numchunk];
+    if (numchunk)
+        memcpy(chunks, &chunkList[0], numchunk * sizeof(Chunk));
+}
+
+//
+// FIFO vertex cache simulation
+//
+TerrainIndices::Stats TerrainIndices::stats(unsigned int cacheSize) const
+{
+    Stats s;
+    s.triangles = s.vertices = s.transforms = 0;
+
+    // vertex is in cache if it was loaded within the last cacheSize misses
+    unsigned int maxVertex = 0;
+    for(unsigned int c=0; c < numchunk; ++c)
+        for(unsigned int i=chunks[c].first; i < chunks[c].first + chunks[c].count; ++i) {
+            unsigned int v = index16 ? index16[i] : index32[i];
+            if (v != restartIndex() && v + chunks[c].baseVertex > maxVertex)
+                maxVertex = v + chunks[c].baseVertex;
+        }
+    const uint64_t NEVER = ~uint64_t(0);
+    std::vector<uint64_t> loaded(maxVertex + 1, NEVER);
+
+    for(unsigned int c=0; c < numchunk; ++c) {
+        // each draw starts with an empty cache
+        uint64_t drawStart = s.transforms;
+        unsigned int run = 0;       // indices since last restart
+        for(unsigned int i=chunks[c].first; i < chunks[c].first + chunks[c].count; ++i) {
+            unsigned int v = index16 ? index16[i] : index32[i];
+            if (strips() && v == restartIndex()) {
+                run = 0;
+                continue;
+            }
+
+            v += chunks[c].baseVertex;
+            if (loaded[v] == NEVER)
+                ++s.vertices;
+            if (loaded[v] == NEVER || loaded[v] < drawStart ||
+                s.transforms - loaded[v] >= cacheSize)
+                loaded[v] = s.transforms++;
+
+            ++run;
+            if (strips() ? run >= 3 : run % 3 == 0)
+                ++s.triangles;
+        }
+    }
+
+    s.acmr = s.triangles ? double(s.transforms) / double(s.triangles) : 0;
+    s.atvr = s.vertices ? double(s.transforms) / double(s.vertices) : 0;
+    return s;
+}
+
+//
+// parse names separated by +
+//
+int TerrainIndices::parseLayout(const char *name)
+{
+    static const char *names[] = { "rows", "blocks", "strips", "short" };
+    static const int flags[] = { ROWS, BLOCKS, STRIPS, SHORT };
+
+    int result = ROWS;
+    while (*name) {
+        size_t len = strcspn(name, "+");
+        unsigned int n=0;
+        for(; n < sizeof(names)/sizeof(*names); ++n)
+            if (strlen(names[n]) == len && strncmp(name, names[n], len) == 0)
+                break;
+        if (n == sizeof(names)/sizeof(*names))
+            return -1;
+        result |= flags[n];
+
+        name += len;
+        if (*name == '+') ++name;
+    }
+    return result;
+}
@@ -0,0 +1,131 @@
+// index buffer layouts for drawing a terrain grid
+// CPU only, so it can be built on any thread
+//
+// The grid has (w+1) x (h+1) vertices in row-major order, as TerrainMesh
+// builds them, and w x h squares of two triangles each. The same
+// triangles can be given to the GPU in several ways:
+//   ROWS: row after row, just like TerrainMesh::indices
+//   BLOCKS: in square blocks small enough for the post-transform vertex
+//     cache, taken in Morton (Z) order, so each vertex is transformed
+//     about once instead of twice
+//   STRIPS: triangle strips, one per row of a block (or whole row),
+//     separated by a primitive restart index, about 1 index per triangle
+//     instead of 3
+//   SHORT: 16-bit indices, with the grid split into chunks of rows small
+//     enough to be drawn with glDrawElementsBaseVertex. Ignored if even
+//     two rows have too many vertices.
+// Layouts can be measured without a GPU by simulating a FIFO vertex cache
+// (see stats).
+//
+// Alternatively, buildSimplified draws just the triangles of a
+// TerrainRTIN that stay within an error bound, using the same vertices.
+#ifndef TerrainIndices_hpp
+#define TerrainIndices_hpp
+
+#include <stdint.h>
+#include <vector>
+
+struct TerrainMesh;
+class TerrainRTIN;
+
+class TerrainIndices {
+// public types
+public:
+    // layout flags, combined with |
+    enum Layout { ROWS = 0, BLOCKS = 1, STRIPS = 2, SHORT = 4 };
+
+    // default squares per block side
+    // Two rows of a block must fit in the vertex cache at once, so the
+    // best size is a little under half the cache size. 6 suits caches of
+    // 16 or more; a cache of 32 does better with 14. Past that, ACMR
+    // jumps back up to the 1.0 of ROWS.
+    enum { BLOCK_SIZE = 6 };
+
+    // part of the index array drawn with one call
+    struct Chunk {
+        unsigned int first;         // first index in array
+        unsigned int count;         // number of indices
+        unsigned int baseVertex;    // added to every index
+        unsigned int firstRow;      // first row of squares covered
+        unsigned int rows;          // rows of squares covered
+        unsigned int firstColumn;   // first column of squares covered
+        unsigned int columns;       // columns of squares covered
+        unsigned int triangles;     // triangles drawn
+    };
+
+    // vertex cache simulation results
+    struct Stats {
+        uint64_t triangles;         // triangles drawn
+        uint64_t vertices;          // different vertices used
+        uint64_t transforms;        // cache misses
+        double acmr;                // transforms per triangle, >= 0.5
+        double atvr;                // transforms per vertex, >= 1
+    };
+
+// private data
+private:
+    unsigned int layout;        // Layout flags actually used
+
+    // no copying
+    TerrainIndices(const TerrainIndices &);
+    TerrainIndices &operator=(const TerrainIndices &);
+
+    // copy index and chunk lists to the final arrays
+    void store(const std::vector<uint32_t> &index,
+               const std::vector<Chunk> &chunkList);
+
+// public data
+public:
+    unsigned int numindex;      // total indices
+    uint16_t *index16;          // indices if SHORT, otherwise NULL
+    uint32_t *index32;          // indices if not SHORT, otherwise NULL
+
+    unsigned int numchunk;      // total chunks
+    Chunk *chunks;              // draw calls, first to last
+
+    float maxError;             // world space height error, if simplified
+
+// public methods
+public:
+    // create empty
+    TerrainIndices() : layout(ROWS), numindex(0), index16(0), index32(0),
+                       numchunk(0), chunks(0), maxError(0) {}
+
+    // free arrays
+    ~TerrainIndices() { clear(); }
+
+    // free arrays and return to empty
+    void clear();
+
+    // build indices for a grid of w x h squares with the given Layout
+    void build(unsigned int w, unsigned int h, unsigned int layout,
+               unsigned int blockSize = BLOCK_SIZE);
+
+    // build indices for the triangles of mesh within bound of the grid,
+    // in world units, one chunk per tile of rtin, which must be built
+    // for mesh. Only the SHORT flag of layout is used, and only if the
+    // tiles are small enough. Sets maxError to the largest error found.
+    void buildSimplified(const TerrainMesh &mesh, const TerrainRTIN &rtin,
+                         float bound, unsigned int layout);
+
+    // layout used by last build, which may leave out SHORT
+    unsigned int usedLayout() const { return layout; }
+
+    // draw as triangle strips if true, or separate triangles
+    bool strips() const { return (layout & STRIPS) != 0; }
+
+    // bytes per index
+    unsigned int indexBytes() const { return index16 ? 2 : 4; }
+
+    // index value that separates strips
+    unsigned int restartIndex() const { return index16 ? 0xffff : 0xffffffff; }
+
+    // simulate drawing every chunk through a FIFO vertex cache holding
+    // cacheSize vertices
+    Stats stats(unsigned int cacheSize) const;
+
+    // layout for a name like "blocks+strips+short", or -1 if unknown
+    static int parseLayout(const char *name);
+};
+
+#endif
@@ -0,0 +1,654 @@
+// build terrain geometry from a height field
+
+#include "TerrainMesh.hpp"
+#include "CacheFile.hpp"
+#include "Hash.hpp"
+#include "Heightfield.hpp"
+#include "Simd.hpp"
+#include "ThreadPool.hpp"
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+
+namespace {
+    // bytes in each mesh array, in cache file order
+    void arrayBytes(uint64_t numvert, uint64_t numtri, uint64_t bytes[6])
+    {
+        bytes[0] = bytes[1] = bytes[2] = bytes[3] = numvert * sizeof(glm::vec3);
+        bytes[4] = numvert * sizeof(glm::vec2);
+        bytes[5] = numtri * sizeof(glm::uvec3);
+    }
+}
+
+//
+// free arrays
+//
+void TerrainMesh::clear()
+{
+    // arrays from a cache are part of the mapping
+    if (cache.mapped())
+        cache.unmap();
+    else {
+        delete[] indices;
+        delete[] texcoord;
+        delete[] norm;
+        delete[] dPdv;
+        delete[] dPdu;
+        delete[] vert;
+    }
+
+    numvert = numtri = 0;
+    vert = dPdu = dPdv = norm = 0;
+    texcoord = 0;
+    indices = 0;
+}
+
+//
+// vertex data for columns x0 <= x < x1 of grid row y, one at a time
+// this is the reference the SIMD kernels must match
+//
+static void rowScalar(const Heightfield &elevation, const glm::vec3 &mapSize,
+                      unsigned int y, unsigned int x0, unsigned int x1,
+                      glm::vec3 *vert, glm::vec3 *dPdu, glm::vec3 *dPdv,
+                      glm::vec3 *norm, glm::vec2 *texcoord)
+{
+    unsigned int w = elevation.width, h = elevation.height;
+    glm::vec3 gridSize(float(w), float(h), float(elevation.maxval));
+
+    for(unsigned int x=x0;  x < x1;  ++x) {
+        // 3d vertex location: x,y from grid location, z from terrain data
+        vert[x] = (glm::vec3(float(x), float(y), float(elevation(x%w, y%h)))
+                   / gridSize - 0.5f) * mapSize;
+
+        // compute normal & tangents from partial derivatives:
+        //   position =
+        //     (u / gridSize.x - .5) * mapSize.x
+        //     (v / gridSize.y - .5) * mapSize.y
+        //     (elevation / gridSize.z - .5) * mapSize.z
+        //   the u-tangent is the per-component partial derivative by u:
+        //      mapSize.x / gridSize.x
+        //      0
+        //      d(elevation(u,v))/du * mapSize.z / gridSize.z
+        //   the v-tangent is the partial derivative by v
+        //      0
+        //      mapSize.y / gridSize.y
+        //      d(elevation(u,v))/du * mapSize.z / gridSize.z
+        //   the normal is the cross product of these
+
+        // first approximate du = d(elevation(u,v))/du (and dv)
+        // be careful to wrap indices to 0 <= x < w and 0 <= y < h
+        float du = (elevation((x+1)%w, y%h) - elevation((x+w-1)%w, y%h))
+            * 0.5f * mapSize.z / gridSize.z;
+        float dv = (elevation(x%w, (y+1)%h) - elevation(x%w, (y+h-1)%h))
+            * 0.5f * mapSize.z / gridSize.z;
+
+        // final tangents and normal using these
+        dPdu[x] = glm::normalize(glm::vec3(mapSize.x/gridSize.x, 0, du));
+        dPdv[x] = glm::normalize(glm::vec3(0, mapSize.y/gridSize.y, dv));
+        norm[x] = glm::normalize(glm::cross(dPdu[x], dPdv[x]));
+
+        // 2D texture coordinate for rocks texture, from grid location
+        texcoord[x] = glm::vec2(float(x),float(y)) / gridSize.xy;
+    }
+}
+
+#ifdef USE_SSE2
+//
+// store x,y,z vectors for 4 vertices as 4 consecutive vec3
+//
+static inline void storeXYZ(glm::vec3 *out, __m128 x, __m128 y, __m128 z)
+{
+    __m128 xy01 = _mm_unpacklo_ps(x, y);                    // x0 y0 x1 y1
+    __m128 xy23 = _mm_unpackhi_ps(x, y);                    // x2 y2 x3 y3
+    __m128 z0x1 = _mm_shuffle_ps(z, x, _MM_SHUFFLE(1,1,0,0));
+    __m128 y1z1 = _mm_shuffle_ps(xy01, z, _MM_SHUFFLE(1,1,3,3));
+    __m128 z2x3 = _mm_shuffle_ps(z, xy23, _MM_SHUFFLE(3,2,3,2));
+    float *f = &out[0].x;
+    _mm_storeu_ps(f,   _mm_shuffle_ps(xy01, z0x1, _MM_SHUFFLE(2,0,1,0)));
+    _mm_storeu_ps(f+4, _mm_shuffle_ps(y1z1, xy23, _MM_SHUFFLE(1,0,2,0)));
+    _mm_storeu_ps(f+8, _mm_shuffle_ps(z2x3, z2x3, _MM_SHUFFLE(1,3,2,0)));
+}
+
+//
+// store s,t vectors for 4 vertices as 4 consecutive vec2
+//
+static inline void storeST(glm::vec2 *out, __m128 s, __m128 t)
+{
+    float *f = &out[0].x;
+    _mm_storeu_ps(f,   _mm_unpacklo_ps(s, t));
+    _mm_storeu_ps(f+4, _mm_unpackhi_ps(s, t));
+}
+
+//
+// 4 elevation samples as float, and the difference of two sets of 4
+//
+static inline __m128 load4(const unsigned short *p)
+{
+    __m128i v = _mm_loadl_epi64((const __m128i*)p);
+    return _mm_cvtepi32_ps(_mm_unpacklo_epi16(v, _mm_setzero_si128()));
+}
+static inline __m128 diff4(const unsigned short *a, const unsigned short *b)
+{
+    __m128i zero = _mm_setzero_si128();
+    __m128i va = _mm_unpacklo_epi16(_mm_loadl_epi64((const __m128i*)a), zero);
+    __m128i vb = _mm_unpacklo_epi16(_mm_loadl_epi64((const __m128i*)b), zero);
+    return _mm_cvtepi32_ps(_mm_sub_epi32(va, vb));
+}
+
+//
+// vertex data for grid row y, 4 vertices at a time with SSE2
+// Only the interior columns, where no neighbor wraps, are done with SIMD.
+// Every operation is done in the same order as rowScalar, including
+// those with a zero component, so the results are bit-for-bit the same
+// (as long as the compiler doesn't fuse the scalar multiplies and adds).
+//
+static void rowSSE2(const Heightfield &elevation, const glm::vec3 &mapSize,
+                    unsigned int y, glm::vec3 *vert, glm::vec3 *dPdu,
+                    glm::vec3 *dPdv, glm::vec3 *norm, glm::vec2 *texcoord)
+{
+    unsigned int w = elevation.width, h = elevation.height;
+    glm::vec3 gridSize(float(w), float(h), float(elevation.maxval));
+    const unsigned short *center = elevation.row(y%h);
+    const unsigned short *above = elevation.row((y+1)%h);
+    const unsigned short *below = elevation.row((y+h-1)%h);
+
+    // per-row constants, computed just as rowScalar does
+    float vy = (float(y) / gridSize.y - 0.5f) * mapSize.y;
+    float ty = float(y) / gridSize.y;
+    float ux = mapSize.x / gridSize.x, uy = 0;
+    float vx = 0, vyt = mapSize.y / gridSize.y;
+
+    __m128 half = _mm_set1_ps(0.5f), one = _mm_set1_ps(1.f);
+    __m128 gsx = _mm_set1_ps(gridSize.x), gsz = _mm_set1_ps(gridSize.z);
+    __m128 msx = _mm_set1_ps(mapSize.x), msz = _mm_set1_ps(mapSize.z);
+    __m128 Ux = _mm_set1_ps(ux), Uy = _mm_set1_ps(uy);
+    __m128 Vx = _mm_set1_ps(vx), Vy = _mm_set1_ps(vyt);
+    __m128 Py = _mm_set1_ps(vy), Ty = _mm_set1_ps(ty);
+    __m128 lanes = _mm_set_ps(3.f, 2.f, 1.f, 0.f);
+
+    // column 0 wraps on the left
+    rowScalar(elevation, mapSize, y, 0, 1, vert, dPdu, dPdv, norm, texcoord);
+
+    unsigned int x = 1;
+    for(; x + 4 <= w - 1; x += 4) {
+        __m128 fx = _mm_add_ps(_mm_set1_ps(float(x)), lanes);
+
+        // position
+        __m128 px = _mm_mul_ps(_mm_sub_ps(_mm_div_ps(fx, gsx), half), msx);
+        __m128 pz = _mm_mul_ps(_mm_sub_ps(_mm_div_ps(load4(center + x), gsz),
+                                          half), msz);
+        storeXYZ(vert + x, px, Py, pz);
+
+        // slopes
+        __m128 du = _mm_div_ps(_mm_mul_ps(_mm_mul_ps(
+            diff4(center + x+1, center + x-1), half), msz), gsz);
+        __m128 dv = _mm_div_ps(_mm_mul_ps(_mm_mul_ps(
+            diff4(above + x, below + x), half), msz), gsz);
+
+        // normalized u tangent (ux, 0, du)
+        __m128 len = _mm_add_ps(_mm_add_ps(_mm_mul_ps(Ux, Ux),
+                                           _mm_mul_ps(Uy, Uy)),
+                                _mm_mul_ps(du, du));
+        __m128 inv = _mm_div_ps(one, _mm_sqrt_ps(len));
+        __m128 tux = _mm_mul_ps(Ux, inv), tuy = _mm_mul_ps(Uy, inv);
+        __m128 tuz = _mm_mul_ps(du, inv);
+        storeXYZ(dPdu + x, tux, tuy, tuz);
+
+        // normalized v tangent (0, vy, dv)
+        len = _mm_add_ps(_mm_add_ps(_mm_mul_ps(Vx, Vx), _mm_mul_ps(Vy, Vy)),
+                         _mm_mul_ps(dv, dv));
+        inv = _mm_div_ps(one, _mm_sqrt_ps(len));
+        __m128 tvx = _mm_mul_ps(Vx, inv), tvy = _mm_mul_ps(Vy, inv);
+        __m128 tvz = _mm_mul_ps(dv, inv);
+        storeXYZ(dPdv + x, tvx, tvy, tvz);
+
+        // normalized cross product
+        __m128 nx = _mm_sub_ps(_mm_mul_ps(tuy, tvz), _mm_mul_ps(tvy, tuz));
+        __m128 ny = _mm_sub_ps(_mm_mul_ps(tuz, tvx), _mm_mul_ps(tvz, tux));
+        __m128 nz = _mm_sub_ps(_mm_mul_ps(tux, tvy), _mm_mul_ps(tvx, tuy));
+        len = _mm_add_ps(_mm_add_ps(_mm_mul_ps(nx, nx), _mm_mul_ps(ny, ny)),
+                         _mm_mul_ps(nz, nz));
+        inv = _mm_div_ps(one, _mm_sqrt_ps(len));
+        storeXYZ(norm + x, _mm_mul_ps(nx, inv), _mm_mul_ps(ny, inv),
+                 _mm_mul_ps(nz, inv));
+
+        // texture coordinate
+        storeST(texcoord + x, _mm_div_ps(fx, gsx), Ty);
+    }
+
+    // leftover columns, and the last two which wrap on the right
+    rowScalar(elevation, mapSize, y, x, w+1, vert, dPdu, dPdv, norm, texcoord);
+}
+
+//
+// vertex data for grid row y, 8 vertices at a time with AVX2
+// same operations as rowSSE2, just twice as wide
+//
+TARGET_AVX2
+static void rowAVX2(const Heightfield &elevation, const glm::vec3 &mapSize,
+                    unsigned int y, glm::vec3 *vert, glm::vec3 *dPdu,
+                    glm::vec3 *dPdv, glm::vec3 *norm, glm::vec2 *texcoord)
+{
+    unsigned int w = elevation.width, h = elevation.height;
+    glm::vec3 gridSize(float(w), float(h), float(elevation.maxval));
+    const unsigned short *center = elevation.row(y%h);
+    const unsigned short *above = elevation.row((y+1)%h);
+    const unsigned short *below = elevation.row((y+h-1)%h);
+
+    float vy = (float(y) / gridSize.y - 0.5f) * mapSize.y;
+    float ty = float(y) / gridSize.y;
+    float ux = mapSize.x / gridSize.x, uy = 0;
+    float vx = 0, vyt = mapSize.y / gridSize.y;
+
+    __m256 half = _mm256_set1_ps(0.5f), one = _mm256_set1_ps(1.f);
+    __m256 gsx = _mm256_set1_ps(gridSize.x), gsz = _mm256_set1_ps(gridSize.z);
+    __m256 msx = _mm256_set1_ps(mapSize.x), msz = _mm256_set1_ps(mapSize.z);
+    __m256 Ux = _mm256_set1_ps(ux), Uy = _mm256_set1_ps(uy);
+    __m256 Vx = _mm256_set1_ps(vx), Vy = _mm256_set1_ps(vyt);
+    __m256 Py = _mm256_set1_ps(vy), Ty = _mm256_set1_ps(ty);
+    __m256 lanes = _mm256_set_ps(7.f, 6.f, 5.f, 4.f, 3.f, 2.f, 1.f, 0.f);
+
+    rowScalar(elevation, mapSize, y, 0, 1, vert, dPdu, dPdv, norm, texcoord);
+
+    unsigned int x = 1;
+    for(; x + 8 <= w - 1; x += 8) {
+        __m256 fx = _mm256_add_ps(_mm256_set1_ps(float(x)), lanes);
+        __m256 elev = _mm256_cvtepi32_ps(_mm256_cvtepu16_epi32(
+            _mm_loadu_si128((const __m128i*)(center + x))));
+        __m256 ddu = _mm256_cvtepi32_ps(_mm256_sub_epi32(
+            _mm256_cvtepu16_epi32(_mm_loadu_si128((const __m128i*)(center + x+1))),
+            _mm256_cvtepu16_epi32(_mm_loadu_si128((const __m128i*)(center + x-1)))));
+        __m256 ddv = _mm256_cvtepi32_ps(_mm256_sub_epi32(
+            _mm256_cvtepu16_epi32(_mm_loadu_si128((const __m128i*)(above + x))),
+            _mm256_cvtepu16_epi32(_mm_loadu_si128((const __m128i*)(below + x)))));
+
+        __m256 px = _mm256_mul_ps(_mm256_sub_ps(_mm256_div_ps(fx, gsx), half),
+                                  msx);
+        __m256 pz = _mm256_mul_ps(_mm256_sub_ps(_mm256_div_ps(elev, gsz),
+                                                half), msz);
+        __m256 du = _mm256_div_ps(_mm256_mul_ps(_mm256_mul_ps(ddu, half), msz),
+                                  gsz);
+        __m256 dv = _mm256_div_ps(_mm256_mul_ps(_mm256_mul_ps(ddv, half), msz),
+                                  gsz);
+
+        __m256 len = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(Ux, Ux),
+                                                 _mm256_mul_ps(Uy, Uy)),
+                                   _mm256_mul_ps(du, du));
+        __m256 inv = _mm256_div_ps(one, _mm256_sqrt_ps(len));
+        __m256 tux = _mm256_mul_ps(Ux, inv), tuy = _mm256_mul_ps(Uy, inv);
+        __m256 tuz = _mm256_mul_ps(du, inv);
+
+        len = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(Vx, Vx),
+                                          _mm256_mul_ps(Vy, Vy)),
+                            _mm256_mul_ps(dv, dv));
+        inv = _mm256_div_ps(one, _mm256_sqrt_ps(len));
+        __m256 tvx = _mm256_mul_ps(Vx, inv), tvy = _mm256_mul_ps(Vy, inv);
+        __m256 tvz = _mm256_mul_ps(dv, inv);
+
+        __m256 nx = _mm256_sub_ps(_mm256_mul_ps(tuy, tvz),
+                                  _mm256_mul_ps(tvy, tuz));
+        __m256 ny = _mm256_sub_ps(_mm256_mul_ps(tuz, tvx),
+                                  _mm256_mul_ps(tvz, tux));
+        __m256 nz = _mm256_sub_ps(_mm256_mul_ps(tux, tvy),
+                                  _mm256_mul_ps(tvx, tuy));
+        len = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(nx, nx),
+                                          _mm256_mul_ps(ny, ny)),
+                            _mm256_mul_ps(nz, nz));
+        inv = _mm256_div_ps(one, _mm256_sqrt_ps(len));
+        nx = _mm256_mul_ps(nx, inv);
+        ny = _mm256_mul_ps(ny, inv);
+        nz = _mm256_mul_ps(nz, inv);
+        __m256 s = _mm256_div_ps(fx, gsx);
+
+        // interleave each half of 4 vertices with the SSE helpers
+        #define LO(v) _mm256_castps256_ps128(v)
+        #define HI(v) _mm256_extractf128_ps(v, 1)
+        storeXYZ(vert + x,   LO(px), LO(Py), LO(pz));
+        storeXYZ(vert + x+4, HI(px), HI(Py), HI(pz));
+        storeXYZ(dPdu + x,   LO(tux), LO(tuy), LO(tuz));
+        storeXYZ(dPdu + x+4, HI(tux), HI(tuy), HI(tuz));
+        storeXYZ(dPdv + x,   LO(tvx), LO(tvy), LO(tvz));
+        storeXYZ(dPdv + x+4, HI(tvx), HI(tvy), HI(tvz));
+        storeXYZ(norm + x,   LO(nx), LO(ny), LO(nz));
+        storeXYZ(norm + x+4, HI(nx), HI(ny), HI(nz));
+        storeST(texcoord + x,   LO(s), LO(Ty));
+        storeST(texcoord + x+4, HI(s), HI(Ty));
+        #undef LO
+        #undef HI
+    }
+
+    rowScalar(elevation, mapSize, y, x, w+1, vert, dPdu, dPdv, norm, texcoord);
+}
+
+#endif
+
+//
+// true if kernel can run here
+//
+bool TerrainMesh::kernelSupported(Kernel kernel)
+{
+#ifdef USE_SSE2
+    static bool avx2 = cpuHasAVX2();
+    return kernel != KERNEL_AVX2 || avx2;
+#else
+    return kernel != KERNEL_SSE2 && kernel != KERNEL_AVX2;
+#endif
+}
+
+//
+// vertex data for one grid row using the given kernel
+//
+void TerrainMesh::buildRow(const Heightfield &elevation,
+                           const glm::vec3 &mapSize, unsigned int y,
+                           glm::vec3 *vert, glm::vec3 *dPdu, glm::vec3 *dPdv,
+                           glm::vec3 *norm, glm::vec2 *texcoord, Kernel kernel)
+{
+    if (kernel == KERNEL_AUTO)
+        kernel = kernelSupported(KERNEL_AVX2) ? KERNEL_AVX2
+               : kernelSupported(KERNEL_SSE2) ? KERNEL_SSE2 : KERNEL_SCALAR;
+
+    switch (kernel) {
+#ifdef USE_SSE2
+    case KERNEL_AVX2:
+        rowAVX2(elevation, mapSize, y, vert, dPdu, dPdv, norm, texcoord);
+        break;
+    case KERNEL_SSE2:
+        rowSSE2(elevation, mapSize, y, vert, dPdu, dPdv, norm, texcoord);
+        break;
+#endif
+    default:
+        rowScalar(elevation, mapSize, y, 0, elevation.width + 1,
+                  vert, dPdu, dPdv, norm, texcoord);
+        break;
+    }
+}
+
+//
+// build vertex and index arrays
+//
+void TerrainMesh::build(const Heightfield &elevation, const glm::vec3 &size,
+                        ThreadPool *pool, Kernel kernel)
+{
+    clear();
+
+    unsigned int w = elevation.width, h = elevation.height;
+    gridSize = glm::vec3(float(w), float(h), float(elevation.maxval));
+
+    // world dimensions
+    mapSize = size;
+
+    // allocate vertex, normal and texture coordinate arrays
+    // each row has w+1 vertices with the first repeated at the end
+    numvert = (w + 1) * (h + 1);
+    vert = new glm::vec3[numvert];
+    dPdu = new glm::vec3[numvert];
+    dPdv = new glm::vec3[numvert];
+    norm = new glm::vec3[numvert];
+    texcoord = new glm::vec2[numvert];
+
+    // and index array, two triangles per square in the grid
+    numtri = 2*w*h;
+    indices = new glm::uvec3[numtri];
+
+    // every row of vertices, and of triangles, is independent, so each
+    // band of rows can be done anywhere as long as it writes only its
+    // own part of the arrays
+    auto band = [&](unsigned int y0, unsigned int y1) {
+        for(unsigned int y=y0;  y < y1;  ++y) {
+            unsigned int idx = y * (w+1);
+            buildRow(elevation, mapSize, y, vert + idx, dPdu + idx,
+                     dPdv + idx, norm + idx, texcoord + idx, kernel);
+
+            // link sets of three vertices into triangles. Each vertex
+            // index is essentially its unfolded grid array position. Be
+            // careful that each triangle ends up in counter-clockwise order
+            if (y == h) continue;
+            glm::uvec3 *tri = indices + 2*w*y;
+            for(unsigned int x=0; x<w; ++x, tri+=2) {
+                tri[0][0] = (w+1)* y    + x;
+                tri[0][1] = (w+1)* y    + x+1;
+                tri[0][2] = (w+1)*(y+1) + x+1;
+
+                tri[1][0] = (w+1)* y    + x;
+                tri[1][1] = (w+1)*(y+1) + x+1;
+                tri[1][2] = (w+1)*(y+1) + x;
+            }
+        }
+    };
+
+    // bands of at least 16 rows, so small meshes don't pay for threads
+    if (pool)
+        pool->parallelFor(0, h+1, band, 16);
+    else
+        band(0, h+1);
+}
+
+//
+// octahedral encoding: project the unit sphere onto the octahedron
+// |x|+|y|+|z| = 1, then fold the lower half out over the corners
+//
+static void octEncode(const glm::vec3 &n, int16_t out[2])
+{
+    float scale = 1.f / (fabsf(n.x) + fabsf(n.y) + fabsf(n.z));
+    float x = n.x * scale, y = n.y * scale;
+    if (n.z < 0) {
+        float fx = (1 - fabsf(y)) * (x < 0 ? -1.f : 1.f);
+        float fy = (1 - fabsf(x)) * (y < 0 ? -1.f : 1.f);
+        x = fx;  y = fy;
+    }
+    out[0] = int16_t(floorf(x * 32767.f + 0.5f));
+    out[1] = int16_t(floorf(y * 32767.f + 0.5f));
+}
+
+//
+// compact vertex data
+//
+void TerrainMesh::pack(PackedVertex *packed, unsigned int first,
+                       unsigned int count) const
+{
+    for(unsigned int i=0; i < count; ++i) {
+        octEncode(norm[first + i], packed[i].normal);
+
+        // undo the position scaling to get back the original sample,
+        // clamped in case edits have gone past the 16-bit range
+        float h = (vert[first + i].z / mapSize.z + 0.5f) * gridSize.z;
+        h = std::min(std::max(h, 0.f), 65535.f);
+        packed[i].height = uint16_t(floorf(h + 0.5f));
+        packed[i].pad = 0;
+    }
+}
+
+//
+// vertices 0 to n (inclusive) that show samples first to last, where
+// vertex n repeats sample 0 and the samples wrap around at n
+// stores up to two inclusive ranges in range, returning how many
+//
+static unsigned int wrapRanges(int first, int last, unsigned int n,
+                               unsigned int range[4])
+{
+    if (last - first + 1 >= int(n)) {
+        range[0] = 0;  range[1] = n;
+        return 1;
+    }
+
+    unsigned int f = unsigned((first % int(n) + int(n)) % int(n));
+    unsigned int l = f + unsigned(last - first);
+    if (l >= n) {
+        range[0] = f;  range[1] = n;
+        range[2] = 0;  range[3] = l - n;
+        return 2;
+    }
+    range[0] = f;  range[1] = l;
+    if (f > 0) return 1;
+    range[2] = range[3] = n;
+    return 2;
+}
+
+//
+// change heights, then the vertex frames around them
+//
+void TerrainMesh::edit(int x0, int y0, unsigned int w, unsigned int h,
+                       const float *delta, std::vector<Span> &spans)
+{
+    unsigned int W = unsigned(gridSize.x), H = unsigned(gridSize.y);
+    unsigned int rowLength = W + 1;
+    unsigned int sx0 = unsigned((x0 % int(W) + int(W)) % int(W));
+    unsigned int sy0 = unsigned((y0 % int(H) + int(H)) % int(H));
+
+    // every vertex showing an edited sample, including the repeated last
+    // row and column
+    unsigned int rows[4], cols[4];
+    unsigned int numRows = wrapRanges(y0, y0 + int(h) - 1, H, rows);
+    unsigned int numCols = wrapRanges(x0, x0 + int(w) - 1, W, cols);
+    for(unsigned int r=0; r < numRows; ++r) {
+        for(unsigned int y=rows[2*r]; y <= rows[2*r+1]; ++y) {
+            unsigned int j = (y % H + H - sy0) % H;
+            for(unsigned int c=0; c < numCols; ++c) {
+                for(unsigned int x=cols[2*c]; x <= cols[2*c+1]; ++x) {
+                    unsigned int i = (x % W + W - sx0) % W;
+                    vert[y * rowLength + x].z += delta[j*w + i];
+                }
+            }
+        }
+    }
+
+    // frames depend on the neighbors on each side, so go one further
+    // same math as build, but from the new world space heights
+    numRows = wrapRanges(y0 - 1, y0 + int(h), H, rows);
+    numCols = wrapRanges(x0 - 1, x0 + int(w), W, cols);
+    float tu = mapSize.x / gridSize.x, tv = mapSize.y / gridSize.y;
+    for(unsigned int r=0; r < numRows; ++r) {
+        for(unsigned int y=rows[2*r]; y <= rows[2*r+1]; ++y) {
+            const glm::vec3 *row = vert + (y % H) * rowLength;
+            const glm::vec3 *up = vert + ((y + 1) % H) * rowLength;
+            const glm::vec3 *down = vert + ((y + H - 1) % H) * rowLength;
+            for(unsigned int c=0; c < numCols; ++c) {
+                Span span = { y * rowLength + cols[2*c],
+                              cols[2*c+1] - cols[2*c] + 1 };
+                spans.push_back(span);
+                for(unsigned int x=cols[2*c]; x <= cols[2*c+1]; ++x) {
+                    unsigned int v = y * rowLength + x;
+                    float du = (row[(x+1) % W].z - row[(x+W-1) % W].z) * 0.5f;
+                    float dv = (up[x % W].z - down[x % W].z) * 0.5f;
+                    dPdu[v] = glm::normalize(glm::vec3(tu, 0, du));
+                    dPdv[v] = glm::normalize(glm::vec3(0, tv, dv));
+                    norm[v] = glm::normalize(glm::cross(dPdu[v], dPdv[v]));
+                }
+            }
+        }
+    }
+}
+
+//
+// hash elevation file contents and map size
+//
+uint64_t TerrainMesh::cacheKey(const char *elevationFile,
+                               const glm::vec3 &mapSize)
+{
+    uint64_t h = FNV_OFFSET;
+    MappedFile file;
+    if (file.map(elevationFile)) {
+        uint64_t size = file.size();
+        h = hashBytes(&size, sizeof(size), h);
+        h = hashBytes(file.data(), file.size(), h);
+    }
+    float size[3] = {mapSize.x, mapSize.y, mapSize.z};
+    return hashBytes(size, sizeof(size), h);
+}
+
+//
+// map cache file and check it matches key and checksum
+//
+bool TerrainMesh::load(const char *name, uint64_t key)
+{
+    clear();
+    if (! cache.map(name))
+        return false;
+
+    const CacheHeader *head = (const CacheHeader*)cache.data();
+    if (cache.size() < sizeof(CacheHeader) ||
+        memcmp(head->magic, "TMSH", 4) != 0 ||
+        head->version != CACHE_VERSION || head->key != key) {
+        cache.unmap();
+        return false;
+    }
+
+    // every array must be entirely inside the file, and match the checksum
+    uint64_t bytes[6];
+    arrayBytes(head->numvert, head->numtri, bytes);
+    uint64_t check = FNV_OFFSET;
+    for(int i=0; i < 6; ++i) {
+        if (head->offset[i] % 16 != 0 || head->offset[i] > cache.size() ||
+            bytes[i] > cache.size() - head->offset[i]) {
+            cache.unmap();
+            return false;
+        }
+        check = hashBytes(cache.data() + head->offset[i], size_t(bytes[i]), check);
+    }
+    if (check != head->checksum) {
+        cache.unmap();
+        return false;
+    }
+
+    unsigned char *base = cache.data();
+    gridSize = glm::vec3(head->gridSize[0], head->gridSize[1],
+                         head->gridSize[2]);
+    mapSize = glm::vec3(head->mapSize[0], head->mapSize[1], head->mapSize[2]);
+    numvert = head->numvert;
+    numtri = head->numtri;
+    vert = (glm::vec3*)(base + head->offset[0]);
+    dPdu = (glm::vec3*)(base + head->offset[1]);
+    dPdv = (glm::vec3*)(base + head->offset[2]);
+    norm = (glm::vec3*)(base + head->offset[3]);
+    texcoord = (glm::vec2*)(base + head->offset[4]);
+    indices = (glm::uvec3*)(base + head->offset[5]);
+    return true;
+}
+
+//
+// write header and arrays to cache file
+//
+bool TerrainMesh::save(const char *name, uint64_t key) const
+{
+    const void *array[6] = {vert, dPdu, dPdv, norm, texcoord, indices};
+    uint64_t bytes[6];
+    arrayBytes(numvert, numtri, bytes);
+
+    CacheHeader head;
+    memset(&head, 0, sizeof(head));
+    memcpy(head.magic, "TMSH", 4);
+    head.version = CACHE_VERSION;
+    head.key = key;
+    head.gridSize[0] = gridSize.x;
+    head.gridSize[1] = gridSize.y;
+    head.gridSize[2] = gridSize.z;
+    head.mapSize[0] = mapSize.x;
+    head.mapSize[1] = mapSize.y;
+    head.mapSize[2] = mapSize.z;
+    head.numvert = numvert;
+    head.numtri = numtri;
+
+    uint64_t offset = sizeof(head);
+    head.checksum = FNV_OFFSET;
+    for(int i=0; i < 6; ++i) {
+        offset = (offset + 15) & ~uint64_t(15);
+        head.offset[i] = offset;
+        offset += bytes[i];
+        head.checksum = hashBytes(array[i], size_t(bytes[i]), head.checksum);
+    }
+
+    // other instances may have the old cache mapped, so write a new one
+    // beside it and swap it in
+    CacheFile cache(name);
+    FILE *fp = cache.file();
+    if (!fp)
+        return false;
+    fwrite(&head, sizeof(head), 1, fp);
+    static const char zero[16] = {0};
+    for(int i=0; i < 6; ++i) {
+        fwrite(zero, 1, size_t(head.offset[i] - ftell(fp)), fp);
+        fwrite(array[i], 1, size_t(bytes[i]), fp);
+    }
+    return cache.commit();
+}
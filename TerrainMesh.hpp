@@ -0,0 +1,138 @@
+// terrain geometry built from a height field
+// CPU only, so it can be built on any thread
+//
+// Built meshes can be saved to a cache file and mapped back in later.
+// Cache file layout, all values in native byte order:
+//   TerrainMesh::CacheHeader
+//   vert, dPdu, dPdv, norm, texcoord and indices arrays, each starting
+//   on a 16-byte boundary, packed just as they are given to glBufferData
+#ifndef TerrainMesh_hpp
+#define TerrainMesh_hpp
+
+#define GLM_SWIZZLE
+
+#include "MappedFile.hpp"
+#include <glm/glm.hpp>
+#include <stdint.h>
+#include <vector>
+
+class Heightfield;
+class ThreadPool;
+
+struct TerrainMesh {
+    enum { CACHE_VERSION = 1 };
+
+    // ways to compute vertex data, all giving identical results
+    // AUTO picks the fastest this CPU supports
+    enum Kernel { KERNEL_AUTO, KERNEL_SCALAR, KERNEL_SSE2, KERNEL_AVX2 };
+
+    // compact vertex, 8 bytes instead of 56
+    // x, y and texture coordinate come from the vertex number, and on a
+    // height field both tangents can be rebuilt from the normal alone
+    struct PackedVertex {
+        int16_t normal[2];          // octahedral normal, -32767 to 32767
+        uint16_t height;            // elevation sample
+        uint16_t pad;               // keep 4-byte alignment
+    };
+
+    // run of consecutive vertices
+    struct Span {
+        unsigned int first;         // first vertex
+        unsigned int count;         // number of vertices
+    };
+
+    struct CacheHeader {
+        char magic[4];              // "TMSH"
+        uint32_t version;           // TerrainMesh::CACHE_VERSION
+        uint64_t key;               // cacheKey of source elevation & size
+        uint64_t checksum;          // hash of all array data
+        float gridSize[3];          // TerrainMesh::gridSize
+        float mapSize[3];           // TerrainMesh::mapSize
+        uint32_t numvert, numtri;   // array sizes
+        uint64_t offset[6];         // file position of each array
+    };
+
+    glm::vec3 gridSize;             // elevation grid size
+    glm::vec3 mapSize;              // size of terrain in world space
+
+    unsigned int numvert;       // total vertices
+    glm::vec3 *vert;                // per-vertex position
+    glm::vec3 *dPdu, *dPdv;         // per-vertex tangents
+    glm::vec3 *norm;                // per-vertex normal
+    glm::vec2 *texcoord;            // per-vertex texture coordinate
+
+    unsigned int numtri;        // total triangles
+    glm::uvec3 *indices; // 3 vertex indices per triangle
+
+// private data
+private:
+    MappedFile cache;               // arrays point here if loaded from cache
+
+// private methods
+private:
+    // no copying
+    TerrainMesh(const TerrainMesh &);
+    TerrainMesh &operator=(const TerrainMesh &);
+
+// public methods
+public:
+    // create empty
+    TerrainMesh() : numvert(0), vert(0), dPdu(0), dPdv(0), norm(0),
+                    texcoord(0), numtri(0), indices(0) {}
+
+    // free arrays
+    ~TerrainMesh() { clear(); }
+
+    // free arrays and return to empty
+    void clear();
+
+    // build vertex and index arrays for elevation
+    // mapSize is the size of the terrain in world space
+    // if pool is given, bands of rows are built in parallel across it,
+    // giving exactly the same arrays as building on one thread
+    void build(const Heightfield &elevation, const glm::vec3 &mapSize,
+               ThreadPool *pool = 0, Kernel kernel = KERNEL_AUTO);
+
+    // true if kernel can run on this CPU; SSE2 and AVX2 never can in a
+    // build for a CPU other than x86
+    static bool kernelSupported(Kernel kernel);
+
+    // compute the w+1 vertices of grid row y (0 <= y <= h), storing
+    // vertex x at vert[x], dPdu[x], etc.
+    static void buildRow(const Heightfield &elevation,
+                         const glm::vec3 &mapSize, unsigned int y,
+                         glm::vec3 *vert, glm::vec3 *dPdu, glm::vec3 *dPdv,
+                         glm::vec3 *norm, glm::vec2 *texcoord,
+                         Kernel kernel = KERNEL_AUTO);
+
+    // fill packed[numvert] with the compact form of each vertex
+    void pack(PackedVertex *packed) const { pack(packed, 0, numvert); }
+
+    // fill packed[count] with the compact form of vertices from first
+    void pack(PackedVertex *packed, unsigned int first,
+              unsigned int count) const;
+
+    // add delta[j*w + i] world units to the height of elevation sample
+    // x0+i, y0+j, for a w x h rectangle of samples that wraps around the
+    // grid edges just as build does (so w and h are at most the grid
+    // size), then recompute tangents and normals of every vertex next to
+    // a change. Appends the runs of vertices that changed to spans.
+    // Works on a cached mesh too, but never changes the cache file.
+    void edit(int x0, int y0, unsigned int w, unsigned int h,
+              const float *delta, std::vector<Span> &spans);
+
+    // cache key for a mesh built from an elevation file for mapSize
+    // hashes the file contents, so any change to the file changes the key
+    static uint64_t cacheKey(const char *elevationFile,
+                             const glm::vec3 &mapSize);
+
+    // map a cached mesh, return false if it's missing, for a different
+    // key, or damaged. Arrays are used in place from the mapped file.
+    bool load(const char *cacheFile, uint64_t key);
+
+    // save mesh to a cache file, return false if it can't be written
+    // replaces the file whole, so instances that have it mapped are safe
+    bool save(const char *cacheFile, uint64_t key) const;
+};
+
+#endif
@@ -0,0 +1,234 @@
+// quadtree of terrain chunks for continuous level of detail
+
+#include "TerrainQuadtree.hpp"
+#include "Frustum.hpp"
+#include "Heightfield.hpp"
+#include "ThreadPool.hpp"
+#include <algorithm>
+#include <float.h>
+#include <math.h>
+
+const float TerrainQuadtree::MORPH_START = 0.66f;
+
+//
+// squared distance from point to box, 0 if inside
+//
+static float distance2(const glm::vec3 &p, const glm::vec3 &boxMin,
+                       const glm::vec3 &boxMax)
+{
+    float d2 = 0;
+    for(int i=0; i < 3; ++i) {
+        float d = std::max(std::max(boxMin[i] - p[i], p[i] - boxMax[i]), 0.f);
+        d2 += d*d;
+    }
+    return d2;
+}
+
+//
+// compute node heights and errors
+//
+void TerrainQuadtree::build(const Heightfield &elevation,
+                            const glm::vec3 &size, ThreadPool *pool)
+{
+    unsigned int w = elevation.width, h = elevation.height;
+    gridSize = glm::vec3(float(w), float(h), float(elevation.maxval));
+    mapSize = size;
+
+    // add levels until one node covers everything
+    levels = 0;
+    for(unsigned int nodeSize = LEAF_SIZE; levels < MAX_LEVELS; nodeSize *= 2) {
+        nodesX[levels] = (w + nodeSize - 1) / nodeSize;
+        nodesY[levels] = (h + nodeSize - 1) / nodeSize;
+        nodes[levels].assign(nodesX[levels] * nodesY[levels], Node());
+        ++levels;
+        if (nodeSize >= w && nodeSize >= h) break;
+    }
+
+    // world units per elevation sample
+    float zScale = mapSize.z / gridSize.z;
+
+    for(unsigned int level=0; level < levels; ++level) {
+        unsigned int step = 1u << level;
+        unsigned int nodeSize = LEAF_SIZE << level;
+        std::vector<Node> &levelNodes = nodes[level];
+        unsigned int across = nodesX[level];
+
+        // each band of node rows only touches its own nodes
+        // nodes include the vertices on all four edges, clamped at the
+        // edge of the grid, just as they are drawn
+        auto band = [&](unsigned int ny0, unsigned int ny1) {
+            for(unsigned int ny=ny0; ny < ny1; ++ny) {
+                for(unsigned int nx=0; nx < across; ++nx) {
+                    Node &node = levelNodes[ny * across + nx];
+                    unsigned int x0 = nx * nodeSize, y0 = ny * nodeSize;
+                    unsigned int x1 = std::min(x0 + nodeSize, w);
+                    unsigned int y1 = std::min(y0 + nodeSize, h);
+                    unsigned short lo = 0xffff, hi = 0;
+                    float error = 0;
+
+                    for(unsigned int y=y0; y <= y1; ++y) {
+                        // coarse grid rows around this one
+                        unsigned int cy0 = y - (y - y0) % step;
+                        unsigned int cy1 = std::min(cy0 + step, y1);
+                        float fy = cy1 > cy0 ? float(y-cy0)/float(cy1-cy0) : 0;
+
+                        for(unsigned int x=x0; x <= x1; ++x) {
+                            unsigned short e = elevation(x%w, y%h);
+                            lo = std::min(lo, e);
+                            hi = std::max(hi, e);
+                            if (step == 1) continue;
+
+                            // height of coarse triangle containing x,y,
+                            // split along the same diagonal as the mesh
+                            unsigned int cx0 = x - (x - x0) % step;
+                            unsigned int cx1 = std::min(cx0 + step, x1);
+                            float fx = cx1 > cx0
+                                ? float(x-cx0)/float(cx1-cx0) : 0;
+                            float h00 = elevation(cx0%w, cy0%h);
+                            float h10 = elevation(cx1%w, cy0%h);
+                            float h01 = elevation(cx0%w, cy1%h);
+                            float h11 = elevation(cx1%w, cy1%h);
+                            float coarse = fx >= fy
+                                ? h00 + fx*(h10 - h00) + fy*(h11 - h10)
+                                : h00 + fy*(h01 - h00) + fx*(h11 - h01);
+                            error = std::max(error, fabsf(e - coarse));
+                        }
+                    }
+
+                    node.minZ = (lo / gridSize.z - 0.5f) * mapSize.z;
+                    node.maxZ = (hi / gridSize.z - 0.5f) * mapSize.z;
+                    node.error = error * zScale;
+                }
+            }
+        };
+        if (pool)
+            pool->parallelFor(0, nodesY[level], band);
+        else
+            band(0, nodesY[level]);
+
+        // worst case for each level, never less than finer levels
+        levelError[level] = level ? levelError[level-1] : 0;
+        levelDiagonal[level] = 0;
+        for(size_t n=0; n < levelNodes.size(); ++n) {
+            const Node &node = levelNodes[n];
+            levelError[level] = std::max(levelError[level], node.error);
+            glm::vec3 boxMin, boxMax;
+            bounds(level, unsigned(n % across), unsigned(n / across),
+                   boxMin, boxMax);
+            levelDiagonal[level] = std::max(levelDiagonal[level],
+                                            glm::length(boxMax - boxMin));
+        }
+    }
+}
+
+//
+// world space box around node
+//
+void TerrainQuadtree::bounds(unsigned int level, unsigned int nx,
+                             unsigned int ny,
+                             glm::vec3 &boxMin, glm::vec3 &boxMax) const
+{
+    unsigned int nodeSize = LEAF_SIZE << level;
+    unsigned int x0 = nx * nodeSize, y0 = ny * nodeSize;
+    unsigned int x1 = std::min(x0 + nodeSize, unsigned(gridSize.x));
+    unsigned int y1 = std::min(y0 + nodeSize, unsigned(gridSize.y));
+    const Node &n = node(level, nx, ny);
+    boxMin = glm::vec3((float(x0) / gridSize.x - 0.5f) * mapSize.x,
+                       (float(y0) / gridSize.y - 0.5f) * mapSize.y, n.minZ);
+    boxMax = glm::vec3((float(x1) / gridSize.x - 0.5f) * mapSize.x,
+                       (float(y1) / gridSize.y - 0.5f) * mapSize.y, n.maxZ);
+}
+
+//
+// per-level distance ranges
+//
+void TerrainQuadtree::ranges(float pixelsPerUnit, float maxPixels,
+                             float *range) const
+{
+    float prev = 0;
+    for(unsigned int level=0; level+1 < levels; ++level) {
+        // beyond this distance, the next level's error is small enough
+        float r = levelError[level+1] * pixelsPerUnit / maxPixels;
+
+        // Neighboring nodes can only differ by one level, and morphing
+        // is only finished where they meet, if each range at least
+        // doubles the last, and the far side of any node in range is
+        // still short of where the next level starts to morph
+        r = std::max(r, 2 * prev);
+        r = std::max(r, 2 * levelDiagonal[level]);
+        range[level] = prev = r;
+    }
+    range[levels-1] = FLT_MAX;
+}
+
+//
+// choose nodes to draw
+//
+void TerrainQuadtree::select(const glm::vec3 &camera, const float *range,
+                             const Frustum &view,
+                             std::vector<Selection> &out,
+                             CullCount &count) const
+{
+    out.clear();
+    if (! levels) return;
+    unsigned int top = levels-1;
+    for(unsigned int ny=0; ny < nodesY[top]; ++ny)
+        for(unsigned int nx=0; nx < nodesX[top]; ++nx)
+            select(top, nx, ny, camera, range, view, false, out, count);
+}
+
+//
+// select one node or its children
+//
+bool TerrainQuadtree::select(unsigned int level,
+                             unsigned int nx, unsigned int ny,
+                             const glm::vec3 &camera, const float *range,
+                             const Frustum &view, bool inside,
+                             std::vector<Selection> &out,
+                             CullCount &count) const
+{
+    glm::vec3 boxMin, boxMax;
+    bounds(level, nx, ny, boxMin, boxMax);
+
+    // nothing to draw out of view, for this node or its parent, and
+    // children of a node wholly in view are in view too
+    if (! inside) {
+        ++count.tested;
+        Frustum::Result result = view.test(boxMin, boxMax);
+        if (result == Frustum::OUTSIDE) {
+            ++count.culled;
+            return true;
+        }
+        inside = result == Frustum::INSIDE;
+    }
+
+    float d2 = distance2(camera, boxMin, boxMax);
+    if (range[level] < FLT_MAX && d2 > range[level] * range[level])
+        return false;
+
+    Selection s;
+    s.level = level;
+    s.x = nx * (LEAF_SIZE << level);
+    s.y = ny * (LEAF_SIZE << level);
+    s.quadrants = 0;
+
+    // whole node at this level if it's too far for any more detail
+    if (level == 0 || d2 > range[level-1] * range[level-1]) {
+        s.quadrants = 0xf;
+        out.push_back(s);
+        return true;
+    }
+
+    // otherwise children where they can, and quadrants of this node
+    // for those that are out of their range
+    for(unsigned int q=0; q < 4; ++q) {
+        unsigned int cx = 2*nx + (q & 1), cy = 2*ny + (q >> 1);
+        if (cx < nodesX[level-1] && cy < nodesY[level-1] &&
+            ! select(level-1, cx, cy, camera, range, view, inside, out,
+                     count))
+            s.quadrants |= 1u << q;
+    }
+    if (s.quadrants)
+        out.push_back(s);
+    return true;
+}
@@ -0,0 +1,118 @@
+// quadtree of terrain chunks for continuous level of detail (CDLOD)
+// CPU only, so it can be built on any thread
+//
+// Level 0 nodes cover LEAF_SIZE x LEAF_SIZE squares of the elevation
+// grid, and each level up covers twice as many in each direction, down
+// to a single root. Every node is drawn with the same LEAF_SIZE grid,
+// so a level L node samples every 2^L'th elevation value.
+//
+// Each node knows its height range and its geometric error: how far the
+// full resolution surface strays from the node's coarser grid. Each
+// frame, ranges() turns the worst error of each level into the distance
+// at which it shrinks below a pixel threshold on screen, and select()
+// walks the tree picking the coarsest level whose range covers each
+// node, skipping any outside the view frustum. Vertices near the far
+// end of a level's range morph smoothly to the next coarser grid, so
+// adjacent levels meet without cracks.
+#ifndef TerrainQuadtree_hpp
+#define TerrainQuadtree_hpp
+
+#include <glm/glm.hpp>
+#include <vector>
+
+class Frustum;
+class Heightfield;
+class ThreadPool;
+
+class TerrainQuadtree {
+// public types
+public:
+    enum { LEAF_SIZE = 32 };        // squares across a node's grid
+    enum { MAX_LEVELS = 16 };       // enough for 2^20 samples across
+
+    // fraction of each level's range where morphing starts
+    static const float MORPH_START;
+
+    struct Node {
+        float minZ, maxZ;           // world space height range
+        float error;                // world space geometric error
+    };
+
+    // node chosen for drawing
+    // quadrants are numbered x + 2*y, each bit set for one to draw
+    struct Selection {
+        unsigned int level;         // detail level, 0 = full resolution
+        unsigned int x, y;          // first grid sample of node
+        unsigned int quadrants;     // mask of quadrants to draw
+    };
+
+    // frustum tests done by select
+    struct CullCount {
+        unsigned int tested;        // node boxes tested
+        unsigned int culled;        // nodes found to be out of view
+    };
+
+// private data
+private:
+    std::vector<Node> nodes[MAX_LEVELS];    // per level in [y][x] order
+    unsigned int nodesX[MAX_LEVELS];        // nodes across each level
+    unsigned int nodesY[MAX_LEVELS];        // nodes down each level
+    float levelError[MAX_LEVELS];           // worst error at each level
+    float levelDiagonal[MAX_LEVELS];        // longest node box diagonal
+
+    // no copying
+    TerrainQuadtree(const TerrainQuadtree &);
+    TerrainQuadtree &operator=(const TerrainQuadtree &);
+
+    // add node and any children that need more detail, return false if
+    // the node is beyond the range of its level, so its parent needs to
+    // draw it instead. Nodes out of view are skipped, and if inside is
+    // true the node is already known to be in view
+    bool select(unsigned int level, unsigned int x, unsigned int y,
+                const glm::vec3 &camera, const float *range,
+                const Frustum &view, bool inside,
+                std::vector<Selection> &out, CullCount &count) const;
+
+// public data
+public:
+    glm::vec3 gridSize;             // elevation grid size, as TerrainMesh
+    glm::vec3 mapSize;              // size of terrain in world space
+    unsigned int levels;            // levels in tree, root is levels-1
+
+// public methods
+public:
+    // create empty
+    TerrainQuadtree() : levels(0) {}
+
+    // build tree for elevation
+    // mapSize is the size of the terrain in world space
+    // if pool is given, node errors are computed in parallel across it
+    void build(const Heightfield &elevation, const glm::vec3 &mapSize,
+               ThreadPool *pool = 0);
+
+    // node data
+    const Node &node(unsigned int level, unsigned int nx,
+                     unsigned int ny) const {
+        return nodes[level][ny * nodesX[level] + nx];
+    }
+
+    // world space bounding box of the part of a node inside the grid
+    void bounds(unsigned int level, unsigned int nx, unsigned int ny,
+                glm::vec3 &boxMin, glm::vec3 &boxMax) const;
+
+    // distance out to which each level is used, so that no error is
+    // more than maxPixels on screen. pixelsPerUnit is the size on screen
+    // of one world unit at distance 1 (half the viewport height times
+    // projection[1][1]). range must hold levels entries; the last is
+    // always infinite
+    void ranges(float pixelsPerUnit, float maxPixels, float *range) const;
+
+    // replace out with the nodes to draw from camera position, leaving
+    // out any that are outside the view
+    // adds the boxes tested and culled to count
+    void select(const glm::vec3 &camera, const float *range,
+                const Frustum &view, std::vector<Selection> &out,
+                CullCount &count) const;
+};
+
+#endif
@@ -0,0 +1,167 @@
+// right-triangulated irregular network for terrain simplification
+
+#include "TerrainRTIN.hpp"
+#include "TerrainMesh.hpp"
+#include "ThreadPool.hpp"
+#include <algorithm>
+#include <math.h>
+#include <stdlib.h>
+
+//
+// largest vertical distance from the plane through vertices a, b, c
+// to any vertex on or inside the triangle
+//
+static float triangleError(const glm::vec3 *vert, unsigned int rowLength,
+                           int ax, int ay, int bx, int by, int cx, int cy)
+{
+    float za = vert[ay * rowLength + ax].z;
+    float zb = vert[by * rowLength + bx].z;
+    float zc = vert[cy * rowLength + cx].z;
+
+    // plane slope in x and y
+    int det = (bx-ax)*(cy-ay) - (by-ay)*(cx-ax);
+    float gx = ((zb-za)*(cy-ay) - (zc-za)*(by-ay)) / det;
+    float gy = ((bx-ax)*(zc-za) - (cx-ax)*(zb-za)) / det;
+
+    // inside if on the same side of all three edges as the triangle
+    float worst = 0;
+    int x0 = std::min(ax, std::min(bx, cx)), x1 = std::max(ax, std::max(bx, cx));
+    int y0 = std::min(ay, std::min(by, cy)), y1 = std::max(ay, std::max(by, cy));
+    for(int y=y0; y <= y1; ++y) {
+        for(int x=x0; x <= x1; ++x) {
+            int e0 = (bx-ax)*(y-ay) - (by-ay)*(x-ax);
+            int e1 = (cx-bx)*(y-by) - (cy-by)*(x-bx);
+            int e2 = (ax-cx)*(y-cy) - (ay-cy)*(x-cx);
+            if (det > 0 ? (e0 < 0 || e1 < 0 || e2 < 0)
+                        : (e0 > 0 || e1 > 0 || e2 > 0))
+                continue;
+            float z = za + gx*(x-ax) + gy*(y-ay);
+            worst = std::max(worst, fabsf(vert[y * rowLength + x].z - z));
+        }
+    }
+    return worst;
+}
+
+//
+// compute vertex errors
+//
+void TerrainRTIN::build(const TerrainMesh &mesh, ThreadPool *pool)
+{
+    width = unsigned(mesh.gridSize.x);
+    height = unsigned(mesh.gridSize.y);
+    unsigned int rowLength = width + 1;
+
+    // largest power of two that divides both sides
+    tileSize = 1;
+    while (tileSize < MAX_TILE && width % (2*tileSize) == 0 &&
+           height % (2*tileSize) == 0)
+        tileSize *= 2;
+    tilesX = width / tileSize;
+    tilesY = height / tileSize;
+
+    // two triangles per tile to start, each split in two until the
+    // legs are one square long
+    unsigned int T = tileSize;
+    triangles.assign(2*T*T - 2, Triangle());
+    if (! triangles.empty()) {
+        Triangle upper = { uint16_t(T), uint16_t(T), 0, 0, 0, uint16_t(T) };
+        Triangle lower = { 0, 0, uint16_t(T), uint16_t(T), uint16_t(T), 0 };
+        triangles[0] = upper;
+        triangles[1] = lower;
+    }
+    for(size_t i=0; 2*i+3 < triangles.size(); ++i) {
+        const Triangle &t = triangles[i];
+        uint16_t mx = uint16_t((t.ax + t.bx) / 2);
+        uint16_t my = uint16_t((t.ay + t.by) / 2);
+        Triangle left = { t.cx, t.cy, t.ax, t.ay, mx, my };
+        Triangle right = { t.bx, t.by, t.cx, t.cy, mx, my };
+        triangles[2*i+2] = left;
+        triangles[2*i+3] = right;
+    }
+
+    // finest triangles first, so each vertex sees the errors below it
+    // tiles share the vertices along their edges, so neighbors have to
+    // be done in turn, first one color of a checkerboard, then the other
+    errors.assign(size_t(rowLength) * (height + 1), 0.f);
+    unsigned int levels = 0;
+    while ((4u << levels) - 2 <= triangles.size()) ++levels;
+    for(int level = int(levels) - 1; level >= 0; --level) {
+        size_t begin = (2u << level) - 2, end = (4u << level) - 2;
+        for(unsigned int color=0; color < 2; ++color) {
+            auto band = [&](unsigned int ty0, unsigned int ty1) {
+                for(unsigned int ty=ty0; ty < ty1; ++ty) {
+                    for(unsigned int tx=(ty + color) & 1; tx < tilesX; tx += 2) {
+                        int x0 = int(tx * T), y0 = int(ty * T);
+                        for(size_t i=begin; i < end; ++i) {
+                            const Triangle &t = triangles[i];
+                            int ax = x0 + t.ax, ay = y0 + t.ay;
+                            int bx = x0 + t.bx, by = y0 + t.by;
+                            int cx = x0 + t.cx, cy = y0 + t.cy;
+                            float e = triangleError(mesh.vert, rowLength,
+                                                    ax, ay, bx, by, cx, cy);
+
+                            // at least as bad as either half
+                            if (2*i+3 < triangles.size()) {
+                                e = std::max(e, errors[((cy + ay) / 2) *
+                                    rowLength + (cx + ax) / 2]);
+                                e = std::max(e, errors[((by + cy) / 2) *
+                                    rowLength + (bx + cx) / 2]);
+                            }
+                            float &mid = errors[((ay + by) / 2) * rowLength +
+                                                (ax + bx) / 2];
+                            mid = std::max(mid, e);
+                        }
+                    }
+                }
+            };
+            if (pool)
+                pool->parallelFor(0, tilesY, band);
+            else
+                band(0, tilesY);
+        }
+    }
+}
+
+//
+// recursively split triangle until it is close enough to the grid
+//
+void TerrainRTIN::split(const TerrainMesh &mesh,
+                        unsigned int x0, unsigned int y0,
+                        unsigned int ax, unsigned int ay,
+                        unsigned int bx, unsigned int by,
+                        unsigned int cx, unsigned int cy,
+                        float maxError, std::vector<uint32_t> &index,
+                        float &worst) const
+{
+    unsigned int rowLength = width + 1;
+    unsigned int mx = (ax + bx) / 2, my = (ay + by) / 2;
+    unsigned int legs = unsigned(abs(int(ax) - int(cx)) +
+                                 abs(int(ay) - int(cy)));
+    if (legs > 1 && errors[(y0 + my) * rowLength + x0 + mx] > maxError) {
+        split(mesh, x0, y0, cx, cy, ax, ay, mx, my, maxError, index, worst);
+        split(mesh, x0, y0, bx, by, cx, cy, mx, my, maxError, index, worst);
+        return;
+    }
+
+    // corners run clockwise, so add them in reverse
+    index.push_back((y0 + ay) * rowLength + x0 + ax);
+    index.push_back((y0 + cy) * rowLength + x0 + cx);
+    index.push_back((y0 + by) * rowLength + x0 + bx);
+    worst = std::max(worst, triangleError(mesh.vert, rowLength,
+        int(x0 + ax), int(y0 + ay), int(x0 + bx), int(y0 + by),
+        int(x0 + cx), int(y0 + cy)));
+}
+
+//
+// triangles of one tile
+//
+float TerrainRTIN::extract(const TerrainMesh &mesh,
+                           unsigned int tx, unsigned int ty, float maxError,
+                           std::vector<uint32_t> &index) const
+{
+    unsigned int T = tileSize, x0 = tx * T, y0 = ty * T;
+    float worst = 0;
+    split(mesh, x0, y0, 0, 0, T, T, T, 0, maxError, index, worst);
+    split(mesh, x0, y0, T, T, 0, 0, 0, T, maxError, index, worst);
+    return worst;
+}
@@ -0,0 +1,85 @@
+// right-triangulated irregular network (RTIN) for simplifying a terrain
+// mesh to a vertical error bound
+// CPU only, so it can be built on any thread
+//
+// The grid is split into square tiles a power of two across, and each
+// tile into two right triangles along its diagonal. Any triangle can be
+// split in two at the midpoint of its hypotenuse, down to single grid
+// squares. Each vertex records the worst error of any triangle whose
+// hypotenuse it splits, or of any smaller triangle below those, where a
+// triangle's error is the largest vertical distance from it to the grid
+// vertices it covers. Triangles are split while that error is above the
+// bound, so every triangle kept is within it, and since both triangles
+// sharing a hypotenuse see the same vertex, neighbors always agree on
+// splitting it and the mesh has no cracks, even between tiles.
+//
+// Tiles have to divide the grid exactly, so their size is the largest
+// power of two up to MAX_TILE that divides both sides. Grids a power of
+// two across get full size tiles, but others simplify far less: a 1000
+// square side allows only 8 square tiles, and an odd one leaves every
+// square its own tile, which can't be simplified at all.
+#ifndef TerrainRTIN_hpp
+#define TerrainRTIN_hpp
+
+#include <stdint.h>
+#include <vector>
+
+struct TerrainMesh;
+class ThreadPool;
+
+class TerrainRTIN {
+// public types
+public:
+    enum { MAX_TILE = 64 };         // largest tile size in squares
+
+// private types
+private:
+    // triangle corners in tile coordinates, with the right angle at c
+    struct Triangle {
+        uint16_t ax, ay, bx, by, cx, cy;
+    };
+
+// private data
+private:
+    // every triangle of a tile that can be split, coarsest first
+    // triangle i is split into 2i+2 and 2i+3
+    std::vector<Triangle> triangles;
+    std::vector<float> errors;      // per grid vertex, in world units
+
+    // no copying
+    TerrainRTIN(const TerrainRTIN &);
+    TerrainRTIN &operator=(const TerrainRTIN &);
+
+    // add triangle a, b, c of the tile at x0, y0 to index, or its two
+    // halves if it is too far from the grid, updating worst error kept
+    void split(const TerrainMesh &mesh, unsigned int x0, unsigned int y0,
+               unsigned int ax, unsigned int ay, unsigned int bx,
+               unsigned int by, unsigned int cx, unsigned int cy,
+               float maxError, std::vector<uint32_t> &index,
+               float &worst) const;
+
+// public data
+public:
+    unsigned int width, height;     // grid squares, as TerrainMesh
+    unsigned int tileSize;          // squares across a tile
+    unsigned int tilesX, tilesY;    // tiles across and down
+
+// public methods
+public:
+    // create empty
+    TerrainRTIN() : width(0), height(0), tileSize(0), tilesX(0), tilesY(0) {}
+
+    // compute vertex errors for mesh
+    // tiles are as large as possible up to MAX_TILE while still dividing
+    // the grid evenly. If pool is given, tiles are done in parallel.
+    void build(const TerrainMesh &mesh, ThreadPool *pool = 0);
+
+    // append the triangles of tile tx, ty that stay within maxError of
+    // the grid to index, as counter-clockwise mesh vertex numbers, in
+    // the order they are found, which keeps neighbors close together
+    // returns the largest error of any triangle added
+    float extract(const TerrainMesh &mesh, unsigned int tx, unsigned int ty,
+                  float maxError, std::vector<uint32_t> &index) const;
+};
+
+#endif
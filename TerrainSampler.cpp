@@ -0,0 +1,312 @@
+// ground height, normal and slope at any world position
+
+#include "TerrainSampler.hpp"
+#include "HeightPyramid.hpp"
+#include "Heightfield.hpp"
+#include "Simd.hpp"
+#include "ThreadPool.hpp"
+#include <algorithm>
+#include <math.h>
+
+//
+// snapshot from elevation samples
+//
+TerrainSampler::TerrainSampler(const Heightfield &elevation,
+                               const glm::vec3 &mapSize)
+    : width(elevation.width), height(elevation.height), mapSize(mapSize)
+{
+    toGridX = float(width) / mapSize.x;
+    toGridY = float(height) / mapSize.y;
+
+    unsigned int rowLength = width + 1;
+    float maxval = float(elevation.maxval);
+    heights.resize(size_t(rowLength) * (height + 1));
+    for(unsigned int y=0; y <= height; ++y) {
+        const unsigned short *row = elevation.row(y % height);
+        for(unsigned int x=0; x <= width; ++x)
+            heights[y * rowLength + x] =
+                (float(row[x % width]) / maxval - 0.5f) * mapSize.z;
+    }
+}
+
+//
+// snapshot from pyramid heights
+//
+TerrainSampler::TerrainSampler(const HeightPyramid &pyramid)
+    : width(pyramid.width), height(pyramid.height), mapSize(pyramid.mapSize)
+{
+    toGridX = float(width) / mapSize.x;
+    toGridY = float(height) / mapSize.y;
+
+    const float *source = pyramid.vertexHeights();
+    heights.assign(source, source + size_t(width + 1) * (height + 1));
+}
+
+//
+// one point at a time, the reference for the SIMD kernels
+//
+void TerrainSampler::sampleScalar(const glm::vec2 *xy, unsigned int first,
+                                  unsigned int last, float *z,
+                                  glm::vec3 *normal, float *slope) const
+{
+    float w = float(width), h = float(height);
+    float invW = 1 / w, invH = 1 / h;
+    float halfW = 0.5f * w, halfH = 0.5f * h;
+    unsigned int rowLength = width + 1;
+
+    for(unsigned int i=first; i < last; ++i) {
+        // grid position, wrapped into the terrain
+        float gx = xy[i].x * toGridX + halfW;
+        float gy = xy[i].y * toGridY + halfH;
+        gx = std::max(0.f, gx - floorf(gx * invW) * w);
+        gy = std::max(0.f, gy - floorf(gy * invH) * h);
+        int ix = std::min(int(gx), int(width) - 1);
+        int iy = std::min(int(gy), int(height) - 1);
+        float fx = gx - float(ix), fy = gy - float(iy);
+
+        // bilinear height, and its slope across the square
+        const float *row0 = &heights[iy * rowLength + ix];
+        const float *row1 = row0 + rowLength;
+        float dx0 = row0[1] - row0[0], dx1 = row1[1] - row1[0];
+        float h0 = row0[0] + fx * dx0, h1 = row1[0] + fx * dx1;
+        float dy = h1 - h0;
+        float sx = (dx0 + fy * (dx1 - dx0)) * toGridX;
+        float sy = dy * toGridY;
+        float s2 = sx * sx + sy * sy;
+
+        if (z) z[i] = h0 + fy * dy;
+        if (slope) slope[i] = sqrtf(s2);
+        if (normal) {
+            float inv = 1 / sqrtf(s2 + 1);
+            normal[i] = glm::vec3(-sx * inv, -sy * inv, inv);
+        }
+    }
+}
+
+#ifdef USE_SSE2
+//
+// floor of 4 floats, for SSE2, which has no rounding instruction
+//
+static inline __m128 floor4(__m128 v)
+{
+    __m128 t = _mm_cvtepi32_ps(_mm_cvttps_epi32(v));
+    return _mm_sub_ps(t, _mm_and_ps(_mm_cmpgt_ps(t, v), _mm_set1_ps(1.f)));
+}
+
+//
+// smaller of each of 4 ints, for SSE2
+//
+static inline __m128i min4i(__m128i a, __m128i b)
+{
+    __m128i greater = _mm_cmpgt_epi32(a, b);
+    return _mm_or_si128(_mm_and_si128(greater, b),
+                        _mm_andnot_si128(greater, a));
+}
+
+//
+// 4 points at a time with SSE2
+// SSE2 can't gather, so the corner heights are loaded one lane at a time
+//
+void TerrainSampler::sampleSSE2(const glm::vec2 *xy, unsigned int first,
+                                unsigned int last, float *z,
+                                glm::vec3 *normal, float *slope) const
+{
+    float w = float(width), h = float(height);
+    unsigned int rowLength = width + 1;
+    __m128 W = _mm_set1_ps(w), H = _mm_set1_ps(h);
+    __m128 invW = _mm_set1_ps(1 / w), invH = _mm_set1_ps(1 / h);
+    __m128 halfW = _mm_set1_ps(0.5f * w), halfH = _mm_set1_ps(0.5f * h);
+    __m128 toX = _mm_set1_ps(toGridX), toY = _mm_set1_ps(toGridY);
+    __m128 zero = _mm_setzero_ps(), one = _mm_set1_ps(1.f);
+    __m128 sign = _mm_set1_ps(-0.f);
+    __m128i maxX = _mm_set1_epi32(int(width) - 1);
+    __m128i maxY = _mm_set1_epi32(int(height) - 1);
+
+    unsigned int i = first;
+    for(; i + 4 <= last; i += 4) {
+        // 4 x,y pairs to 4 x and 4 y
+        __m128 a = _mm_loadu_ps(&xy[i].x), b = _mm_loadu_ps(&xy[i+2].x);
+        __m128 px = _mm_shuffle_ps(a, b, _MM_SHUFFLE(2,0,2,0));
+        __m128 py = _mm_shuffle_ps(a, b, _MM_SHUFFLE(3,1,3,1));
+
+        // grid position, wrapped into the terrain
+        __m128 gx = _mm_add_ps(_mm_mul_ps(px, toX), halfW);
+        __m128 gy = _mm_add_ps(_mm_mul_ps(py, toY), halfH);
+        gx = _mm_max_ps(_mm_sub_ps(gx, _mm_mul_ps(
+            floor4(_mm_mul_ps(gx, invW)), W)), zero);
+        gy = _mm_max_ps(_mm_sub_ps(gy, _mm_mul_ps(
+            floor4(_mm_mul_ps(gy, invH)), H)), zero);
+        __m128i ix = min4i(_mm_cvttps_epi32(gx), maxX);
+        __m128i iy = min4i(_mm_cvttps_epi32(gy), maxY);
+        __m128 fx = _mm_sub_ps(gx, _mm_cvtepi32_ps(ix));
+        __m128 fy = _mm_sub_ps(gy, _mm_cvtepi32_ps(iy));
+
+        // corners
+        int lx[4], ly[4];
+        float c00[4], c10[4], c01[4], c11[4];
+        _mm_storeu_si128((__m128i*)lx, ix);
+        _mm_storeu_si128((__m128i*)ly, iy);
+        for(int l=0; l < 4; ++l) {
+            const float *row0 = &heights[ly[l] * rowLength + lx[l]];
+            c00[l] = row0[0];
+            c10[l] = row0[1];
+            c01[l] = row0[rowLength];
+            c11[l] = row0[rowLength + 1];
+        }
+        __m128 h00 = _mm_loadu_ps(c00), h10 = _mm_loadu_ps(c10);
+        __m128 h01 = _mm_loadu_ps(c01), h11 = _mm_loadu_ps(c11);
+
+        // bilinear height, and its slope across the square
+        __m128 dx0 = _mm_sub_ps(h10, h00), dx1 = _mm_sub_ps(h11, h01);
+        __m128 h0 = _mm_add_ps(h00, _mm_mul_ps(fx, dx0));
+        __m128 h1 = _mm_add_ps(h01, _mm_mul_ps(fx, dx1));
+        __m128 dy = _mm_sub_ps(h1, h0);
+        __m128 sx = _mm_mul_ps(_mm_add_ps(dx0, _mm_mul_ps(fy,
+            _mm_sub_ps(dx1, dx0))), toX);
+        __m128 sy = _mm_mul_ps(dy, toY);
+        __m128 s2 = _mm_add_ps(_mm_mul_ps(sx, sx), _mm_mul_ps(sy, sy));
+
+        if (z)
+            _mm_storeu_ps(z + i, _mm_add_ps(h0, _mm_mul_ps(fy, dy)));
+        if (slope)
+            _mm_storeu_ps(slope + i, _mm_sqrt_ps(s2));
+        if (normal) {
+            __m128 inv = _mm_div_ps(one, _mm_sqrt_ps(_mm_add_ps(s2, one)));
+            float nx[4], ny[4], nz[4];
+            _mm_storeu_ps(nx, _mm_mul_ps(_mm_xor_ps(sx, sign), inv));
+            _mm_storeu_ps(ny, _mm_mul_ps(_mm_xor_ps(sy, sign), inv));
+            _mm_storeu_ps(nz, inv);
+            for(int l=0; l < 4; ++l)
+                normal[i + l] = glm::vec3(nx[l], ny[l], nz[l]);
+        }
+    }
+
+    // leftovers
+    sampleScalar(xy, i, last, z, normal, slope);
+}
+
+//
+// 8 points at a time with AVX2
+// same operations as sampleSSE2, but with gathers for the corners
+//
+TARGET_AVX2
+void TerrainSampler::sampleAVX2(const glm::vec2 *xy, unsigned int first,
+                                unsigned int last, float *z,
+                                glm::vec3 *normal, float *slope) const
+{
+    float w = float(width), h = float(height);
+    __m256 W = _mm256_set1_ps(w), H = _mm256_set1_ps(h);
+    __m256 invW = _mm256_set1_ps(1 / w), invH = _mm256_set1_ps(1 / h);
+    __m256 halfW = _mm256_set1_ps(0.5f * w), halfH = _mm256_set1_ps(0.5f * h);
+    __m256 toX = _mm256_set1_ps(toGridX), toY = _mm256_set1_ps(toGridY);
+    __m256 zero = _mm256_setzero_ps(), one = _mm256_set1_ps(1.f);
+    __m256 sign = _mm256_set1_ps(-0.f);
+    __m256i maxX = _mm256_set1_epi32(int(width) - 1);
+    __m256i maxY = _mm256_set1_epi32(int(height) - 1);
+    __m256i rowLength = _mm256_set1_epi32(int(width) + 1);
+    __m256i right = _mm256_set1_epi32(1);
+    const float *base = &heights[0];
+
+    unsigned int i = first;
+    for(; i + 8 <= last; i += 8) {
+        // 8 x,y pairs to 8 x and 8 y: the shuffles work within each
+        // 128-bit half, leaving 64-bit pairs to put back in order
+        __m256 a = _mm256_loadu_ps(&xy[i].x), b = _mm256_loadu_ps(&xy[i+4].x);
+        __m256 px = _mm256_castpd_ps(_mm256_permute4x64_pd(_mm256_castps_pd(
+            _mm256_shuffle_ps(a, b, _MM_SHUFFLE(2,0,2,0))),
+            _MM_SHUFFLE(3,1,2,0)));
+        __m256 py = _mm256_castpd_ps(_mm256_permute4x64_pd(_mm256_castps_pd(
+            _mm256_shuffle_ps(a, b, _MM_SHUFFLE(3,1,3,1))),
+            _MM_SHUFFLE(3,1,2,0)));
+
+        // grid position, wrapped into the terrain
+        __m256 gx = _mm256_add_ps(_mm256_mul_ps(px, toX), halfW);
+        __m256 gy = _mm256_add_ps(_mm256_mul_ps(py, toY), halfH);
+        gx = _mm256_max_ps(_mm256_sub_ps(gx, _mm256_mul_ps(
+            _mm256_floor_ps(_mm256_mul_ps(gx, invW)), W)), zero);
+        gy = _mm256_max_ps(_mm256_sub_ps(gy, _mm256_mul_ps(
+            _mm256_floor_ps(_mm256_mul_ps(gy, invH)), H)), zero);
+        __m256i ix = _mm256_min_epi32(_mm256_cvttps_epi32(gx), maxX);
+        __m256i iy = _mm256_min_epi32(_mm256_cvttps_epi32(gy), maxY);
+        __m256 fx = _mm256_sub_ps(gx, _mm256_cvtepi32_ps(ix));
+        __m256 fy = _mm256_sub_ps(gy, _mm256_cvtepi32_ps(iy));
+
+        // corners
+        __m256i i00 = _mm256_add_epi32(_mm256_mullo_epi32(iy, rowLength), ix);
+        __m256i i01 = _mm256_add_epi32(i00, rowLength);
+        __m256 h00 = _mm256_i32gather_ps(base, i00, 4);
+        __m256 h10 = _mm256_i32gather_ps(base, _mm256_add_epi32(i00, right), 4);
+        __m256 h01 = _mm256_i32gather_ps(base, i01, 4);
+        __m256 h11 = _mm256_i32gather_ps(base, _mm256_add_epi32(i01, right), 4);
+
+        // bilinear height, and its slope across the square
+        __m256 dx0 = _mm256_sub_ps(h10, h00), dx1 = _mm256_sub_ps(h11, h01);
+        __m256 h0 = _mm256_add_ps(h00, _mm256_mul_ps(fx, dx0));
+        __m256 h1 = _mm256_add_ps(h01, _mm256_mul_ps(fx, dx1));
+        __m256 dy = _mm256_sub_ps(h1, h0);
+        __m256 sx = _mm256_mul_ps(_mm256_add_ps(dx0, _mm256_mul_ps(fy,
+            _mm256_sub_ps(dx1, dx0))), toX);
+        __m256 sy = _mm256_mul_ps(dy, toY);
+        __m256 s2 = _mm256_add_ps(_mm256_mul_ps(sx, sx), _mm256_mul_ps(sy, sy));
+
+        if (z)
+            _mm256_storeu_ps(z + i,
+                             _mm256_add_ps(h0, _mm256_mul_ps(fy, dy)));
+        if (slope)
+            _mm256_storeu_ps(slope + i, _mm256_sqrt_ps(s2));
+        if (normal) {
+            __m256 inv = _mm256_div_ps(one,
+                                       _mm256_sqrt_ps(_mm256_add_ps(s2, one)));
+            float nx[8], ny[8], nz[8];
+            _mm256_storeu_ps(nx, _mm256_mul_ps(_mm256_xor_ps(sx, sign), inv));
+            _mm256_storeu_ps(ny, _mm256_mul_ps(_mm256_xor_ps(sy, sign), inv));
+            _mm256_storeu_ps(nz, inv);
+            for(int l=0; l < 8; ++l)
+                normal[i + l] = glm::vec3(nx[l], ny[l], nz[l]);
+        }
+    }
+
+    // leftovers
+    sampleScalar(xy, i, last, z, normal, slope);
+}
+
+#endif
+
+//
+// sample with the chosen kernel, in blocks across the pool if given
+//
+void TerrainSampler::sample(const glm::vec2 *xy, unsigned int count,
+                            float *z, glm::vec3 *normal, float *slope,
+                            ThreadPool *pool, TerrainMesh::Kernel kernel) const
+{
+    if (kernel == TerrainMesh::KERNEL_AUTO)
+        kernel = TerrainMesh::kernelSupported(TerrainMesh::KERNEL_AVX2)
+            ? TerrainMesh::KERNEL_AVX2
+            : TerrainMesh::kernelSupported(TerrainMesh::KERNEL_SSE2)
+            ? TerrainMesh::KERNEL_SSE2 : TerrainMesh::KERNEL_SCALAR;
+
+    // points per block, a multiple of every kernel's width
+    const unsigned int BLOCK = 1024;
+    auto blocks = [&](unsigned int b0, unsigned int b1) {
+        unsigned int first = b0 * BLOCK;
+        unsigned int last = std::min(b1 * BLOCK, count);
+        switch (kernel) {
+#ifdef USE_SSE2
+        case TerrainMesh::KERNEL_AVX2:
+            sampleAVX2(xy, first, last, z, normal, slope);
+            break;
+        case TerrainMesh::KERNEL_SSE2:
+            sampleSSE2(xy, first, last, z, normal, slope);
+            break;
+#endif
+        default:
+            sampleScalar(xy, first, last, z, normal, slope);
+            break;
+        }
+    };
+    unsigned int numBlocks = (count + BLOCK - 1) / BLOCK;
+    if (pool)
+        pool->parallelFor(0, numBlocks, blocks);
+    else
+        blocks(0, numBlocks);
+}
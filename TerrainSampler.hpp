@@ -0,0 +1,75 @@
+// ground height, normal and slope at any world position, many at a time
+// CPU only, and never changes once made, so any number of threads can
+// sample the same one at once
+//
+// Heights are bilinear across each grid square, between the same vertex
+// heights TerrainMesh uses, and positions outside the terrain wrap
+// around just as the mesh build does with x%w and y%h, so the terrain
+// repeats forever in every direction. The SSE2 and AVX2 kernels do 4 or
+// 8 points at a time with every operation in the same order as the
+// scalar one, so all give identical results.
+#ifndef TerrainSampler_hpp
+#define TerrainSampler_hpp
+
+#include "TerrainMesh.hpp"
+#include <glm/glm.hpp>
+#include <vector>
+
+class Heightfield;
+class HeightPyramid;
+class ThreadPool;
+
+class TerrainSampler {
+// private data
+private:
+    // world z of each vertex, (width+1) x (height+1) in [y][x] order
+    std::vector<float> heights;
+    float toGridX, toGridY;         // world to grid scale
+
+    // no copying
+    TerrainSampler(const TerrainSampler &);
+    TerrainSampler &operator=(const TerrainSampler &);
+
+    // sample points first to last-1 with kernel
+    void sampleScalar(const glm::vec2 *xy, unsigned int first,
+                      unsigned int last, float *z, glm::vec3 *normal,
+                      float *slope) const;
+    void sampleSSE2(const glm::vec2 *xy, unsigned int first,
+                    unsigned int last, float *z, glm::vec3 *normal,
+                    float *slope) const;
+    void sampleAVX2(const glm::vec2 *xy, unsigned int first,
+                    unsigned int last, float *z, glm::vec3 *normal,
+                    float *slope) const;
+
+// public data
+public:
+    unsigned int width, height;     // grid squares, as TerrainMesh
+    glm::vec3 mapSize;              // size of terrain in world space
+
+// public methods
+public:
+    // snapshot of elevation, placed as TerrainMesh would
+    TerrainSampler(const Heightfield &elevation, const glm::vec3 &mapSize);
+
+    // snapshot of the current heights of a pyramid, edits included
+    explicit TerrainSampler(const HeightPyramid &pyramid);
+
+    // for each of count world space points xy[i], store the ground
+    // height in world units at z[i], the unit surface normal at
+    // normal[i], and the slope, rise over run in the steepest direction,
+    // at slope[i]. Any output can be null to skip it.
+    // If pool is given, points are spread across it in blocks.
+    void sample(const glm::vec2 *xy, unsigned int count, float *z,
+                glm::vec3 *normal = 0, float *slope = 0,
+                ThreadPool *pool = 0,
+                TerrainMesh::Kernel kernel = TerrainMesh::KERNEL_AUTO) const;
+
+    // ground height at one point
+    float heightAt(const glm::vec2 &xy) const {
+        float h;
+        sampleScalar(&xy, 0, 1, &h, 0, 0);
+        return h;
+    }
+};
+
+#endif
@@ -0,0 +1,39 @@
+// texture read from disk, baked or not
+
+#include "TextureFile.hpp"
+#include "ImagePPM.hpp"
+#include <string>
+
+//
+// load baked chain if there is one, otherwise the image
+//
+TextureFile::TextureFile(const char *ppmName) : ppm(0)
+{
+    std::string bakedName(ppmName);
+    bakedName = bakedName.substr(0, bakedName.find_last_of('.')) + ".mip";
+    if (mips.load(bakedName.c_str()))
+        mips.prefetch();
+    else {
+        ppm = new ImagePPM(ppmName);
+        ppm->prefetch();
+    }
+}
+
+//
+// free image, if any
+//
+TextureFile::~TextureFile()
+{
+    delete ppm;
+}
+
+//
+// upload, with all mip levels
+//
+void TextureFile::loadTexture(unsigned int textureID) const
+{
+    if (ppm)
+        ppm->loadTexture(textureID);
+    else
+        mips.loadTexture(textureID);
+}
@@ -0,0 +1,37 @@
+// texture read from disk: a mip chain baked by BakeMips if there is one
+// next to the image (same name but .mip extension), or the image itself
+#ifndef TextureFile_hpp
+#define TextureFile_hpp
+
+#include "MipChain.hpp"
+
+struct ImagePPM;
+
+class TextureFile {
+// private data
+private:
+    MipChain mips;              // baked mip chain
+    ImagePPM *ppm;              // or source image if not baked
+
+    // no copying
+    TextureFile(const TextureFile &);
+    TextureFile &operator=(const TextureFile &);
+
+// public methods
+public:
+    // read texture, preferring the baked version
+    // the file is mapped and read in, so it's ready to upload
+    explicit TextureFile(const char *ppmName);
+    ~TextureFile();
+
+    // baked mip chain, or NULL if there isn't one
+    const MipChain *baked() const { return ppm ? 0 : &mips; }
+
+    // source image, or NULL if baked
+    const ImagePPM *image() const { return ppm; }
+
+    // upload, with all mip levels
+    void loadTexture(unsigned int textureID) const;
+};
+
+#endif
@@ -0,0 +1,393 @@
+// replace textures in the background, a little at a time
+
+#include "TextureStreamer.hpp"
+#include "TextureFile.hpp"
+#include "MipChain.hpp"
+#include "BlockCompress.hpp"
+#include "ImagePPM.hpp"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// using core modern OpenGL
+#include <GL/glew.h>
+#include <GLFW/glfw3.h>
+
+// GL compressed format for MipChain::Format, or 0 if not compressed
+static GLenum compressedFormat(unsigned int format)
+{
+    switch (format) {
+    case MipChain::BC1: return GL_COMPRESSED_RGB_S3TC_DXT1_EXT;
+    case MipChain::BC4: return GL_COMPRESSED_RED_RGTC1;
+    case MipChain::BC5: return GL_COMPRESSED_RG_RGTC2;
+    default: return 0;
+    }
+}
+
+//
+// 2x2 box filter an 8-bit rgb image of width x height into the next
+// smaller mip level, at least 1 texel each way
+//
+static void halveRGB(const unsigned char *in, unsigned int width,
+                     unsigned int height, unsigned char *out)
+{
+    unsigned int outWidth = width > 1 ? width / 2 : 1;
+    unsigned int outHeight = height > 1 ? height / 2 : 1;
+    for(unsigned int y=0; y < outHeight; ++y) {
+        const unsigned char *a = in + size_t(2*y < height ? 2*y : 0) * width * 3;
+        const unsigned char *b = 2*y+1 < height ? a + size_t(width) * 3 : a;
+        for(unsigned int x=0; x < outWidth; ++x) {
+            unsigned int x0 = 2*x < width ? 2*x : 0;
+            unsigned int x1 = 2*x+1 < width ? 2*x+1 : x0;
+            for(unsigned int c=0; c < 3; ++c)
+                *out++ = (unsigned char)((a[3*x0+c] + a[3*x1+c] +
+                                          b[3*x0+c] + b[3*x1+c] + 2) / 4);
+        }
+    }
+}
+
+//
+// create staging buffers and start loader
+//
+TextureStreamer::TextureStreamer()
+    : uploadNext(0), fillNext(0), pending(0), quit(false)
+{
+    // buffers that stay mapped need GL 4.4 or ARB_buffer_storage
+    // otherwise, free buffers are mapped and unmapped again to upload
+    persistent = GLEW_ARB_buffer_storage || GLEW_VERSION_4_4;
+    for(int i=0; i < RING_SIZE; ++i) {
+        Slot &slot = ring[i];
+        glGenBuffers(1, &slot.bufferID);
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, slot.bufferID);
+        if (persistent) {
+            GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT |
+                               GL_MAP_COHERENT_BIT;
+            glBufferStorage(GL_PIXEL_UNPACK_BUFFER, SLICE_BYTES, 0, flags);
+            slot.data = (unsigned char*)glMapBufferRange(
+                GL_PIXEL_UNPACK_BUFFER, 0, SLICE_BYTES, flags);
+        }
+        else {
+            glBufferData(GL_PIXEL_UNPACK_BUFFER, SLICE_BYTES, 0,
+                         GL_STREAM_DRAW);
+            slot.data = 0;
+            mapSlot(slot);
+        }
+        slot.fence = 0;
+        slot.state = FREE;
+        slot.job = 0;
+    }
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+    loader = std::thread([this]() { load(); });
+}
+
+//
+// stop loader, then free buffers and unfinished textures
+//
+TextureStreamer::~TextureStreamer()
+{
+    {
+        std::unique_lock<std::mutex> hold(lock);
+        quit = true;
+    }
+    changed.notify_all();
+    loader.join();
+
+    for(int i=0; i < RING_SIZE; ++i) {
+        Slot &slot = ring[i];
+        if (slot.fence) glDeleteSync(slot.fence);
+        if (slot.data) {
+            glBindBuffer(GL_PIXEL_UNPACK_BUFFER, slot.bufferID);
+            glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+        }
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+        glDeleteBuffers(1, &slot.bufferID);
+    }
+
+    for(size_t i=0; i < jobs.size(); ++i) {
+        if (jobs[i]->textureID) glDeleteTextures(1, &jobs[i]->textureID);
+        delete jobs[i];
+    }
+}
+
+//
+// queue a texture to load
+//
+void TextureStreamer::replace(const char *file, unsigned int *textureID)
+{
+    Request request;
+    request.file = file;
+    request.target = textureID;
+
+    std::unique_lock<std::mutex> hold(lock);
+    requests.push_back(request);
+    ++pending;
+    changed.notify_all();
+}
+
+//
+// true if any replacements are still in progress
+//
+bool TextureStreamer::busy()
+{
+    std::unique_lock<std::mutex> hold(lock);
+    return pending > 0;
+}
+
+//
+// loader thread: read requested files and copy them into the ring
+//
+void TextureStreamer::load()
+{
+    std::unique_lock<std::mutex> hold(lock);
+    for(;;) {
+        while (!quit && requests.empty())
+            changed.wait(hold);
+        if (quit) return;
+        Request request = requests.front();
+        requests.pop_front();
+
+        Job *job = new Job;
+        job->target = request.target;
+        job->textureID = 0;
+        jobs.push_back(job);
+        hold.unlock();
+
+        // describe texture, then send each level
+        bool done = true;
+        TextureFile file(request.file.c_str());
+        if (const MipChain *mips = file.baked()) {
+            job->format = mips->format();
+            for(unsigned int l=0; l < mips->levels(); ++l) {
+                job->width.push_back(mips->info(l).width);
+                job->height.push_back(mips->info(l).height);
+            }
+
+            // BC1 is an extension, so decode here if it's missing
+            bool decode = job->format == MipChain::BC1 &&
+                          !GLEW_EXT_texture_compression_s3tc;
+            if (decode) job->format = MipChain::RGB8;
+
+            std::vector<unsigned char> rgb;
+            for(unsigned int l=0; done && l < mips->levels(); ++l) {
+                const unsigned char *data = mips->data(l);
+                if (decode) {
+                    rgb.resize(size_t(job->width[l]) * job->height[l] * 3);
+                    decodeBC1(data, job->width[l], job->height[l], &rgb[0]);
+                    data = &rgb[0];
+                }
+                done = sendLevel(job, l, data, l+1 == mips->levels());
+            }
+        }
+        else {
+            // not baked, so build the levels here, where it doesn't hold
+            // up drawing as glGenerateMipmap would
+            const ImagePPM *image = file.image();
+            job->format = MipChain::RGB8;
+            unsigned int w = image->width, h = image->height;
+            job->width.push_back(w);
+            job->height.push_back(h);
+            while (w > 1 || h > 1) {
+                w = w > 1 ? w / 2 : 1;
+                h = h > 1 ? h / 2 : 1;
+                job->width.push_back(w);
+                job->height.push_back(h);
+            }
+
+            // each level is made from the one before, kept until sent
+            unsigned int levels = unsigned(job->width.size());
+            std::vector<unsigned char> level[2];
+            const unsigned char *data = (const unsigned char*)image->image;
+            for(unsigned int l=0; done && l < levels; ++l) {
+                done = sendLevel(job, l, data, l+1 == levels);
+                if (done && l+1 < levels) {
+                    std::vector<unsigned char> &next = level[l & 1];
+                    next.resize(size_t(job->width[l+1]) * job->height[l+1] * 3);
+                    halveRGB(data, job->width[l], job->height[l], &next[0]);
+                    data = &next[0];
+                }
+            }
+        }
+
+        hold.lock();
+        if (!done) return;      // told to quit part way through
+    }
+}
+
+//
+// copy slices of one level into free staging buffers
+//
+bool TextureStreamer::sendLevel(Job *job, unsigned int level,
+                                const unsigned char *data, bool lastLevel)
+{
+    // compressed data is sent in whole rows of 4x4 blocks
+    unsigned int width = job->width[level], height = job->height[level];
+    unsigned int unitRows = compressedFormat(job->format) ? 4 : 1;
+    unsigned int unitBytes = (unsigned int)MipChain::levelBytes(
+        MipChain::Format(job->format), width, unitRows);
+    unsigned int sliceRows = SLICE_BYTES / unitBytes * unitRows;
+    if (sliceRows == 0) {
+        fprintf(stderr, "texture rows too large to stream\n");
+        exit(1);
+    }
+
+    for(unsigned int y=0; y < height; y += sliceRows) {
+        unsigned int rows = height - y < sliceRows ? height - y : sliceRows;
+        unsigned int bytes = (rows + unitRows-1) / unitRows * unitBytes;
+
+        // wait for the next buffer to be free
+        std::unique_lock<std::mutex> hold(lock);
+        Slot &slot = ring[fillNext];
+        while (!quit && slot.state != FREE)
+            changed.wait(hold);
+        if (quit) return false;
+
+        // copy without holding the lock, nothing else touches a free slot
+        hold.unlock();
+        memcpy(slot.data, data + size_t(y / unitRows) * unitBytes, bytes);
+        hold.lock();
+
+        slot.job = job;
+        slot.level = level;
+        slot.y = y;
+        slot.rows = rows;
+        slot.bytes = bytes;
+        slot.last = lastLevel && y + rows == height;
+        slot.state = FILLED;
+        fillNext = (fillNext + 1) % RING_SIZE;
+    }
+    return true;
+}
+
+//
+// map free buffer so the loader can fill it
+//
+void TextureStreamer::mapSlot(Slot &slot)
+{
+    if (persistent) return;
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, slot.bufferID);
+    slot.data = (unsigned char*)glMapBufferRange(
+        GL_PIXEL_UNPACK_BUFFER, 0, SLICE_BYTES,
+        GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+}
+
+//
+// unmap filled buffer so GL can use it
+//
+void TextureStreamer::unmapSlot(Slot &slot)
+{
+    if (persistent) return;
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, slot.bufferID);
+    glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    slot.data = 0;
+}
+
+//
+// recycle finished buffers, then upload filled ones within budget
+//
+bool TextureStreamer::update(unsigned int budget)
+{
+    std::unique_lock<std::mutex> hold(lock);
+
+    // buffers whose uploads are done can be filled again
+    for(int i=0; i < RING_SIZE; ++i) {
+        Slot &slot = ring[i];
+        if (slot.state != IN_FLIGHT) continue;
+        GLenum status = glClientWaitSync(slot.fence, 0, 0);
+        if (status == GL_ALREADY_SIGNALED || status == GL_CONDITION_SATISFIED) {
+            glDeleteSync(slot.fence);
+            slot.fence = 0;
+            mapSlot(slot);
+            slot.state = FREE;
+            changed.notify_all();
+        }
+    }
+
+    // upload in order, always at least one slice so large slices progress
+    bool replaced = false;
+    unsigned int sent = 0;
+    while (ring[uploadNext].state == FILLED &&
+           (sent == 0 || sent + ring[uploadNext].bytes <= budget)) {
+        Slot &slot = ring[uploadNext];
+        sent += slot.bytes;
+        upload(slot);
+        if (slot.last) {
+            finish(slot.job);
+            replaced = true;
+        }
+        uploadNext = (uploadNext + 1) % RING_SIZE;
+    }
+    return replaced;
+}
+
+//
+// copy one slice from its buffer into the new texture
+//
+void TextureStreamer::upload(Slot &slot)
+{
+    Job *job = slot.job;
+    GLenum compressed = compressedFormat(job->format);
+
+    // first slice: make texture with space for all levels
+    if (job->textureID == 0) {
+        glGenTextures(1, &job->textureID);
+        glBindTexture(GL_TEXTURE_2D, job->textureID);
+        for(unsigned int l=0; l < job->width.size(); ++l) {
+            unsigned int w = job->width[l], h = job->height[l];
+            if (compressed)
+                glCompressedTexImage2D(GL_TEXTURE_2D, l, compressed, w, h, 0,
+                    GLsizei(MipChain::levelBytes(MipChain::Format(job->format),
+                                                 w, h)), 0);
+            else
+                glTexImage2D(GL_TEXTURE_2D, l, GL_RGB, w, h, 0,
+                             GL_RGB, GL_UNSIGNED_BYTE, 0);
+        }
+    }
+
+    unmapSlot(slot);
+    glBindTexture(GL_TEXTURE_2D, job->textureID);
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, slot.bufferID);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    if (compressed)
+        glCompressedTexSubImage2D(GL_TEXTURE_2D, slot.level, 0, slot.y,
+                                  job->width[slot.level], slot.rows,
+                                  compressed, slot.bytes, 0);
+    else
+        glTexSubImage2D(GL_TEXTURE_2D, slot.level, 0, slot.y,
+                        job->width[slot.level], slot.rows,
+                        GL_RGB, GL_UNSIGNED_BYTE, 0);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    slot.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    slot.state = IN_FLIGHT;
+}
+
+//
+// all levels sent: finish texture and swap it in
+// called with lock held
+//
+void TextureStreamer::finish(Job *job)
+{
+    glBindTexture(GL_TEXTURE_2D, job->textureID);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, 0);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL,
+                    GLint(job->width.size()) - 1);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER,
+                    GL_LINEAR_MIPMAP_LINEAR);
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    glDeleteTextures(1, job->target);
+    *job->target = job->textureID;
+
+    for(size_t i=0; i < jobs.size(); ++i)
+        if (jobs[i] == job) {
+            jobs.erase(jobs.begin() + i);
+            break;
+        }
+    delete job;
+    --pending;
+}
@@ -0,0 +1,119 @@
+// replace textures in the background, a little at a time
+//
+// Texture files are read on a loader thread, which copies them a slice
+// of rows at a time into a ring of mapped pixel unpack buffers. Each
+// frame, update() uploads filled slices up to a byte budget with
+// glTexSubImage2D, and uses fences to tell when a buffer can be reused.
+// The new data goes into a new texture, which only replaces the old one
+// once every level is complete, so the old texture stays in use until
+// then and a swap never holds up a frame. Textures without a baked mip
+// chain have their levels built on the loader thread too, rather than
+// with glGenerateMipmap at the end.
+#ifndef TextureStreamer_hpp
+#define TextureStreamer_hpp
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+class TextureStreamer {
+// public constants
+public:
+    enum { RING_SIZE = 4 };                 // staging buffers
+    enum { SLICE_BYTES = 1 << 20 };         // size of each staging buffer
+    enum { FRAME_BUDGET = 2 << 20 };        // default bytes per update
+
+// private types
+private:
+    // texture being streamed
+    struct Job {
+        unsigned int *target;       // texture ID to replace when done
+        unsigned int textureID;     // new texture, or 0 until first slice
+        unsigned int format;        // MipChain::Format of data
+        std::vector<unsigned int> width, height;    // size of each level
+    };
+
+    // staging buffer and what's in it
+    enum SlotState { FREE, FILLED, IN_FLIGHT };
+    struct Slot {
+        unsigned int bufferID;      // GL pixel unpack buffer
+        unsigned char *data;        // mapped buffer, loader copies here
+        struct __GLsync *fence;     // signaled when upload is done
+        SlotState state;
+
+        Job *job;                   // texture this slice belongs to
+        unsigned int level;         // mip level
+        unsigned int y, rows;       // first row and number of rows
+        unsigned int bytes;         // bytes of data
+        bool last;                  // last slice of job
+    };
+
+    // queued request
+    struct Request {
+        std::string file;           // texture file name
+        unsigned int *target;       // texture ID to replace
+    };
+
+// private data
+private:
+    bool persistent;            // true if buffers stay mapped
+    Slot ring[RING_SIZE];       // staging buffers
+    unsigned int uploadNext;    // next slot to upload, GL thread only
+
+    // loader thread and state shared with it
+    std::thread loader;
+    std::mutex lock;                    // protects everything below
+    std::condition_variable changed;    // signal state change
+    std::deque<Request> requests;       // textures to load, oldest first
+    std::vector<Job*> jobs;             // textures started but not done
+    unsigned int fillNext;              // next slot for loader to fill
+    unsigned int pending;               // requests not yet swapped in
+    bool quit;                          // true to stop loader thread
+
+    // no copying
+    TextureStreamer(const TextureStreamer &);
+    TextureStreamer &operator=(const TextureStreamer &);
+
+    // loader thread loop
+    void load();
+
+    // copy slices of one level into the ring
+    // return false if told to quit part way
+    bool sendLevel(Job *job, unsigned int level, const unsigned char *data,
+                   bool lastLevel);
+
+    // map or unmap buffer for slot (if not persistently mapped)
+    void mapSlot(Slot &slot);
+    void unmapSlot(Slot &slot);
+
+    // upload one filled slot
+    void upload(Slot &slot);
+
+    // job done, swap in new texture for old
+    void finish(Job *job);
+
+// public methods
+public:
+    // create buffers and start loader thread, needs GL context
+    TextureStreamer();
+
+    // stop loading and free buffers, needs GL context
+    ~TextureStreamer();
+
+    // start replacing *textureID with the texture in file
+    // uses the baked mip chain next to the file if there is one
+    // *textureID changes when the new texture is completely loaded
+    void replace(const char *file, unsigned int *textureID);
+
+    // call once per frame to upload at most budget bytes
+    // returns true if any texture was replaced
+    bool update(unsigned int budget = FRAME_BUDGET);
+
+    // true if any replacements are still in progress
+    bool busy();
+};
+
+#endif
@@ -0,0 +1,157 @@
+// pool of worker threads for background tasks and parallel loops
+
+#include "ThreadPool.hpp"
+#include <atomic>
+#include <memory>
+
+//
+// start worker threads
+//
+ThreadPool::ThreadPool(unsigned int numThreads) : busy(0), quit(false)
+{
+    if (numThreads == 0)
+        numThreads = std::thread::hardware_concurrency();
+    if (numThreads == 0)        // hardware_concurrency may not know
+        numThreads = 1;
+
+    for(unsigned int i=0; i < numThreads; ++i)
+        workers.push_back(std::thread(&ThreadPool::worker, this));
+}
+
+//
+// finish any remaining work and stop workers
+//
+ThreadPool::~ThreadPool()
+{
+    {
+        std::unique_lock<std::mutex> guard(lock);
+        quit = true;
+    }
+    wake.notify_all();
+    for(unsigned int i=0; i < workers.size(); ++i)
+        workers[i].join();
+}
+
+//
+// each worker runs tasks until told to quit
+//
+void ThreadPool::worker()
+{
+    std::unique_lock<std::mutex> guard(lock);
+    for(;;) {
+        // sleep until there is something to do
+        while (tasks.empty() && !quit)
+            wake.wait(guard);
+        if (tasks.empty())
+            return;             // quitting, and nothing left to do
+
+        // run next task without holding the lock
+        std::function<void()> task = tasks.front();
+        tasks.pop_front();
+        ++busy;
+        guard.unlock();
+        task();
+        guard.lock();
+        --busy;
+
+        if (tasks.empty() && busy == 0)
+            idle.notify_all();
+    }
+}
+
+//
+// queue a task
+//
+void ThreadPool::run(const std::function<void()> &task)
+{
+    {
+        std::unique_lock<std::mutex> guard(lock);
+        tasks.push_back(task);
+    }
+    wake.notify_one();
+}
+
+//
+// wait for all tasks to finish
+//
+void ThreadPool::wait()
+{
+    std::unique_lock<std::mutex> guard(lock);
+    while (!tasks.empty() || busy != 0)
+        idle.wait(guard);
+}
+
+//
+// state shared by everyone working on one parallelFor
+// held by shared_ptr, since helpers may start after the loop is done
+//
+namespace {
+    struct LoopState {
+        std::atomic<unsigned int> next;     // next band to claim
+        unsigned int numBands;              // total bands
+        unsigned int finished;              // bands completed
+        std::mutex lock;                    // protects finished
+        std::condition_variable done;       // signaled when all finished
+
+        // claim and run bands until there are none left
+        void work(unsigned int begin, unsigned int end, unsigned int bandSize,
+                  const std::function<void(unsigned int,unsigned int)> &body)
+        {
+            unsigned int count = 0;
+            for(unsigned int band = next++; band < numBands; band = next++) {
+                unsigned int b = begin + band * bandSize;
+                unsigned int e = (end - b > bandSize) ? b + bandSize : end;
+                body(b, e);
+                ++count;
+            }
+
+            if (count) {
+                std::unique_lock<std::mutex> guard(lock);
+                finished += count;
+                if (finished == numBands)
+                    done.notify_all();
+            }
+        }
+    };
+}
+
+//
+// run body over bands of [begin,end)
+//
+void ThreadPool::parallelFor(unsigned int begin, unsigned int end,
+                             const std::function<void(unsigned int,unsigned int)> &body,
+                             unsigned int grain)
+{
+    if (end <= begin) return;
+
+    // a few bands per thread helps balance uneven work
+    unsigned int count = end - begin;
+    unsigned int bands = 4 * (size() + 1);
+    unsigned int bandSize = (count + bands - 1) / bands;
+    if (bandSize < grain) bandSize = grain;
+    bands = (count + bandSize - 1) / bandSize;
+
+    // single band: just do it here
+    if (bands == 1) {
+        body(begin, end);
+        return;
+    }
+
+    std::shared_ptr<LoopState> state(new LoopState);
+    state->next = 0;
+    state->numBands = bands;
+    state->finished = 0;
+
+    // helpers only touch body while holding an unfinished band, and
+    // we don't return until all bands are finished
+    const std::function<void(unsigned int,unsigned int)> *bodyPtr = &body;
+    unsigned int helpers = bands - 1 < size() ? bands - 1 : size();
+    for(unsigned int i=0; i < helpers; ++i)
+        run([=]() { state->work(begin, end, bandSize, *bodyPtr); });
+
+    // work here too, then wait for stragglers
+    state->work(begin, end, bandSize, body);
+    std::unique_lock<std::mutex> guard(state->lock);
+    while (state->finished != state->numBands)
+        state->done.wait(guard);
+}
@@ -0,0 +1,69 @@
+// pool of worker threads for background tasks and parallel loops
+#ifndef ThreadPool_hpp
+#define ThreadPool_hpp
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+class ThreadPool {
+// private data
+private:
+    std::vector<std::thread> workers;           // worker threads
+    std::deque< std::function<void()> > tasks;  // queued tasks
+    std::mutex lock;                            // protects everything below
+    std::condition_variable wake;               // signal workers
+    std::condition_variable idle;               // signal wait()
+    unsigned int busy;                          // tasks currently running
+    bool quit;                                  // true to shut down
+
+    // pools cannot be copied
+    ThreadPool(const ThreadPool &);
+    ThreadPool &operator=(const ThreadPool &);
+
+    // worker thread loop
+    void worker();
+
+// public methods
+public:
+    // start numThreads workers, or one per hardware thread if 0
+    explicit ThreadPool(unsigned int numThreads = 0);
+
+    // finish queued tasks then stop all workers
+    ~ThreadPool();
+
+    // number of worker threads
+    unsigned int size() const { return (unsigned int)workers.size(); }
+
+    // queue task to run on some worker
+    void run(const std::function<void()> &task);
+
+    // queue task returning a value, which can be collected from the
+    // returned future once it is ready
+    template <typename R>
+    std::future<R> async(const std::function<R()> &task) {
+        std::shared_ptr< std::packaged_task<R()> >
+            job(new std::packaged_task<R()>(task));
+        std::future<R> result = job->get_future();
+        run([job]() { (*job)(); });
+        return result;
+    }
+
+    // wait until all queued tasks have finished
+    void wait();
+
+    // call body(bandBegin, bandEnd) for bands covering [begin,end)
+    // spread across the pool, returning when every band is done.
+    // The calling thread works on bands too, so this is safe to use
+    // from inside a task. grain is the minimum band size.
+    void parallelFor(unsigned int begin, unsigned int end,
+                     const std::function<void(unsigned int, unsigned int)> &body,
+                     unsigned int grain = 1);
+};
+
+#endif
@@ -0,0 +1,65 @@
+// read tiles from a tiled heightmap pyramid
+
+#include "TilePyramid.hpp"
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef _WIN32
+// don't complain if we use standard IO functions instead of windows-only
+#pragma warning( disable: 4996 )
+#define fseeko _fseeki64
+#endif
+
+//
+// open and read index
+//
+TilePyramid::TilePyramid(const char *name)
+{
+    fp = fopen(name, "rb");
+    if (!fp) {
+        fprintf(stderr, "error opening %s\n", name);
+        exit(1);
+    }
+
+    if (fread(&header, sizeof(header), 1, fp) != 1 ||
+        memcmp(header.magic, "TPYR", 4) != 0 ||
+        header.version != VERSION || header.tileSize == 0) {
+        fprintf(stderr, "%s is not a version %d tile pyramid\n", name, VERSION);
+        exit(1);
+    }
+
+    // count tiles in each level
+    levelStart = new unsigned int[header.levels + 1];
+    levelStart[0] = 0;
+    for(unsigned int l=0; l < header.levels; ++l)
+        levelStart[l+1] = levelStart[l] + tilesX(l) * tilesY(l);
+
+    // tile index follows header
+    tiles = new TileInfo[levelStart[header.levels]];
+    if (fread(tiles, sizeof(TileInfo), levelStart[header.levels], fp)
+        != levelStart[header.levels]) {
+        fprintf(stderr, "truncated tile index in %s\n", name);
+        exit(1);
+    }
+}
+
+//
+// close file
+//
+TilePyramid::~TilePyramid()
+{
+    fclose(fp);
+    delete[] tiles;
+    delete[] levelStart;
+}
+
+//
+// seek to tile data and read it
+//
+bool TilePyramid::readTile(unsigned int level, unsigned int tx, unsigned int ty,
+                           uint16_t *samples) const
+{
+    size_t count = size_t(header.tileSize) * header.tileSize;
+    return fseeko(fp, tile(level, tx, ty).offset, SEEK_SET) == 0
+        && fread(samples, sizeof(uint16_t), count, fp) == count;
+}
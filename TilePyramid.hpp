@@ -0,0 +1,91 @@
+// tiled multi-resolution heightmap container
+//
+// File layout, all values in native byte order:
+//   TilePyramid::Header
+//   TilePyramid::TileInfo for every tile: level 0 first, each level
+//       in row-major tile order
+//   tile data: tileSize*tileSize 16-bit samples per tile, row-major.
+//       Edge tiles are padded by repeating the last row/column.
+// Level 0 is the full resolution map, each following level is half the
+// size (rounding up) down to a level that fits in a single tile.
+// Coarse tiles are averages, but their height bounds are for all the
+// full resolution samples beneath them, so anything inside the bounds
+// at one level is inside them at every coarser level.
+#ifndef TilePyramid_hpp
+#define TilePyramid_hpp
+
+#include <stdio.h>
+#include <stdint.h>
+
+class TilePyramid {
+// public types
+public:
+    enum { VERSION = 2 };           // 2: bounds from level 0 samples
+
+    struct Header {
+        char magic[4];              // "TPYR"
+        uint32_t version;           // TilePyramid::VERSION
+        uint32_t width, height;     // level 0 size in samples
+        uint32_t tileSize;          // samples along each tile edge
+        uint32_t levels;            // number of pyramid levels
+        uint32_t maxval;            // maximum sample value of source
+    };
+
+    struct TileInfo {
+        uint64_t offset;            // file position of tile data
+        uint16_t minHeight;         // smallest level 0 sample under tile
+        uint16_t maxHeight;         // largest level 0 sample under tile
+        uint32_t reserved;          // pad to 16 bytes
+    };
+
+// private data
+private:
+    FILE *fp;                   // open container file
+    Header header;              // header from file
+    TileInfo *tiles;            // tile index for all levels
+    unsigned int *levelStart;   // index of first tile in each level
+
+    // no copying
+    TilePyramid(const TilePyramid &);
+    TilePyramid &operator=(const TilePyramid &);
+
+// public methods
+public:
+    // size of level, given size of level 0
+    static unsigned int levelSize(unsigned int size0, unsigned int level) {
+        for(; level > 0; --level) size0 = (size0 + 1) / 2;
+        return size0;
+    }
+
+    // tiles needed to cover size samples
+    static unsigned int tileCount(unsigned int size, unsigned int tileSize) {
+        return (size + tileSize - 1) / tileSize;
+    }
+
+    // open existing container and read the tile index
+    TilePyramid(const char *filename);
+    ~TilePyramid();
+
+    const Header &info() const { return header; }
+
+    // number of tiles across and down in a level
+    unsigned int tilesX(unsigned int level) const {
+        return tileCount(levelSize(header.width, level), header.tileSize);
+    }
+    unsigned int tilesY(unsigned int level) const {
+        return tileCount(levelSize(header.height, level), header.tileSize);
+    }
+
+    // index entry for one tile
+    const TileInfo &tile(unsigned int level,
+                         unsigned int tx, unsigned int ty) const {
+        return tiles[levelStart[level] + ty * tilesX(level) + tx];
+    }
+
+    // read one tile into samples[tileSize*tileSize]
+    // return false on read error
+    bool readTile(unsigned int level, unsigned int tx, unsigned int ty,
+                  uint16_t *samples) const;
+};
+
+#endif
@@ -0,0 +1,386 @@
+//
+// TileTerrain: cut a large heightmap into a tiled, multi-resolution
+// TilePyramid (see TilePyramid.hpp)
+//
+// usage: TileTerrain [-t tileSize] [-j threads] input.ppm output.tpyr
+//
+// Input is a binary P5 (grey) or P6 (color) file, 8 or 16 bits per
+// channel. As in Terrain, height comes from the first channel.
+//
+// The input is streamed one strip of tiles at a time. Each level keeps
+// just one strip in memory, and the downsampled rows from a finished
+// strip go straight into the next level's strip, so memory use depends
+// on the image width and tile size, but not on the image height.
+//
+
+#include "TilePyramid.hpp"
+#include "ThreadPool.hpp"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <chrono>
+
+#ifdef _WIN32
+// don't complain if we use standard IO functions instead of windows-only
+#pragma warning( disable: 4996 )
+#endif
+
+//
+// read one header value, skipping white space and comments
+//
+static unsigned int readValue(FILE *fp, const char *name)
+{
+    int c = fgetc(fp);
+    for(;;) {
+        if (c == '#')                   // comment to end of line
+            while (c != '\n' && c != EOF) c = fgetc(fp);
+        else if (c == ' ' || c == '\t' || c == '\r' || c == '\n')
+            c = fgetc(fp);
+        else
+            break;
+    }
+
+    if (c < '0' || c > '9') {
+        fprintf(stderr, "bad header in %s\n", name);
+        exit(1);
+    }
+
+    unsigned int value = 0;
+    for(; c >= '0' && c <= '9'; c = fgetc(fp))
+        value = value*10 + (c - '0');
+    return value;               // character after value is consumed
+}
+
+//
+// streaming pyramid writer
+//
+class PyramidWriter {
+// private data
+private:
+    // one level of the pyramid
+    struct Level {
+        unsigned int width, height; // size of level
+        unsigned int tilesX;        // tiles across level
+        unsigned int rows;          // rows currently in strip
+        unsigned int stripY;        // tile row of current strip
+        uint16_t *strip;            // tileSize rows of width samples
+
+        // lowest and highest level 0 sample under each one in strip,
+        // so tile bounds hold for the full resolution heights
+        // level 0 has no separate copies, both are just strip
+        uint16_t *low, *high;
+    };
+
+    FILE *fp;                       // output file
+    TilePyramid::Header header;     // output header
+    Level *level;                   // per-level state
+    TilePyramid::TileInfo *index;   // tile index for all levels
+    unsigned int *levelStart;       // first index entry for each level
+    uint16_t *tileData;             // one strip of tiles, ready to write
+    uint64_t offset;                // current end of file
+    ThreadPool &pool;               // threads for parallel work
+
+    // write tiles for a strip, then pass it down to the next level
+    void flushStrip(unsigned int l);
+
+// public methods
+public:
+    PyramidWriter(const char *name, unsigned int width, unsigned int height,
+                  unsigned int tileSize, unsigned int maxval, ThreadPool &pool);
+    ~PyramidWriter();
+
+    // next row to fill in level 0
+    uint16_t *nextRow() {
+        return level[0].strip + size_t(level[0].rows) * level[0].width;
+    }
+
+    // row from nextRow() has been filled
+    void addRow() {
+        if (++level[0].rows == header.tileSize)
+            flushStrip(0);
+    }
+
+    // flush partial strips and write index
+    void finish();
+
+    // total levels and tiles
+    unsigned int levels() const { return header.levels; }
+    unsigned int tiles() const { return levelStart[header.levels]; }
+    uint64_t bytes() const { return offset; }
+
+    // memory used by strips and tile buffer
+    size_t stripBytes() const;
+};
+
+//
+// set up levels and reserve space for the index
+//
+PyramidWriter::PyramidWriter(const char *name,
+                             unsigned int width, unsigned int height,
+                             unsigned int tileSize, unsigned int maxval,
+                             ThreadPool &threads)
+    : pool(threads)
+{
+    fp = fopen(name, "wb");
+    if (!fp) {
+        fprintf(stderr, "error creating %s\n", name);
+        exit(1);
+    }
+
+    // levels go down to one that fits in a single tile
+    memcpy(header.magic, "TPYR", 4);
+    header.version = TilePyramid::VERSION;
+    header.width = width;
+    header.height = height;
+    header.tileSize = tileSize;
+    header.maxval = maxval;
+    header.levels = 1;
+    while (TilePyramid::levelSize(width, header.levels-1) > tileSize ||
+           TilePyramid::levelSize(height, header.levels-1) > tileSize)
+        ++header.levels;
+
+    level = new Level[header.levels];
+    levelStart = new unsigned int[header.levels + 1];
+    levelStart[0] = 0;
+    for(unsigned int l=0; l < header.levels; ++l) {
+        Level &lv = level[l];
+        lv.width = TilePyramid::levelSize(width, l);
+        lv.height = TilePyramid::levelSize(height, l);
+        lv.tilesX = TilePyramid::tileCount(lv.width, tileSize);
+        lv.rows = lv.stripY = 0;
+        lv.strip = new uint16_t[size_t(tileSize) * lv.width];
+        lv.low = lv.high = lv.strip;
+        if (l > 0) {
+            lv.low = new uint16_t[size_t(tileSize) * lv.width];
+            lv.high = new uint16_t[size_t(tileSize) * lv.width];
+        }
+        levelStart[l+1] = levelStart[l] +
+            lv.tilesX * TilePyramid::tileCount(lv.height, tileSize);
+    }
+
+    // level 0 has the widest strip, so its tile buffer works for all
+    tileData = new uint16_t[size_t(level[0].tilesX) * tileSize * tileSize];
+
+    // header, then index placeholder, then tile data
+    index = new TilePyramid::TileInfo[tiles()];
+    memset(index, 0, tiles() * sizeof(TilePyramid::TileInfo));
+    fwrite(&header, sizeof(header), 1, fp);
+    fwrite(index, sizeof(TilePyramid::TileInfo), tiles(), fp);
+    offset = sizeof(header) + uint64_t(tiles()) * sizeof(TilePyramid::TileInfo);
+}
+
+//
+// free level data
+//
+PyramidWriter::~PyramidWriter()
+{
+    for(unsigned int l=0; l < header.levels; ++l) {
+        if (l > 0) {
+            delete[] level[l].low;
+            delete[] level[l].high;
+        }
+        delete[] level[l].strip;
+    }
+    delete[] level;
+    delete[] levelStart;
+    delete[] index;
+    delete[] tileData;
+}
+
+//
+// write strip as tiles and downsample into next level
+//
+void PyramidWriter::flushStrip(unsigned int l)
+{
+    Level &lv = level[l];
+    unsigned int T = header.tileSize;
+    size_t tileSamples = size_t(T) * T;
+    TilePyramid::TileInfo *info =
+        index + levelStart[l] + size_t(lv.stripY) * lv.tilesX;
+
+    // cut strip into tiles, padding with the last row and column, and
+    // bound them by the full resolution samples they cover
+    const Level *src = &lv;
+    uint16_t *dst = tileData;
+    pool.parallelFor(0, lv.tilesX, [=](unsigned int t0, unsigned int t1) {
+        for(unsigned int tx = t0; tx < t1; ++tx) {
+            uint16_t *tile = dst + tx * tileSamples;
+            uint16_t lo = 0xffff, hi = 0;
+            for(unsigned int y=0; y < T; ++y) {
+                unsigned int sy = y < src->rows ? y : src->rows - 1;
+                size_t start = size_t(sy) * src->width;
+                const uint16_t *row = src->strip + start;
+                const uint16_t *rowLow = src->low + start;
+                const uint16_t *rowHigh = src->high + start;
+                for(unsigned int x=0; x < T; ++x) {
+                    unsigned int sx = tx*T + x;
+                    if (sx >= src->width) sx = src->width - 1;
+                    tile[size_t(y)*T + x] = row[sx];
+                    if (rowLow[sx] < lo) lo = rowLow[sx];
+                    if (rowHigh[sx] > hi) hi = rowHigh[sx];
+                }
+            }
+            info[tx].minHeight = lo;
+            info[tx].maxHeight = hi;
+        }
+    });
+
+    // tiles in a strip are written together, one after another
+    for(unsigned int tx=0; tx < lv.tilesX; ++tx)
+        info[tx].offset = offset + tx * tileSamples * sizeof(uint16_t);
+    fwrite(tileData, sizeof(uint16_t), lv.tilesX * tileSamples, fp);
+    offset += lv.tilesX * tileSamples * sizeof(uint16_t);
+
+    // 2x2 box filter down into the next level, carrying the lowest and
+    // highest samples along, since the averages lie between them
+    // strips always start on an even row, so pairs never span strips
+    if (l+1 < header.levels) {
+        Level &next = level[l+1];
+        unsigned int outRows = (lv.rows + 1) / 2;
+        size_t outStart = size_t(next.rows) * next.width;
+        const Level *in = &lv;
+        const Level *out = &next;
+        pool.parallelFor(0, outRows, [=](unsigned int r0, unsigned int r1) {
+            for(unsigned int r = r0; r < r1; ++r) {
+                unsigned int y0 = 2*r, y1 = 2*r+1 < in->rows ? 2*r+1 : 2*r;
+                size_t a = size_t(y0) * in->width, b = size_t(y1) * in->width;
+                size_t o = outStart + size_t(r) * out->width;
+                for(unsigned int x=0; x < out->width; ++x) {
+                    unsigned int x0 = 2*x, x1 = 2*x+1 < in->width ? 2*x+1 : 2*x;
+                    const uint16_t *v = in->strip;
+                    out->strip[o+x] = uint16_t((v[a+x0] + v[a+x1] +
+                                                v[b+x0] + v[b+x1] + 2) / 4);
+                    v = in->low;
+                    out->low[o+x] = std::min(std::min(v[a+x0], v[a+x1]),
+                                             std::min(v[b+x0], v[b+x1]));
+                    v = in->high;
+                    out->high[o+x] = std::max(std::max(v[a+x0], v[a+x1]),
+                                              std::max(v[b+x0], v[b+x1]));
+                }
+            }
+        }, 8);
+
+        // full strips make T/2 rows, so the next strip fills exactly
+        next.rows += outRows;
+        if (next.rows == T)
+            flushStrip(l+1);
+    }
+
+    lv.rows = 0;
+    ++lv.stripY;
+}
+
+//
+// flush remaining partial strips, top level last, and write index
+//
+void PyramidWriter::finish()
+{
+    for(unsigned int l=0; l < header.levels; ++l)
+        if (level[l].rows > 0)
+            flushStrip(l);
+
+    fseek(fp, sizeof(header), SEEK_SET);
+    fwrite(index, sizeof(TilePyramid::TileInfo), tiles(), fp);
+    if (fclose(fp) != 0) {
+        fprintf(stderr, "error writing tile pyramid\n");
+        exit(1);
+    }
+    fp = 0;
+}
+
+//
+// strip and tile buffer memory
+//
+size_t PyramidWriter::stripBytes() const
+{
+    size_t total = size_t(level[0].tilesX) * header.tileSize * header.tileSize;
+    for(unsigned int l=0; l < header.levels; ++l)
+        total += size_t(header.tileSize) * level[l].width * (l > 0 ? 3 : 1);
+    return total * sizeof(uint16_t);
+}
+
+
+int main(int argc, char *argv[])
+{
+    unsigned int tileSize = 256, threads = 0;
+    int arg = 1;
+    for(; arg < argc && argv[arg][0] == '-'; ++arg) {
+        if (strcmp(argv[arg], "-t") == 0 && arg+1 < argc)
+            tileSize = atoi(argv[++arg]);
+        else if (strcmp(argv[arg], "-j") == 0 && arg+1 < argc)
+            threads = atoi(argv[++arg]);
+        else
+            break;
+    }
+    if (argc - arg != 2 || tileSize < 2 || tileSize % 2) {
+        fprintf(stderr, "usage: %s [-t tileSize] [-j threads] "
+                "input.ppm output.tpyr\n"
+                "  tileSize must be even, default 256\n", argv[0]);
+        return 1;
+    }
+    const char *inName = argv[arg], *outName = argv[arg+1];
+
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+    // read header
+    FILE *in = fopen(inName, "rb");
+    if (!in) {
+        fprintf(stderr, "error opening %s\n", inName);
+        return 1;
+    }
+    unsigned int channels = 0;
+    if (fgetc(in) == 'P') {
+        int c = fgetc(in);
+        if (c == '5') channels = 1;
+        if (c == '6') channels = 3;
+    }
+    if (!channels) {
+        fprintf(stderr, "unknown image format %s\n", inName);
+        return 1;
+    }
+    unsigned int width = readValue(in, inName);
+    unsigned int height = readValue(in, inName);
+    unsigned int maxval = readValue(in, inName);
+    if (width == 0 || height == 0 || maxval == 0 || maxval > 65535) {
+        fprintf(stderr, "bad header in %s\n", inName);
+        return 1;
+    }
+    unsigned int bytes = maxval > 255 ? 2 : 1;
+
+    ThreadPool pool(threads);
+    PyramidWriter out(outName, width, height, tileSize, maxval, pool);
+
+    // stream rows, keeping only the first channel
+    size_t rowBytes = size_t(width) * channels * bytes;
+    unsigned char *raw = new unsigned char[rowBytes];
+    for(unsigned int y=0; y < height; ++y) {
+        if (fread(raw, 1, rowBytes, in) != rowBytes) {
+            fprintf(stderr, "%s ends after %u of %u rows\n", inName, y, height);
+            return 1;
+        }
+
+        uint16_t *row = out.nextRow();
+        size_t stride = channels * bytes;
+        if (bytes == 1)
+            for(unsigned int x=0; x < width; ++x)
+                row[x] = raw[x * stride];
+        else                    // 16-bit samples are big-endian
+            for(unsigned int x=0; x < width; ++x)
+                row[x] = uint16_t(raw[x*stride] << 8 | raw[x*stride + 1]);
+        out.addRow();
+    }
+    delete[] raw;
+    fclose(in);
+
+    out.finish();
+
+    double seconds = std::chrono::duration<double>(
+        std::chrono::steady_clock::now() - start).count();
+    printf("%s: %ux%u, %u levels, %u tiles of %ux%u, %.1f MB\n",
+           outName, width, height, out.levels(), out.tiles(),
+           tileSize, tileSize, out.bytes() / 1048576.);
+    printf("%.2f s on %u threads, %.1f MB of strip buffers\n",
+           seconds, pool.size(), out.stripBytes() / 1048576.);
+    return 0;
+}
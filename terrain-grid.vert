@@ -0,0 +1,63 @@
+// vertex shader for simple terrain demo, procedural grid version
+// same output as terrain.vert, with no vertex data at all
+#version 400 core
+
+// per-frame data
+layout(std140)                  // use standard layout
+uniform SceneData {             // uniform struct name
+    mat4 viewMatrix, viewInverse;
+    mat4 projectionMatrix, projectionInverse;
+    vec3 lightpos;
+    int fog;
+};
+
+// terrain layout
+uniform vec3 gridSize;          // elevation grid width, height and maxval
+uniform vec3 mapSize;           // terrain size in world space
+uniform usampler2D heights;     // elevation samples
+
+// first row of squares in this draw, each instance draws the next row
+uniform int firstRow;
+
+// output to fragment shader
+out vec4 position, light;
+out vec3 tangent, bitangent, normal;
+out vec2 texcoord;
+
+// elevation at a grid location, wrapping like TerrainMesh
+float elevation(ivec2 g) {
+    ivec2 size = ivec2(gridSize.xy);
+    return float(texelFetch(heights, (g + size) % size, 0).r);
+}
+
+void main() {
+    // each row is one strip, alternating the next row and this one, as
+    // in TerrainIndices
+    ivec2 g = ivec2(gl_VertexID / 2,
+                    firstRow + gl_InstanceID + 1 - (gl_VertexID & 1));
+    vec2 grid = vec2(g);
+
+    // surface and light position in view space
+    vec3 pos = (vec3(grid, elevation(g)) / gridSize - 0.5) * mapSize;
+    position = viewMatrix * vec4(pos, 1);
+    light = viewMatrix * vec4(lightpos, 1);
+
+    // tangents and normal from central differences, as TerrainMesh
+    float scale = 0.5 * mapSize.z / gridSize.z;
+    float du = (elevation(g + ivec2(1,0)) - elevation(g - ivec2(1,0))) * scale;
+    float dv = (elevation(g + ivec2(0,1)) - elevation(g - ivec2(0,1))) * scale;
+    vec3 T = normalize(vec3(mapSize.x / gridSize.x, 0, du));
+    vec3 B = normalize(vec3(0, mapSize.y / gridSize.y, dv));
+    vec3 N = normalize(cross(T, B));
+
+    // transform tangents and normal
+    tangent = normalize(mat3(viewMatrix) * T);
+    bitangent = normalize(mat3(viewMatrix) * B);
+    normal = normalize(N * mat3(viewInverse));
+
+    // texture coordinate from grid location
+    texcoord = grid / gridSize.xy;
+
+    // rendering position
+    gl_Position = projectionMatrix * position;
+}
@@ -0,0 +1,86 @@
+// vertex shader for simple terrain demo, level of detail version
+// same output as terrain.vert, from the elevation texture alone
+#version 400 core
+
+// per-frame data
+layout(std140)                  // use standard layout
+uniform SceneData {             // uniform struct name
+    mat4 viewMatrix, viewInverse;
+    mat4 projectionMatrix, projectionInverse;
+    vec3 lightpos;
+    int fog;
+};
+
+// terrain layout, from TerrainQuadtree
+uniform vec3 gridSize;          // elevation grid width, height and maxval
+uniform vec3 mapSize;           // terrain size in world space
+uniform int gridWidth;          // vertices per row of a node
+uniform usampler2D heights;     // elevation samples
+
+// per-node data
+uniform vec2 nodeOrigin;        // first grid sample of node
+uniform float nodeStep;         // grid samples between vertices
+uniform vec2 morphRange;        // distance to start and finish morphing
+
+// output to fragment shader
+out vec4 position, light;
+out vec3 tangent, bitangent, normal;
+out vec2 texcoord;
+
+// elevation at a grid location, wrapping like TerrainMesh
+float elevation(ivec2 g) {
+    ivec2 size = ivec2(gridSize.xy);
+    return float(texelFetch(heights, (g + size) % size, 0).r);
+}
+
+// world space position of a grid location
+vec3 surface(vec2 grid) {
+    return (vec3(grid, elevation(ivec2(grid))) / gridSize - 0.5) * mapSize;
+}
+
+// tangents and normal at a grid location, computed as TerrainMesh does
+void frame(vec2 grid, out vec3 T, out vec3 B, out vec3 N) {
+    ivec2 g = ivec2(grid);
+    float scale = 0.5 * mapSize.z / gridSize.z;
+    float du = (elevation(g + ivec2(1,0)) - elevation(g - ivec2(1,0))) * scale;
+    float dv = (elevation(g + ivec2(0,1)) - elevation(g - ivec2(0,1))) * scale;
+    T = normalize(vec3(mapSize.x / gridSize.x, 0, du));
+    B = normalize(vec3(0, mapSize.y / gridSize.y, dv));
+    N = normalize(cross(T, B));
+}
+
+void main() {
+    // grid location from vertex number, and the same vertex on the next
+    // coarser grid, where odd vertices slide back onto even ones
+    vec2 local = vec2(gl_VertexID % gridWidth, gl_VertexID / gridWidth);
+    vec2 fine = nodeOrigin + local * nodeStep;
+    vec2 coarse = fine - mod(local, 2) * nodeStep;
+    fine = min(fine, gridSize.xy);
+    coarse = min(coarse, gridSize.xy);
+
+    // morph from fine to coarse over the far end of the node's range
+    vec3 camera = viewInverse[3].xyz;
+    vec3 finePos = surface(fine);
+    float k = clamp((distance(finePos, camera) - morphRange.x)
+                    / (morphRange.y - morphRange.x), 0, 1);
+    vec2 grid = mix(fine, coarse, k);
+    vec3 pos = mix(finePos, surface(coarse), k);
+
+    // surface and light position in view space
+    position = viewMatrix * vec4(pos, 1);
+    light = viewMatrix * vec4(lightpos, 1);
+
+    // blend tangents and normal the same way
+    vec3 fineT, fineB, fineN, coarseT, coarseB, coarseN;
+    frame(fine, fineT, fineB, fineN);
+    frame(coarse, coarseT, coarseB, coarseN);
+    tangent = normalize(mat3(viewMatrix) * mix(fineT, coarseT, k));
+    bitangent = normalize(mat3(viewMatrix) * mix(fineB, coarseB, k));
+    normal = normalize(mix(fineN, coarseN, k) * mat3(viewInverse));
+
+    // texture coordinate from grid location
+    texcoord = grid / gridSize.xy;
+
+    // rendering position
+    gl_Position = projectionMatrix * position;
+}
@@ -0,0 +1,56 @@
+// vertex shader for simple terrain demo, packed vertex version
+// same output as terrain.vert, from 8 bytes of input per vertex
+#version 400 core
+
+// per-frame data
+layout(std140)                  // use standard layout
+uniform SceneData {             // uniform struct name
+    mat4 viewMatrix, viewInverse;
+    mat4 projectionMatrix, projectionInverse;
+    vec3 lightpos;
+    int fog;
+};
+
+// mesh layout, from TerrainMesh
+uniform vec3 gridSize;          // elevation grid width, height and maxval
+uniform vec3 mapSize;           // terrain size in world space
+uniform int gridWidth;          // vertices per row
+
+// per-vertex input
+in vec2 vNormal;                // octahedral normal
+in float vHeight;               // elevation sample
+
+// output to fragment shader
+out vec4 position, light;
+out vec3 tangent, bitangent, normal;
+out vec2 texcoord;
+
+void main() {
+    // grid location from vertex number
+    vec2 grid = vec2(gl_VertexID % gridWidth, gl_VertexID / gridWidth);
+
+    // surface and light position in view space
+    vec3 pos = (vec3(grid, vHeight) / gridSize - 0.5) * mapSize;
+    position = viewMatrix * vec4(pos, 1);
+    light = viewMatrix * vec4(lightpos, 1);
+
+    // unfold octahedral normal
+    vec3 N = vec3(vNormal, 1 - abs(vNormal.x) - abs(vNormal.y));
+    if (N.z < 0) N.xy = (1 - abs(N.yx)) * sign(N.xy);
+    N = normalize(N);
+
+    // the u tangent (1,0,du) and v tangent (0,1,dv) of a height field
+    // are both perpendicular to the normal, which fixes du and dv
+    vec3 T = vec3(N.z, 0, -N.x), B = vec3(0, N.z, -N.y);
+
+    // transform tangents and normal
+    tangent = normalize(mat3(viewMatrix) * T);
+    bitangent = normalize(mat3(viewMatrix) * B);
+    normal = normalize(N * mat3(viewInverse));
+
+    // texture coordinate from grid location
+    texcoord = grid / gridSize.xy;
+
+    // rendering position
+    gl_Position = projectionMatrix * position;
+}
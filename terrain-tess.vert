@@ -0,0 +1,21 @@
+// vertex shader for simple terrain demo, tessellated version
+// just the patch corners, terrain-tess.tesc and .tese do the rest
+#version 400 core
+
+// terrain layout
+uniform vec3 gridSize;          // elevation grid width, height and maxval
+uniform int patchSize;          // grid squares across a patch
+uniform int patchesAcross;      // patches per row
+
+// output to tessellation control shader
+out vec2 vGrid;                 // grid location of corner
+
+void main() {
+    // four corners per patch, counterclockwise from the first grid sample
+    int p = gl_VertexID / 4, corner = gl_VertexID % 4;
+    ivec2 offset = ivec2(corner == 1 || corner == 2, corner >= 2);
+    ivec2 origin = ivec2(p % patchesAcross, p / patchesAcross) * patchSize;
+
+    // last patches in each direction may be partly off the grid
+    vGrid = min(vec2(origin + offset * patchSize), gridSize.xy);
+}
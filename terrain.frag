@@ -14,6 +14,8 @@ uniform SceneData {             // uniform struct name
 uniform sampler2D colorTexture;
 uniform sampler2D normalTexture;
 uniform sampler2D glossTexture;
+uniform sampler2DArray horizons;    // HorizonMap, a layer per direction
+uniform sampler2D occlusion;        // OcclusionMap, sky seen from each vertex
 
 // input from vertex shader
 in vec4 position, light;
@@ -31,7 +33,10 @@ void main() {
     vec3 terrainOrigin = viewMatrix[3].xyz / viewMatrix[3].w;
 
     // surface normal, including extra bumps from normal map
-    vec3 nmap = texture(normalTexture, texcoord).xyz * 2 - 1;
+    // only x & y are stored (BC5 has just red & green), so rebuild z
+    vec3 nmap;
+    nmap.xy = texture(normalTexture, texcoord).xy * 2 - 1;
+    nmap.z = sqrt(max(0., 1 - dot(nmap.xy, nmap.xy)));
     vec3 N = normalize(nmap.x * normalize(tangent) +
                        nmap.y * normalize(bitangent) + 
                        nmap.z * normalize(normal));
@@ -50,9 +55,24 @@ void main() {
     float spec = (gloss+2) * pow(N_H, gloss) / (1 + max(0.,V_L));
     float fresnel = 0.04 + 0.96 * pow(1 - V_H, 5);
 
-    // combined specular and diffuse
-    vec3 color = texture(colorTexture, texcoord).rgb;
-    color = mix(color, vec3(spec), fresnel) * N_L;
+    // shadow where the light is below the horizon in its direction,
+    // blending the two nearest directions, and softened over a few
+    // degrees for the size of the light and the 8-bit horizons
+    vec3 Lw = normalize(lightpos);
+    vec3 size = vec3(textureSize(horizons, 0));
+    vec2 uv = texcoord + 0.5 / size.xy;     // vertices are texel centers
+    float a = mod(atan(Lw.y, Lw.x) / 6.2831853 * size.z, size.z);
+    float a0 = floor(a);
+    float horizon = mix(texture(horizons, vec3(uv, a0)).r,
+                        texture(horizons, vec3(uv, mod(a0 + 1, size.z))).r,
+                        a - a0);
+    float lit = smoothstep(horizon - .04, horizon + .04, Lw.z);
+
+    // combined specular and diffuse, plus dim light from the sky
+    // wherever the terrain doesn't hide it
+    vec3 albedo = texture(colorTexture, texcoord).rgb;
+    float sky = 0.15 * texture(occlusion, uv).r;
+    vec3 color = mix(albedo, vec3(spec), fresnel) * N_L * lit + albedo * sky;
 
     // fade to white with fog
     if (fog != 0)